@@ -0,0 +1,174 @@
+/*
+    Copyright 2020 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+   Compares the time it takes to run a program in the evaluators
+   against the time it takes to run the same program compiled by
+   lispbmc in the bytecode interpreter.
+
+   usage: bench_bytecode program.lisp program.bmc [iterations]
+*/
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "heap.h"
+#include "symrepr.h"
+#include "eval_cps.h"
+#include "ec_eval.h"
+#include "print.h"
+#include "tokpar.h"
+#include "prelude.h"
+#include "typedefs.h"
+#include "memory.h"
+#include "env.h"
+#include "bytecode.h"
+
+#define EVAL_CPS_STACK_SIZE 256
+
+bytecode_t bc;
+
+/* load a file, caller is responsible for freeing the returned buffer */
+char *load_file(char *name, unsigned int *size) {
+  FILE *fp = fopen(name, "rb");
+  if (!fp) return NULL;
+
+  fseek(fp, 0, SEEK_END);
+  long fsize = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  if (fsize <= 0) {
+    fclose(fp);
+    return NULL;
+  }
+  char *data = malloc((size_t)fsize + 1);
+  if (!data) {
+    fclose(fp);
+    return NULL;
+  }
+  memset(data, 0, (size_t)fsize + 1);
+  if (fread(data, 1, (size_t)fsize, fp) != (size_t)fsize) {
+    free(data);
+    data = NULL;
+  }
+  fclose(fp);
+  *size = (unsigned int)fsize;
+  return data;
+}
+
+double time_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+void report(char *name, VALUE res, double t, int iterations) {
+  char output[1024];
+  char error[1024];
+
+  int r = print_value(output, 1024, error, 1024, res);
+  printf("%-24s %10.3f ms/iteration   result: %s\n",
+	 name, 1000.0 * t / iterations, r >= 0 ? output : error);
+}
+
+int main(int argc, char **argv) {
+
+  if (argc < 3) {
+    printf("usage: %s program.lisp program.bmc [iterations]\n", argv[0]);
+    return 1;
+  }
+
+  int iterations = 10;
+  if (argc > 3) iterations = atoi(argv[3]);
+  if (iterations < 1) iterations = 1;
+
+  unsigned int src_size;
+  unsigned int bc_size;
+  char *src = load_file(argv[1], &src_size);
+  uint8_t *bc_data = (uint8_t *)load_file(argv[2], &bc_size);
+
+  if (!src || !bc_data) {
+    printf("Error loading input files\n");
+    return 1;
+  }
+
+  unsigned char *memory = malloc(MEMORY_SIZE_16K);
+  unsigned char *bitmap = malloc(MEMORY_BITMAP_SIZE_16K);
+  if (memory == NULL || bitmap == NULL) return 1;
+
+  if (!memory_init(memory, MEMORY_SIZE_16K,
+		   bitmap, MEMORY_BITMAP_SIZE_16K) ||
+      !symrepr_init() ||
+      !heap_init(8192) ||
+      !eval_cps_init_nc(EVAL_CPS_STACK_SIZE, true) ||
+      !env_init()) {
+    printf("Error initializing lispbm\n");
+    return 1;
+  }
+
+  eval_cps_program_nc(prelude_load());
+
+  VALUE bc_val;
+  if (!bytecode_load(&bc, bc_data, bc_size) ||
+      !bytecode_create(&bc_val, &bc)) {
+    printf("Error loading bytecode\n");
+    return 1;
+  }
+
+  UINT sym_id;
+  if (!symrepr_addsym("program-bc", &sym_id)) {
+    printf("Error adding symbol\n");
+    return 1;
+  }
+  *env_get_global_ptr() = env_set(*env_get_global_ptr(), enc_sym(sym_id), bc_val);
+
+  VALUE res = enc_sym(symrepr_nil());
+  double t;
+
+  t = time_now();
+  for (int i = 0; i < iterations; i ++) {
+    res = eval_cps_program_nc(tokpar_parse(src));
+  }
+  report("eval_cps", res, time_now() - t, iterations);
+
+  t = time_now();
+  for (int i = 0; i < iterations; i ++) {
+    res = ec_eval_program(tokpar_parse(src));
+  }
+  report("ec_eval", res, time_now() - t, iterations);
+
+  t = time_now();
+  for (int i = 0; i < iterations; i ++) {
+    res = eval_cps_program_nc(tokpar_parse("(program-bc)"));
+  }
+  report("bytecode (eval_cps)", res, time_now() - t, iterations);
+
+  t = time_now();
+  for (int i = 0; i < iterations; i ++) {
+    res = ec_eval_program(tokpar_parse("(program-bc)"));
+  }
+  report("bytecode (ec_eval)", res, time_now() - t, iterations);
+
+  bytecode_del(&bc);
+  free(bc_data);
+  free(src);
+  symrepr_del();
+  heap_del();
+  return 0;
+}
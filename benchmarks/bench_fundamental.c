@@ -0,0 +1,133 @@
+/*
+    Copyright 2020 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+   Measures the cost of applying the fundamental operations + - * / <
+   and = to two arguments of each numeric type, and of a mixed i28 and
+   float pair, through fundamental_exec. Time spent collecting the
+   boxed results is not counted.
+
+   usage: bench_fundamental [iterations]
+*/
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "heap.h"
+#include "symrepr.h"
+#include "fundamental.h"
+
+#define HEAP_SIZE   8192
+#define NUM_OPS     6
+#define NUM_TYPES   6
+
+double time_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static const UINT ops[NUM_OPS] = {SYM_ADD, SYM_SUB, SYM_MUL, SYM_DIV, SYM_LT, SYM_EQ};
+static const char *op_names[NUM_OPS] = {"+", "-", "*", "/", "<", "="};
+static const char *type_names[NUM_TYPES] = {"i28", "u28", "i32", "u32", "float", "i28 float"};
+
+static VALUE number(unsigned int type, int n, bool first) {
+  switch (type) {
+  case 0: return enc_i(n);
+  case 1: return enc_u((UINT)n);
+  case 2: return enc_I(n);
+  case 3: return enc_U((UINT)n);
+  case 4: return enc_F((FLOAT)n);
+  default: return first ? enc_i(n) : enc_F((FLOAT)n);
+  }
+}
+
+/* Returns nanoseconds per application, or a negative number if the
+   operation fails */
+double run(unsigned int type, unsigned int op, unsigned int iterations) {
+
+  VALUE nil = enc_sym(symrepr_nil());
+  VALUE args[2];
+
+  heap_perform_gc_aux(nil, nil, nil, nil, nil, NULL, 0);
+  args[0] = number(type, 1000, true);
+  args[1] = number(type, 7, false);
+  // Keeps the boxed arguments alive
+  VALUE roots = cons(args[0], cons(args[1], nil));
+
+  VALUE fun = enc_sym(ops[op]);
+  double gc_time = 0.0;
+  double t = time_now();
+
+  for (unsigned int i = 0; i < iterations; i ++) {
+    VALUE r = fundamental_exec(args, 2, fun);
+    if (is_symbol_merror(r)) {
+      double t_gc = time_now();
+      heap_perform_gc_aux(roots, nil, nil, nil, nil, NULL, 0);
+      gc_time += time_now() - t_gc;
+      r = fundamental_exec(args, 2, fun);
+    }
+    if (type_of(r) == VAL_TYPE_SYMBOL &&
+	dec_sym(r) != symrepr_true() &&
+	dec_sym(r) != symrepr_nil()) {
+      return -1.0;
+    }
+  }
+
+  t = time_now() - t - gc_time;
+  return 1e9 * t / iterations;
+}
+
+int main(int argc, char **argv) {
+
+  unsigned int iterations = 10000000;
+
+  if (argc > 1) iterations = (unsigned int)atoi(argv[1]);
+
+  if (!symrepr_init()) {
+    printf("Error initializing symrepr\n");
+    return 1;
+  }
+  if (!heap_init(HEAP_SIZE)) {
+    printf("Error initializing heap\n");
+    return 1;
+  }
+
+  printf("%u applications per operation, ns per application\n", iterations);
+  printf("%-10s", "");
+  for (unsigned int op = 0; op < NUM_OPS; op ++) {
+    printf("%8s", op_names[op]);
+  }
+  printf("\n");
+
+  for (unsigned int type = 0; type < NUM_TYPES; type ++) {
+    printf("%-10s", type_names[type]);
+    for (unsigned int op = 0; op < NUM_OPS; op ++) {
+      double ns = run(type, op, iterations);
+      if (ns < 0) {
+	printf("\nError applying %s to %s\n", op_names[op], type_names[type]);
+	return 1;
+      }
+      printf("%8.2f", ns);
+    }
+    printf("\n");
+  }
+  heap_del();
+  return 0;
+}
@@ -0,0 +1,154 @@
+/*
+    Copyright 2020 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+   Measures the worst case pause of a control loop that allocates a
+   fixed amount per tick and collects when the heap is full, with
+   the sweep done in the collector (mark bits in the cells or in a
+   bitmap), lazily in heap_allocate_cell, incrementally with one
+   gc_incremental_step per allocation and in a nursery.
+
+   usage: bench_gc_pause [num_cells] [ticks]
+*/
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "heap.h"
+#include "symrepr.h"
+
+#define LIST_LENGTH    100   // Cells kept alive per tick
+#define GARBAGE        400   // Cells thrown away per tick
+
+double time_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static VALUE roots;
+static VALUE list;
+static double max_gc;
+static double total_gc;
+static unsigned int num_gc;
+
+static void mark_roots(void) {
+  gc_mark_phase(roots);
+  gc_mark_phase(list);
+}
+
+static VALUE alloc(VALUE car, VALUE cdr) {
+  // One incremental step per allocation, if HEAP_INCREMENTAL_GC
+  gc_incremental_step(mark_roots);
+
+  // A full nursery is collected the way the evaluators do, between steps
+  VALUE c = enc_sym(symrepr_merror());
+  if (!heap_nursery_full()) c = cons(car, cdr);
+  if (!is_ptr(c)) {
+    double t = time_now();
+    heap_perform_gc_aux(roots, enc_sym(symrepr_nil()), car, cdr,
+			enc_sym(symrepr_nil()), NULL, 0);
+    t = time_now() - t;
+    if (t > max_gc) max_gc = t;
+    total_gc += t;
+    num_gc ++;
+    c = cons(car, cdr);
+  }
+  return c;
+}
+
+int run(char *name, unsigned int num_cells, unsigned int ticks, uint32_t options) {
+
+  if (!heap_init_ext(num_cells, options)) {
+    printf("Error initializing heap\n");
+    return 0;
+  }
+
+  VALUE nil = enc_sym(symrepr_nil());
+  // Half of the heap is kept alive in a ring of lists
+  unsigned int num_roots = num_cells / 2 / (LIST_LENGTH + 1);
+
+  roots = nil;
+  for (unsigned int i = 0; i < num_roots; i ++) {
+    roots = alloc(nil, roots);
+  }
+
+  max_gc = 0.0;
+  total_gc = 0.0;
+  num_gc = 0;
+  double max_tick = 0.0;
+  double total = 0.0;
+  VALUE slot = roots;
+
+  for (unsigned int tick = 0; tick < ticks; tick ++) {
+    double t = time_now();
+
+    list = nil;
+    for (unsigned int i = 0; i < LIST_LENGTH; i ++) {
+      list = alloc(enc_u(i), list);
+    }
+    for (unsigned int i = 0; i < GARBAGE; i ++) {
+      alloc(nil, nil);
+    }
+    set_car(slot, list);
+    slot = cdr(slot);
+    if (slot == nil) slot = roots;
+
+    t = time_now() - t;
+    total += t;
+    if (t > max_tick) max_tick = t;
+  }
+
+  heap_state_t hs;
+  heap_get_state(&hs);
+
+  printf("%-12s gc: %3u avg %6.3f ms max %6.3f ms (%7u cells)  incremental: %3u max step %4u cells  tick: avg %6.3f ms max %6.3f ms\n",
+	 name, num_gc,
+	 num_gc ? 1000.0 * total_gc / num_gc : 0.0, 1000.0 * max_gc,
+	 hs.gc_max_pause, hs.gc_num_incremental, hs.gc_max_step,
+	 1000.0 * total / ticks, 1000.0 * max_tick);
+  heap_del();
+  return 1;
+}
+
+int main(int argc, char **argv) {
+
+  unsigned int num_cells = 256 * 1024;
+  unsigned int ticks = 20000;
+
+  if (argc > 1) num_cells = (unsigned int)atoi(argv[1]);
+  if (argc > 2) ticks = (unsigned int)atoi(argv[2]);
+
+  if (!symrepr_init()) {
+    printf("Error initializing symrepr\n");
+    return 1;
+  }
+
+  printf("Heap size: %u cells, %u ticks of %u cells\n",
+	 num_cells, ticks, LIST_LENGTH + GARBAGE);
+
+  if (!run("default", num_cells, ticks, 0) ||
+      !run("bitmap", num_cells, ticks, HEAP_GC_MARK_BITMAP) ||
+      !run("lazy", num_cells, ticks, HEAP_LAZY_SWEEP) ||
+      !run("incremental", num_cells, ticks, HEAP_INCREMENTAL_GC) ||
+      !run("generational", num_cells, ticks, HEAP_GENERATIONAL)) {
+    return 1;
+  }
+  return 0;
+}
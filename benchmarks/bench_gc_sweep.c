@@ -0,0 +1,105 @@
+/*
+    Copyright 2020 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+   Compares mark and sweep times with GC mark bits stored in the cdr
+   of each cell and in a side bitmap (HEAP_GC_MARK_BITMAP).
+
+   usage: bench_gc_sweep [num_cells] [live percent]
+*/
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "heap.h"
+#include "symrepr.h"
+
+#define ITERATIONS 10
+
+double time_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+int run(char *name, unsigned int num_cells, unsigned int live, uint32_t options) {
+
+  if (!heap_init_ext(num_cells, options)) {
+    printf("Error initializing heap\n");
+    return 0;
+  }
+
+  double t_mark = 0.0;
+  double t_sweep = 0.0;
+  VALUE nil = enc_sym(symrepr_nil());
+
+  for (int it = 0; it < ITERATIONS; it ++) {
+    // A live list and garbage interleaved with it
+    VALUE list = nil;
+    unsigned int n = heap_num_free();
+    for (unsigned int i = 0; i < n; i ++) {
+      if (i % 100 < live) {
+	list = cons(enc_u(0), list);
+      } else {
+	cons(nil, nil);
+      }
+    }
+
+    double t = time_now();
+    gc_state_inc();
+    gc_mark_freelist();
+    gc_mark_phase(list);
+    t_mark += time_now() - t;
+
+    t = time_now();
+    gc_sweep_phase();
+    t_sweep += time_now() - t;
+
+    // Drop the live list as well
+    heap_perform_gc(nil);
+  }
+
+  printf("%-10s mark: %8.3f ms   sweep: %8.3f ms\n", name,
+	 1000.0 * t_mark / ITERATIONS,
+	 1000.0 * t_sweep / ITERATIONS);
+  heap_del();
+  return 1;
+}
+
+int main(int argc, char **argv) {
+
+  unsigned int num_cells = 1024 * 1024;
+  unsigned int live = 50;
+
+  if (argc > 1) num_cells = (unsigned int)atoi(argv[1]);
+  if (argc > 2) live = (unsigned int)atoi(argv[2]);
+
+  if (!symrepr_init()) {
+    printf("Error initializing symrepr\n");
+    return 1;
+  }
+
+  printf("Heap size: %u cells, %u%% live\n", num_cells, live);
+
+  if (!run("cdr bit", num_cells, live, 0) ||
+      !run("bitmap", num_cells, live, HEAP_GC_MARK_BITMAP)) {
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,112 @@
+/*
+    Copyright 2020 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+   Times 100000 allocations of mixed array sizes from a 1MB arena,
+   first fit or next fit (MEMORY_NEXT_FIT) and with or without size
+   classes (MEMORY_SIZE_CLASSES). A window of the most recent arrays
+   is kept alive and older ones are freed, as when short strings and
+   arrays are dropped by the collector.
+
+   usage: bench_memory [allocations] [live]
+*/
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "memory.h"
+
+#define MAX_LIVE 16384
+
+static uint32_t arena[MEMORY_SIZE_1M / 4];
+static uint32_t bits[MEMORY_BITMAP_SIZE_1M / 4];
+static uint32_t *live_arrays[MAX_LIVE];
+
+double time_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Words for an array as heap_allocate_array asks for them: mostly
+// short strings, some small arrays and a few large ones.
+static uint32_t array_words(unsigned int *seed) {
+  *seed = *seed * 1103515245 + 12345;
+  unsigned int r = (*seed >> 8) % 100;
+  unsigned int n = (*seed >> 16) & 0xFF;
+  if (r < 70) return 2 + 1 + n % 8;    // strings of up to 32 chars
+  if (r < 95) return 2 + 8 + n % 16;   // arrays of 8 to 23 elements
+  return 2 + 64 + n;                   // arrays of 64 to 319 elements
+}
+
+int run(char *name, unsigned int allocations, unsigned int live, uint32_t options) {
+
+  if (!memory_init_ext((unsigned char *)arena, MEMORY_SIZE_1M,
+		       (unsigned char *)bits, MEMORY_BITMAP_SIZE_1M,
+		       options)) {
+    printf("Error initializing memory\n");
+    return 0;
+  }
+
+  for (unsigned int i = 0; i < live; i ++) {
+    live_arrays[i] = NULL;
+  }
+
+  unsigned int seed = 1;
+  unsigned int failed = 0;
+  double t = time_now();
+
+  for (unsigned int i = 0; i < allocations; i ++) {
+    unsigned int slot = i % live;
+    if (live_arrays[slot]) {
+      memory_free(live_arrays[slot]);
+    }
+    live_arrays[slot] = memory_allocate(array_words(&seed));
+    if (!live_arrays[slot]) failed ++;
+  }
+
+  t = time_now() - t;
+
+  printf("%-14s %8.3f ms  %8.1f ns/allocation  failed: %u  free: %u words  longest free: %u words\n",
+	 name, 1000.0 * t, 1e9 * t / allocations, failed,
+	 memory_num_free(), memory_longest_free());
+  return 1;
+}
+
+int main(int argc, char **argv) {
+
+  unsigned int allocations = 100000;
+  unsigned int live = 1000;
+
+  if (argc > 1) allocations = (unsigned int)atoi(argv[1]);
+  if (argc > 2) live = (unsigned int)atoi(argv[2]);
+  if (live == 0 || live > MAX_LIVE) live = 1000;
+
+  printf("Arena: %u words, %u allocations, %u live\n",
+	 MEMORY_SIZE_1M / 4, allocations, live);
+
+  if (!run("first fit", allocations, live, 0) ||
+      !run("next fit", allocations, live, MEMORY_NEXT_FIT) ||
+      !run("size classes", allocations, live, MEMORY_SIZE_CLASSES) ||
+      !run("both", allocations, live, MEMORY_SIZE_CLASSES | MEMORY_NEXT_FIT)) {
+    return 1;
+  }
+  return 0;
+}
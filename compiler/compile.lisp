@@ -64,7 +64,9 @@
 		     caddr       ;; reg0 <- caddr reg1
 		     car         ;; reg0 <- car reg1
  		     callf       ;; val <- fund-apply proc argl
-                     done))      ;; Computation done
+                     done        ;; Computation done
+		     bnil        ;; pc <- if (= val nil) address
+		     modenv))    ;; binding of symbol in env <- val
 
 ;; OpCode to size in bytes (including arguments)
 (define instr-size
@@ -85,8 +87,11 @@
       (cdr          3)
       (cadr         3)
       (caddr        3)
+      (car          3)
       (callf        1)
       (done         1)
+      (bnil         5)
+      (modenv       5)
       (label        0)))
 
 
@@ -115,6 +120,9 @@
 (define is-let
     (lambda (exp) (= (car exp) 'let)))
 
+(define is-if
+    (lambda (exp) (= (car exp) 'if)))
+
 (define is-progn
     (lambda (exp) (= (car exp) 'progn)))
 
@@ -212,7 +220,7 @@
 			      (regs-modified s1)))
        (list-union (regs-modified s1)
 		   (regs-modified s2))
-       (append (statements s1) (statements s2))))))
+       (append (statements s1) (statements s2)))))
 
 (define append-instr-seqs
     (lambda (seqs)
@@ -275,7 +283,7 @@
 	       (if (is-nil x) acc
 		   (progn
 		     (if (is-label (car x))
-			 (define label-loc (cons (cons (car x) acc) label-loc))
+			 (define label-loc (cons (cons (car x) (cons acc nil)) label-loc))
 			 nil)
 		     (f (cdr x) (+ (lookup (car (car x)) instr-size) acc)))))))
 	(f (car (cdr (cdr s))) 0))))
@@ -350,8 +358,9 @@
 
 (define compile-data-prim
     (lambda (exp target)
-      (mk-instr-seq '() (list target)
-		    `((movimm ,target ,exp)))))
+      (let ((imm (if (is-symbol exp) (new-indirection exp) exp)))
+	(mk-instr-seq '() (list target)
+		      `((movimm ,target ,imm))))))
 
 (define compile-data-list
     (lambda (exp target)
@@ -382,7 +391,9 @@
 							       `((setglbval ,i)
 								 (movimm ,target ,i))))))))
 
-;; Very unsure of how to do this one correctly.
+;; Each variable is bound (to nil) before its value is computed and
+;; the binding is then modified. This way a lambda bound in a let
+;; can refer to itself, as in the evaluators.
 (define compile-let
     (lambda (exp target linkage)
       (append-two-instr-seqs
@@ -395,16 +406,21 @@
 	     (compile-instr-list (car (cdr keyval)) 'val 'next))
 	    (var (car keyval))
 	    (i (new-indirection var)))
-	(append-two-instr-seqs get-value-code
-			       (mk-instr-seq '(val) (list 'env)
-					     `((exenvval ,i)))))))
+	(append-two-instr-seqs
+	 (mk-instr-seq '(env) '(env val)
+		       `((movimm val nil)
+			 (exenvval ,i)))
+	 (preserving '(env)
+		     get-value-code
+		     (mk-instr-seq '(env val) '()
+				   `((modenv ,i))))))))
 
 
 (define compile-progn
     (lambda (exp target linkage)
       (if (is-last-element exp)
 	  (compile-instr-list (car exp) target linkage)
-	  (preserving '(env continue)
+	  (preserving '(env cont)
 		      (compile-instr-list (car exp) target 'next)
 		      (compile-progn (cdr exp) target linkage)))))
 
@@ -420,7 +436,7 @@
 					  `((movimm ,target nil)
 					    (cons ,target env)
 					    (consimm ,target ,proc-entry)
-					    (consimm ,target proc)))) ;; put symbol proc first in list
+					    (consimm ,target ,(new-indirection 'proc))))) ;; put symbol proc first in list
 	  (compile-lambda-body exp proc-entry))
 	 after-lambda))))
 
@@ -438,7 +454,7 @@
 	  (append-instr-seqs
 	   (map (lambda (p)
 		  (mk-instr-seq '(argl) '(env)
-				`((exenvargl ,p))))
+				`((exenvargl ,(new-indirection p)))))
 		formals)))
 	 (compile-instr-list (car (cdr (cdr exp))) 'val 'return)))))
 
@@ -556,11 +572,29 @@
 				(jmpimm ,linkage))))
 	      (if (and (= target 'val)
 		       (= linkage 'return))
-		  (mk-instr-seq '(proc continue) all-regs
+		  (mk-instr-seq '(proc cont) all-regs
 				'((cadr val proc)
 				  (jmpval)))
 		  'compile-error)))))
 
+(define compile-if
+    (lambda (exp target linkage)
+      (let ((f-branch (mk-label "false-branch"))
+	    (after-if (mk-label "after-if"))
+	    (consequent-linkage (if (= linkage 'next) after-if linkage))
+	    (p-code (compile-instr-list (car (cdr exp)) 'val 'next))
+	    (c-code (compile-instr-list (car (cdr (cdr exp))) target consequent-linkage))
+	    (a-code (compile-instr-list (car (cdr (cdr (cdr exp)))) target linkage)))
+	(preserving '(env cont)
+		    p-code
+		    (append-instr-seqs
+		     (list (mk-instr-seq '(val) '()
+					 `((bnil ,f-branch)))
+			   (parallel-instr-seqs
+			    c-code
+			    (append-two-instr-seqs f-branch a-code))
+			   after-if))))))
+
 (define compile-instr-list
     (lambda (exp target linkage)
       (if (is-self-evaluating exp)
@@ -577,9 +611,11 @@
 			      (compile-progn (cdr exp) target linkage)
 			      (if (is-let exp)
 				  (compile-let exp target linkage)
-				  (if (is-list exp)
-				      (compile-application exp target linkage)
-				      (print "Not recognized")))))))))))
+				  (if (is-if exp)
+				      (compile-if exp target linkage)
+				      (if (is-list exp)
+					  (compile-application exp target linkage)
+					  (print "Not recognized"))))))))))))
 
 
 (define compile-program
@@ -603,3 +639,43 @@
       (let ((ir (compile-program prg))
 	    (ir-ops (car (cdr (cdr ir)))))
 	  (ops-out nil ir-ops))))
+
+;; Bytecode generation: Labels are replaced by their location in the
+;; code and each instruction is passed to the bc-out extension.
+;; The symbol indirections used are output using bc-ind.
+
+(define label-addr
+    (lambda (arg)
+      (if (is-list arg)
+	  (if (is-label arg)
+	      (lookup arg label-loc)
+	      arg)
+	  arg)))
+
+(define bytecode-out
+    (lambda (ops)
+      (if ops
+	  (progn
+	    (if (is-label (car ops))
+		nil
+		(bc-out (cons (car (car ops)) (map label-addr (cdr (car ops))))))
+	    (bytecode-out (cdr ops)))
+	  'done)))
+
+(define indirections-out
+    (lambda (inds)
+      (if inds
+	  (progn
+	    (bc-ind (car (cdr (car inds))))
+	    (indirections-out (cdr inds)))
+	  'done)))
+
+(define gen-bytecode
+    (lambda (prg)
+      (let ((ir (compile-program prg))
+	    (ir-ops (car (cdr (cdr ir)))))
+	(progn
+	  (define label-loc '())
+	  (locate-labels ir)
+	  (bytecode-out ir-ops)
+	  (indirections-out symbol-indirections)))))
@@ -25,6 +25,7 @@
 #include <getopt.h>
 #include <termios.h>
 #include <ctype.h>
+#include <string.h>
 
 #include "heap.h"
 #include "symrepr.h"
@@ -36,6 +37,7 @@
 #include "typedefs.h"
 #include "memory.h"
 #include "env.h"
+#include "bytecode.h"
 
 #define EVAL_CPS_STACK_SIZE 256
 
@@ -55,10 +57,9 @@ VALUE ext_print(VALUE *args, int argn) {
     VALUE t = args[i];
 
     if (is_ptr(t) && ptr_type(t) == PTR_TYPE_ARRAY) {
-      array_header_t *array = (array_header_t *)car(t);
-      switch (array->elt_type){
+      switch (array_elt_type(t)){
       case VAL_TYPE_CHAR: {
-	char *data = (char *)array + 8;
+	char *data = array_data(t);
 	printf("%s", data);
 	break;
       }
@@ -117,10 +118,9 @@ int output_arg_assembly(VALUE arg) {
   }
     /* STRING */
   case PTR_TYPE_ARRAY: {
-    array_header_t *array = (array_header_t *)arg;
-    switch (array->elt_type){
+    switch (array_elt_type(arg)){
     case VAL_TYPE_CHAR: {
-      char *data = (char *)array + 8;
+      char *data = array_data(arg);
       fprintf(out_file,"%s", data);
       break;
     }
@@ -138,10 +138,9 @@ int output_arg_assembly(VALUE arg) {
     num  = car(cdr(cdr(arg)));
     if (type_of(name) == PTR_TYPE_ARRAY &&
 	type_of(num)  == VAL_TYPE_I) {
-      array_header_t *array = (array_header_t *)(car(name));
-      switch (array->elt_type){
+      switch (array_elt_type(name)){
       case VAL_TYPE_CHAR: {
-	char *data = (char *)array + 8;
+	char *data = array_data(name);
 	fprintf(out_file,"%s%d", data, dec_i(num));
 	break;
       }
@@ -173,10 +172,9 @@ VALUE ext_output_assembly(VALUE *args, int argn) {
     VALUE num  = car(cdr(cdr(args[0])));
     if (type_of(name) == PTR_TYPE_ARRAY &&
 	type_of(num)  == VAL_TYPE_I) {
-      array_header_t *array = (array_header_t *)(car(name));
-      switch (array->elt_type){
+      switch (array_elt_type(name)){
       case VAL_TYPE_CHAR: {
-	char *data = (char *)array + 8;
+	char *data = array_data(name);
 	char composite[1024];
 	snprintf(composite, 1024, "%s%d", data, dec_i(num));
 	fprintf(out_file,"%-20s", composite);
@@ -216,19 +214,219 @@ VALUE ext_output_assembly(VALUE *args, int argn) {
   return enc_sym(symrepr_nil());  
 }
  
+/* Bytecode output buffers */
+#define BC_BUFFER_SIZE 65536
+
+uint8_t bc_code[BC_BUFFER_SIZE];
+unsigned int bc_code_size = 0;
+uint8_t bc_ind[BC_BUFFER_SIZE];
+unsigned int bc_ind_size = 0;
+unsigned int bc_num_ind = 0;
+
+typedef struct {
+  char *name;
+  uint8_t opcode;
+} opcode_name_t;
+
+opcode_name_t opcode_names[] = {
+  {"jmpcnt",    OP_JMPCNT},
+  {"jmpimm",    OP_JMPIMM},
+  {"jmpval",    OP_JMPVAL},
+  {"movimm",    OP_MOVIMM},
+  {"mov",       OP_MOV},
+  {"lookup",    OP_LOOKUP},
+  {"setglbval", OP_SETGLBVAL},
+  {"push",      OP_PUSH},
+  {"pop",       OP_POP},
+  {"bpf",       OP_BPF},
+  {"exenvargl", OP_EXENVARGL},
+  {"exenvval",  OP_EXENVVAL},
+  {"cons",      OP_CONS},
+  {"consimm",   OP_CONSIMM},
+  {"cdr",       OP_CDR},
+  {"cadr",      OP_CADR},
+  {"caddr",     OP_CADDR},
+  {"car",       OP_CAR},
+  {"callf",     OP_CALLF},
+  {"done",      OP_DONE},
+  {"bnil",      OP_BNIL},
+  {"modenv",    OP_MODENV}
+};
+
+char *reg_names[REG_NUM_REGS] = {"env", "proc", "val", "argl", "cont"};
+
+int bc_put_u8(uint8_t *buf, unsigned int *size, uint8_t v) {
+  if (*size >= BC_BUFFER_SIZE) return 0;
+  buf[(*size)++] = v;
+  return 1;
+}
+
+int bc_put_u32(uint8_t *buf, unsigned int *size, UINT v) {
+  for (int i = 0; i < 4; i ++) {
+    if (!bc_put_u8(buf, size, (uint8_t)(v >> (8 * i)))) return 0;
+  }
+  return 1;
+}
+
+int output_arg_reg(VALUE arg) {
+  if (type_of(arg) != VAL_TYPE_SYMBOL) return 0;
+  const char *name = symrepr_lookup_name(dec_sym(arg));
+  if (!name) return 0;
+  for (uint8_t r = 0; r < REG_NUM_REGS; r ++) {
+    if (strcmp(name, reg_names[r]) == 0) {
+      return bc_put_u8(bc_code, &bc_code_size, r);
+    }
+  }
+  printf("Error: %s is not a register\n", name);
+  return 0;
+}
+
+/* Immediates are stored as VALUEs. Only values that are not
+   heap allocated can be immediates, and symbols other than
+   special symbols must be passed via an indirection */
+int output_arg_imm(VALUE arg) {
+  switch (type_of(arg)) {
+  case VAL_TYPE_I:
+  case VAL_TYPE_U:
+  case VAL_TYPE_CHAR:
+  case PTR_TYPE_SYMBOL_INDIRECTION:
+    break;
+  case VAL_TYPE_SYMBOL:
+    if (dec_sym(arg) < MAX_SPECIAL_SYMBOLS) break;
+    printf("Error: symbol %s without indirection\n", symrepr_lookup_name(dec_sym(arg)));
+    return 0;
+  default:
+    printf("Error: unsupported immediate value\n");
+    return 0;
+  }
+  return bc_put_u32(bc_code, &bc_code_size, (UINT)arg);
+}
+
+int output_arg_addr(VALUE arg) {
+  if (type_of(arg) != VAL_TYPE_I &&
+      type_of(arg) != VAL_TYPE_U) {
+    printf("Error: unresolved address\n");
+    return 0;
+  }
+  return bc_put_u32(bc_code, &bc_code_size, dec_u(arg));
+}
+
 /* ext_output_bytecode
-   args: opcode, arguments
+   args: (opcode arguments ...) with labels resolved to addresses
 */
 VALUE ext_output_bytecode(VALUE *args, int argn) {
-   
+
+  if (argn != 1 || type_of(args[0]) != PTR_TYPE_CONS)
+    return enc_sym(symrepr_eerror());
+
+  VALUE op = car(args[0]);
+  VALUE op_args = cdr(args[0]);
+
+  if (type_of(op) != VAL_TYPE_SYMBOL) return enc_sym(symrepr_eerror());
+  const char *name = symrepr_lookup_name(dec_sym(op));
+  if (!name) return enc_sym(symrepr_eerror());
+
+  int opcode = -1;
+  for (unsigned int i = 0; i < sizeof(opcode_names) / sizeof(opcode_name_t); i ++) {
+    if (strcmp(name, opcode_names[i].name) == 0) {
+      opcode = opcode_names[i].opcode;
+      break;
+    }
+  }
+  if (opcode < 0) {
+    printf("Error: unknown instruction %s\n", name);
+    return enc_sym(symrepr_eerror());
+  }
+
+  int ok = bc_put_u8(bc_code, &bc_code_size, (uint8_t)opcode);
+
+  switch (opcode) {
+  case OP_JMPIMM:
+  case OP_BPF:
+  case OP_BNIL:
+    ok = ok && output_arg_addr(car(op_args));
+    break;
+  case OP_MOVIMM:
+  case OP_LOOKUP:
+  case OP_CONSIMM:
+    ok = ok && output_arg_reg(car(op_args));
+    ok = ok && output_arg_imm(car(cdr(op_args)));
+    break;
+  case OP_SETGLBVAL:
+  case OP_EXENVARGL:
+  case OP_EXENVVAL:
+  case OP_MODENV:
+    ok = ok && output_arg_imm(car(op_args));
+    break;
+  case OP_MOV:
+  case OP_CONS:
+  case OP_CDR:
+  case OP_CADR:
+  case OP_CADDR:
+  case OP_CAR:
+    ok = ok && output_arg_reg(car(op_args));
+    ok = ok && output_arg_reg(car(cdr(op_args)));
+    break;
+  case OP_PUSH:
+  case OP_POP:
+    ok = ok && output_arg_reg(car(op_args));
+    break;
+  default:
+    break;
+  }
+
+  if (!ok) {
+    printf("Error in bc-out (%s)\n", name);
+    return enc_sym(symrepr_eerror());
+  }
   return enc_sym(symrepr_nil());
 }
 
+/* ext_output_symbol_indirection
+   args: (string . indirection)
+*/
 VALUE ext_output_symbol_indirection(VALUE *args, int argn) {
 
+  if (argn != 1 || type_of(args[0]) != PTR_TYPE_CONS)
+    return enc_sym(symrepr_eerror());
+
+  VALUE str = car(args[0]);
+  VALUE ind = cdr(args[0]);
+
+  if (type_of(str) != PTR_TYPE_ARRAY ||
+      type_of(ind) != PTR_TYPE_SYMBOL_INDIRECTION)
+    return enc_sym(symrepr_eerror());
+
+  if (array_elt_type(str) != VAL_TYPE_CHAR) return enc_sym(symrepr_eerror());
+  char *data = array_data(str);
+
+  // Symbol indirections fit in 32 bits also with 64 bit VALUEs
+  int ok = bc_put_u32(bc_ind, &bc_ind_size, (UINT)ind);
+  for (size_t i = 0; ok && i <= strlen(data); i ++) {
+    ok = bc_put_u8(bc_ind, &bc_ind_size, (uint8_t)data[i]);
+  }
+  if (!ok) {
+    printf("Error in bc-ind\n");
+    return enc_sym(symrepr_eerror());
+  }
+  bc_num_ind ++;
   return enc_sym(symrepr_nil());
 }
 
+int write_bytecode(FILE *fp) {
+  uint8_t header[4];
+  unsigned int n = 0;
+
+  bc_put_u32(header, &n, bc_code_size);
+  if (fwrite(header, 1, 4, fp) != 4 ||
+      fwrite(bc_code, 1, bc_code_size, fp) != bc_code_size) return 0;
+  n = 0;
+  bc_put_u32(header, &n, bc_num_ind);
+  if (fwrite(header, 1, 4, fp) != 4 ||
+      fwrite(bc_ind, 1, bc_ind_size, fp) != bc_ind_size) return 0;
+  return 1;
+}
+
 /* load a file, caller is responsible for freeing the returned string */
 char * load_file(FILE *fp) {
   char *file_str = NULL;
@@ -440,6 +638,22 @@ int main(int argc, char **argv) {
     return 0;
   }
 
+  res = extensions_add("bc-out", ext_output_bytecode);
+  if (res)
+    printf("Extension bc-out added.\n");
+  else {
+    printf("Error adding bc-out extension.\n");
+    return 0;
+  }
+
+  res = extensions_add("bc-ind", ext_output_symbol_indirection);
+  if (res)
+    printf("Extension bc-ind added.\n");
+  else {
+    printf("Error adding bc-ind extension.\n");
+    return 0;
+  }
+
   char output[1024];
   char error[1024];
 
@@ -464,12 +678,16 @@ int main(int argc, char **argv) {
   char *comp_str = load_file(fp);
   VALUE f_exp = tokpar_parse(comp_str);
   free(comp_str);
+  if (is_symbol(f_exp) && symrepr_is_error(dec_sym(f_exp))) {
+    printf("Error parsing compile.lisp: %s\n", symrepr_lookup_name(dec_sym(f_exp)));
+    return 1;
+  }
   VALUE c_r = ec_eval_program(f_exp);
 
   r = print_value(output, 1024, error, 1024, c_r);
 
   if (is_symbol(c_r) && symrepr_is_error(dec_sym(c_r))) {
-    printf("Error loading compiler: %s\n", r == 0 ? "UNKNOWN" : "output");
+    printf("Error loading compiler: %s\n", r == 0 ? "UNKNOWN" : output);
   } else {
     printf("Compiler loaded successfully: %s\n", r == 0 ? "UNKNOWN" : output);
   }
@@ -480,7 +698,7 @@ int main(int argc, char **argv) {
   free(file_str);
 
   UINT compiler;
-  if (symrepr_lookup("gen-asm", &compiler)) {
+  if (symrepr_lookup(output_assembler ? "gen-asm" : "gen-bytecode", &compiler)) {
     VALUE invoce_compiler = cons(cons (enc_sym(compiler),
 				       cons(cons (enc_sym(symrepr_quote()),
 						  cons (input_prg, enc_sym(symrepr_nil()))),
@@ -503,6 +721,17 @@ int main(int argc, char **argv) {
     } else {
       printf("%s\n", error);
     }
+
+    if (!output_assembler) {
+      if (is_symbol(compiled_res) && symrepr_is_error(dec_sym(compiled_res))) {
+	printf("Error: Compilation failed\n");
+      } else if (!write_bytecode(out_file)) {
+	printf("Error: Unable to write bytecode\n");
+      } else {
+	printf("Bytecode size: %u bytes, %u symbol indirections\n", bc_code_size, bc_num_ind);
+      }
+    }
+    fclose(out_file);
   } else {
     printf("Error: Compiler not present\n");
   }
@@ -18,6 +18,74 @@
 #ifndef BYTECODE_H_
 #define BYTECODE_H_
 
+#include "typedefs.h"
+
+/*
+   Instruction encoding (see compiler/compile.lisp):
+   The first byte of an instruction is the opcode. Register operands
+   are 1 byte and immediates, symbols and code addresses are 4 byte
+   little endian values.
+
+   Opcode    Size  Operands
+   jmpcnt     1                 pc <- cont
+   jmpimm     5    addr         pc <- addr
+   jmpval     1                 pc <- val
+   movimm     6    reg, imm     reg <- imm
+   mov        3    reg0, reg1   reg0 <- reg1
+   lookup     6    reg, sym     reg <- lookup sym (env, then global env)
+   setglbval  5    sym          global-env <- (sym . val) : global-env
+   push       2    reg          stack[sp++] <- reg
+   pop        2    reg          reg <- stack[--sp]
+   bpf        5    addr         pc <- addr if proc is fundamental or extension
+   exenvargl  5    sym          env <- (sym . (car argl)) : env; argl <- cdr argl
+   exenvval   5    sym          env <- (sym . val) : env
+   cons       3    reg0, reg1   reg0 <- reg1 : reg0
+   consimm    6    reg, imm     reg <- imm : reg
+   cdr        3    reg0, reg1   reg0 <- cdr reg1
+   cadr       3    reg0, reg1   reg0 <- car (cdr reg1)
+   caddr      3    reg0, reg1   reg0 <- car (cdr (cdr reg1))
+   car        3    reg0, reg1   reg0 <- car reg1
+   callf      1                 val <- apply proc argl  (fundamental or extension)
+   done       1                 return val
+   bnil       5    addr         pc <- addr if val is nil
+   modenv     5    sym          binding of sym in env <- val
+
+   Code addresses used as immediates (the continuation register and
+   the entry point of compiled procedures) are encoded as lisp
+   integers.
+*/
+
+#define OP_JMPCNT      0x00
+#define OP_JMPIMM      0x01
+#define OP_JMPVAL      0x02
+#define OP_MOVIMM      0x03
+#define OP_MOV         0x04
+#define OP_LOOKUP      0x05
+#define OP_SETGLBVAL   0x06
+#define OP_PUSH        0x07
+#define OP_POP         0x08
+#define OP_BPF         0x09
+#define OP_EXENVARGL   0x0A
+#define OP_EXENVVAL    0x0B
+#define OP_CONS        0x0C
+#define OP_CONSIMM     0x0D
+#define OP_CDR         0x0E
+#define OP_CADR        0x0F
+#define OP_CADDR       0x10
+#define OP_CAR         0x11
+#define OP_CALLF       0x12
+#define OP_DONE        0x13
+#define OP_BNIL        0x14
+#define OP_MODENV      0x15
+#define OP_NUM_OPCODES 0x16
+
+#define REG_ENV        0
+#define REG_PROC       1
+#define REG_VAL        2
+#define REG_ARGL       3
+#define REG_CONT       4
+#define REG_NUM_REGS   5
+
 typedef struct {
   char* symbol_str;
   VALUE symbol_indirection;
@@ -30,5 +98,21 @@ typedef struct {
   symbol_indirection_t *indirections;
 } bytecode_t;
 
+/*
+   Serialized bytecode (as written by lispbmc):
+   uint32 code_size
+   uint8  code[code_size]
+   uint32 num_indirections
+   num_indirections times:
+     uint32 symbol_indirection
+     char   symbol_str[] (zero terminated)
+*/
+
+extern int bytecode_load(bytecode_t *bc, uint8_t *data, unsigned int size);
+extern void bytecode_del(bytecode_t *bc);
+extern int bytecode_create(VALUE *res, bytecode_t *bc);
+extern VALUE bytecode_eval(VALUE bc, VALUE args,
+			   void (*mark_roots)(void),
+			   void (*relocate_roots)(void));
 
 #endif
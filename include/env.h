@@ -22,8 +22,11 @@
 
 extern int env_init(void);
 extern VALUE *env_get_global_ptr(void);
+extern unsigned int env_num_global_bindings(void);
+extern void env_global_iterate(void (*f)(VALUE binding));
 extern VALUE env_copy_shallow(VALUE env);
 extern VALUE env_lookup(VALUE sym, VALUE env);
+extern VALUE env_binding(VALUE sym, VALUE env);
 extern VALUE env_set(VALUE env, VALUE key, VALUE val);
 extern VALUE env_modify_binding(VALUE env, VALUE key, VALUE val);
 extern VALUE env_build_params_args(VALUE params,
@@ -149,22 +149,60 @@ Aux bits could be used for storing vector size. Up to 30bits should be available
 
 0000 00XX XXXX XXXX XXXX XXXX XXXX X000   : 0x03FF FFF8
 1111 AA00 0000 0000 0000 0000 0000 0000   : 0xFC00 0000 (AA bits left unused for now, future heap growth?)
+ 
+With -D_VALUE64 a value is 64 bits. The lower half is encoded as
+above and the upper half is zero, except for pointers to cells that
+have the cell index in the upper half, for heaps of up to 2^32 cells,
+and 32 bit integers and floats that are stored unboxed there:
+
+ [cell index    | TTTT 0000 0000 0000 0000 0000 0000 0G01]
+ [32 bit number | TTTT 0100 0000 0000 0000 0000 0000 0001]
+
+Symbol indirections are not cells and keep the 32 bit layout, so
+that they fit in a bytecode immediate.
+
+TTTT is PTR_TYPE_BOXED_I, U or F, so type_of is the same in both
+modes, but the PTR_UNBOXED bit makes is_ptr false so the number is
+not taken for a cell by the GC. enc_I, enc_U and enc_F then never
+allocate, and numbers must be decoded with dec_I, dec_U and dec_f
+rather than with car.
  */
 
+#ifdef _VALUE64
+#define CONS_CELL_SIZE              16
+#else
 #define CONS_CELL_SIZE              8
+#endif
+#ifdef _VALUE64
+#define ADDRESS_SHIFT               32
+#else
 #define ADDRESS_SHIFT               3
+#endif
 #define VAL_SHIFT                   4
 
 #define PTR_MASK                    0x00000001u
 #define PTR                         0x00000001u
+#ifdef _VALUE64
+#define PTR_VAL_MASK                0xFFFFFFFF00000000u
+#else
 #define PTR_VAL_MASK                0x03FFFFF8u
+#endif
+#define HEAP_MAX_CELLS              ((PTR_VAL_MASK >> ADDRESS_SHIFT) + 1) // Cells addressable by a pointer
+#define SYM_IND_MASK                0x03FFFFF8u
+#define SYM_IND_SHIFT               3
+#ifdef _VALUE64
+#define PTR_TYPE_MASK               0xF0000000u
+#define PTR_UNBOXED                 0x04000000u // Unboxed 32 bit number, see is_ptr
+#else
 #define PTR_TYPE_MASK               0xFC000000u
+#endif
 
 #define PTR_TYPE_CONS               0x10000000u
 #define PTR_TYPE_BOXED_I            0x20000000u
 #define PTR_TYPE_BOXED_U            0x30000000u
 #define PTR_TYPE_BOXED_F            0x40000000u
 #define PTR_TYPE_SYMBOL_INDIRECTION 0x50000000u
+#define PTR_TYPE_GLOBAL_REF         0x60000000u // to a binding in the global env
 
 #define PTR_TYPE_BYTECODE           0xC0000000u 
 #define PTR_TYPE_ARRAY              0xD0000000u
@@ -184,6 +222,15 @@ Aux bits could be used for storing vector size. Up to 30bits should be available
 
 #define MAX_CONSTANTS               256
 
+// heap_init_ext options
+#define HEAP_GC_MARK_BITMAP         0x00000001u // Keep GC mark bits in a bitmap beside the heap
+#define HEAP_LAZY_SWEEP             0x00000002u // Sweep on demand in heap_allocate_cell (implies HEAP_GC_MARK_BITMAP)
+#define HEAP_INCREMENTAL_GC         0x00000004u // Collect in steps with gc_incremental_step (implies HEAP_LAZY_SWEEP)
+#define HEAP_GENERATIONAL           0x00000008u // Minor collections of a nursery (implies HEAP_GC_MARK_BITMAP,
+                                                // not with HEAP_LAZY_SWEEP or HEAP_INCREMENTAL_GC)
+#define HEAP_COMPACTING             0x00000010u // Move live cells together in gc_compact_phase (not with HEAP_GENERATIONAL)
+#define HEAP_INTERN_STRINGS         0x00000020u // Share string constants made by heap_intern_string
+
 typedef struct {
   VALUE car;
   VALUE cdr;
@@ -191,7 +238,13 @@ typedef struct {
 
 typedef struct {
   cons_t  *heap;            
+  uint32_t *gc_bitmap;      // GC mark bits, one per cell, if HEAP_GC_MARK_BITMAP
   bool  malloced;           // allocated by heap_init
+  bool  lazy_sweep;         // HEAP_LAZY_SWEEP
+  bool  incremental;        // HEAP_INCREMENTAL_GC
+  bool  generational;       // HEAP_GENERATIONAL
+  bool  compacting;         // HEAP_COMPACTING
+  bool  intern_strings;     // HEAP_INTERN_STRINGS
   VALUE freelist;           // list of free cons cells.
 
   unsigned int heap_size;          // In number of cells.
@@ -204,6 +257,20 @@ typedef struct {
   unsigned int gc_marked;          // Number of cells marked by mark phase.
   unsigned int gc_recovered;       // Number of cells recovered by sweep phase.
   unsigned int gc_recovered_arrays;// Number of arrays recovered by sweep.
+  unsigned int gc_mark_rescans;    // Number of heap rescans after mark stack overflow.
+  unsigned int gc_sweep_pos;       // Next cell to sweep lazily, heap_size when the sweep is done.
+  unsigned int gc_step_budget;     // Cells marked or swept per incremental step.
+  unsigned int gc_num_incremental; // Number of incremental collections completed.
+  unsigned int gc_max_pause;       // Most cells visited by one stop the world collection.
+  unsigned int gc_max_step;        // Most cells visited by one incremental step.
+  unsigned int nursery_size;       // Cells allocated between minor collections.
+  unsigned int gc_num_minor;       // Number of minor collections.
+  unsigned int gc_promoted;        // Cells promoted by the last minor collection.
+  unsigned int gc_compact_interval;// Collections per compaction.
+  unsigned int gc_num_compactions; // Number of compactions.
+  unsigned int num_array_compactions; // Number of times array memory was compacted.
+  unsigned int num_interned;       // Number of strings in the intern table.
+  unsigned int num_intern_hits;    // Number of heap_intern_string calls that found a string.
 } heap_state_t;
 
 typedef struct {
@@ -211,14 +278,20 @@ typedef struct {
   uint32_t size;            // Number of elements
 } array_header_t;
 
+// Char arrays up to this size are stored in the car of their cell
+#define INLINE_ARRAY_MAX_SIZE       ((unsigned int)sizeof(VALUE))
+
 extern int heap_init_addr(cons_t *addr, unsigned int num_cells);
 extern int heap_init(unsigned int num_cells);
+extern int heap_init_ext(unsigned int num_cells, uint32_t options);
 extern void heap_del(void);
 extern unsigned int heap_num_free(void);
 extern unsigned int heap_num_allocated(void);
 extern unsigned int heap_size(void);
+extern unsigned int heap_num_gc(void);
 extern VALUE heap_allocate_cell(TYPE type);
 extern unsigned int heap_size_bytes(void);
+extern bool heap_nursery_full(void);
 
 extern VALUE cons(VALUE car, VALUE cdr);
 extern VALUE car(VALUE cons);
@@ -234,47 +307,64 @@ extern void heap_get_state(heap_state_t *);
 
 // Garbage collection
 extern int heap_perform_gc(VALUE env);
-extern int heap_perform_gc_aux(VALUE env, VALUE env2, VALUE exp, VALUE exp2, VALUE exp3, UINT *aux_data, unsigned int aux_size);
+extern int heap_perform_gc_aux(VALUE env, VALUE env2, VALUE exp, VALUE exp2, VALUE exp3, VALUE *aux_data, unsigned int aux_size);
 extern void gc_state_inc(void);
 extern int gc_mark_freelist(void);
 extern int gc_mark_phase(VALUE v);
-extern int gc_mark_aux(UINT *data, unsigned int n);
+extern int gc_mark_aux(VALUE *data, unsigned int n);
 extern int gc_sweep_phase(void);
+extern int gc_incremental_step(void (*mark_roots)(void));
+extern void gc_write_barrier(VALUE v);
+extern void heap_set_gc_step_budget(unsigned int cells);
+extern int gc_compact_phase(void (*roots)(void));
+extern VALUE gc_relocate(VALUE v);
+extern void gc_relocate_aux(VALUE *data, unsigned int n);
+extern void heap_set_gc_compact_interval(unsigned int collections);
 
 
 // Array functionality
 extern int heap_allocate_array(VALUE *res, unsigned int size, TYPE type);
+extern uint32_t array_size(VALUE arr);
+extern TYPE array_elt_type(VALUE arr);
+extern void *array_data(VALUE arr);
+extern int heap_intern_string(VALUE *res, char *str, unsigned int len);
+extern bool array_is_interned(VALUE arr);
+extern int heap_compact_arrays(void);
 
 static inline TYPE val_type(VALUE x) {
-  return (x & VAL_TYPE_MASK);
+  return (TYPE)(x & VAL_TYPE_MASK);
 }
 
 static inline TYPE ptr_type(VALUE p) {
-  return (p & PTR_TYPE_MASK);
+  return (TYPE)(p & PTR_TYPE_MASK);
 }
 
 static inline TYPE type_of(VALUE x) {
-  return (x & PTR_MASK) ? (x & PTR_TYPE_MASK) : (x & VAL_TYPE_MASK);
+  return (TYPE)((x & PTR_MASK) ? (x & PTR_TYPE_MASK) : (x & VAL_TYPE_MASK));
 }
 
 static inline bool is_ptr(VALUE x) {
+#ifdef _VALUE64
+  return (x & (PTR_MASK | PTR_UNBOXED)) == PTR;
+#else
   return (x & PTR_MASK);
+#endif
 }
 
 static inline VALUE enc_cons_ptr(UINT x) {
-  return ((x << ADDRESS_SHIFT) | PTR_TYPE_CONS | PTR);
+  return (((VALUE)x << ADDRESS_SHIFT) | PTR_TYPE_CONS | PTR);
 }
 
 static inline VALUE enc_symbol_indirection(UINT x) {
-  return ((x << ADDRESS_SHIFT) | PTR_TYPE_SYMBOL_INDIRECTION | PTR);
+  return ((x << SYM_IND_SHIFT) | PTR_TYPE_SYMBOL_INDIRECTION | PTR);
 }
 
 static inline UINT dec_symbol_indirection(VALUE p) {
-  return ((PTR_VAL_MASK & p) >> ADDRESS_SHIFT);
+  return (UINT)((SYM_IND_MASK & p) >> SYM_IND_SHIFT);
 }
 
 static inline UINT dec_ptr(VALUE p) {
-  return ((PTR_VAL_MASK & p) >> ADDRESS_SHIFT);
+  return (UINT)((PTR_VAL_MASK & p) >> ADDRESS_SHIFT);
 }
 
 static inline VALUE set_ptr_type(VALUE p, TYPE t) {
@@ -293,6 +383,21 @@ static inline VALUE enc_u(UINT x) {
   return (x << VAL_SHIFT) | VAL_TYPE_U;
 }
 
+#ifdef _VALUE64
+static inline VALUE enc_I(INT x) {
+  return ((VALUE)(UINT)x << 32) | PTR_TYPE_BOXED_I | PTR_UNBOXED | PTR;
+}
+
+static inline VALUE enc_U(UINT x) {
+  return ((VALUE)x << 32) | PTR_TYPE_BOXED_U | PTR_UNBOXED | PTR;
+}
+
+static inline VALUE enc_F(FLOAT x) {
+  UINT t;
+  memcpy(&t, &x, sizeof(float));
+  return ((VALUE)t << 32) | PTR_TYPE_BOXED_F | PTR_UNBOXED | PTR;
+}
+#else
 static inline VALUE enc_I(INT x) {
   VALUE i = cons((UINT)x, enc_sym(DEF_REPR_BOXED_I_TYPE));
   if (type_of(i) == VAL_TYPE_SYMBOL) return i;
@@ -312,17 +417,18 @@ static inline VALUE enc_F(FLOAT x) {
   if (type_of(f) == VAL_TYPE_SYMBOL) return f;
   return set_ptr_type(f, PTR_TYPE_BOXED_F);
 }
+#endif
 
 static inline VALUE enc_char(char x) {
   return ((UINT)x << VAL_SHIFT) | VAL_TYPE_CHAR;
 }
 
 static inline INT dec_i(VALUE x) {
-  return (INT)x >> VAL_SHIFT;
+  return (INT)(UINT)x >> VAL_SHIFT;
 }
 
 static inline UINT dec_u(VALUE x) {
-  return x >> VAL_SHIFT;
+  return (UINT)x >> VAL_SHIFT;
 }
 
 static inline char dec_char(VALUE x) {
@@ -330,22 +436,31 @@ static inline char dec_char(VALUE x) {
 }
 
 static inline UINT dec_sym(VALUE x) {
-  return x >> VAL_SHIFT;
+  return (UINT)x >> VAL_SHIFT;
+}
+
+// The 32 bits of a PTR_TYPE_BOXED_I, U or F
+static inline UINT dec_boxed(VALUE x) {
+#ifdef _VALUE64
+  return (UINT)(x >> 32);
+#else
+  return car(x);
+#endif
 }
 
 static inline FLOAT dec_f(VALUE x) { // Use only when knowing that x is a VAL_TYPE_F
   FLOAT f_tmp;
-  UINT tmp = car(x);
+  UINT tmp = dec_boxed(x);
   memcpy(&f_tmp, &tmp, sizeof(FLOAT));
   return f_tmp;
 }
 
 static inline UINT dec_U(VALUE x) {
-  return car(x);
+  return dec_boxed(x);
 }
 
 static inline INT dec_I(VALUE x) {
-  return (INT)car(x);
+  return (INT)dec_boxed(x);
 }
 
 static inline VALUE val_set_gc_mark(VALUE x) {
@@ -353,7 +468,7 @@ static inline VALUE val_set_gc_mark(VALUE x) {
 }
 
 static inline VALUE val_clr_gc_mark(VALUE x) {
-  return x & ~GC_MASK;
+  return x & ~(VALUE)GC_MASK;
 }
 
 static inline bool val_get_gc_mark(VALUE x) {
@@ -386,6 +501,10 @@ static inline bool is_closure(VALUE exp) {
 	  (dec_sym(car(exp)) == symrepr_closure()));
 }
 
+static inline bool is_bytecode(VALUE exp) {
+  return (type_of(exp) == PTR_TYPE_BYTECODE);
+}
+
 static inline bool is_symbol(VALUE exp) {
   return (type_of(exp) == VAL_TYPE_SYMBOL);
 }
@@ -394,6 +513,16 @@ static inline bool is_symbol_indirection(VALUE exp) {
   return (type_of(exp) == PTR_TYPE_SYMBOL_INDIRECTION);
 }
 
+/* A reference to a global variable, in code resolved by lexical.c,
+   points straight at its key-val pair in the global environment. */
+static inline VALUE enc_global_ref(VALUE binding) {
+  return set_ptr_type(binding, PTR_TYPE_GLOBAL_REF);
+}
+
+static inline VALUE dec_global_ref(VALUE ref) {
+  return set_ptr_type(ref, PTR_TYPE_CONS);
+}
+
 static inline bool is_symbol_nil(VALUE exp) {
   return (is_symbol(exp) && dec_sym(exp) == symrepr_nil());
 }
@@ -0,0 +1,93 @@
+/*
+    Copyright 2020 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _LEXICAL_H_
+#define _LEXICAL_H_
+
+#include "heap.h"
+#include "symrepr.h"
+
+/* A lexical reference, dec_sym(ref) - DEF_REPR_LEXICAL_REF, holds
+   the number of frames up the environment the variable is in, the
+   path to its slot in that frame and whether the slot holds the value
+   or a binding of it.
+
+   A frame is (slots . parent). The slots of a frame of one variable
+   is its value, the slots of a frame of n variables is a cons of the
+   slots of the first (n + 1) / 2 of them and the slots of the rest.
+   The path is read from the lowest bit, 0 is the car and 1 the cdr,
+   up to a leading 1. */
+#define LEXICAL_PATH_MASK   0x1F
+#define LEXICAL_INDIRECT    0x20
+#define LEXICAL_DEPTH_SHIFT 6
+#define LEXICAL_MAX_SLOTS   16   // fits in a path of 4 steps
+
+extern void lexical_init(void);
+extern void lexical_mark_cache(void);
+extern void lexical_relocate_cache(void);
+extern VALUE lexical_resolve_lambda(VALUE exp, VALUE env);
+extern VALUE lexical_capture(VALUE exp, VALUE env);
+extern VALUE lexical_frame(VALUE *vals, unsigned int n, VALUE env);
+extern VALUE lexical_let_frame(VALUE binds, VALUE env);
+
+static inline UINT lexical_code(VALUE ref) {
+  return dec_sym(ref) - DEF_REPR_LEXICAL_REF;
+}
+
+// The contents of the slot a lexical reference refers to
+static inline VALUE lexical_slot(VALUE ref, VALUE env) {
+  UINT code = lexical_code(ref);
+  VALUE curr = env;
+  for (UINT i = code >> LEXICAL_DEPTH_SHIFT; i > 0; i --) {
+    curr = cdr(curr);
+  }
+  curr = car(curr);
+  for (UINT path = code & LEXICAL_PATH_MASK; path > 1; path >>= 1) {
+    curr = (path & 1) ? cdr(curr) : car(curr);
+  }
+  return curr;
+}
+
+/* The value a lexical reference refers to is found at a fixed frame
+   and slot in the environment, no symbols are compared. */
+static inline VALUE lexical_lookup(VALUE ref, VALUE env) {
+  VALUE v = lexical_slot(ref, env);
+  return (lexical_code(ref) & LEXICAL_INDIRECT) ? cdr(v) : v;
+}
+
+static inline void lexical_set(VALUE ref, VALUE env, VALUE val) {
+  UINT code = lexical_code(ref);
+  VALUE cell = env;
+  for (UINT i = code >> LEXICAL_DEPTH_SHIFT; i > 0; i --) {
+    cell = cdr(cell);
+  }
+  // cell is the cons holding the slot, in its car or cdr
+  bool right = false;
+  for (UINT path = code & LEXICAL_PATH_MASK; path > 1; path >>= 1) {
+    cell = right ? cdr(cell) : car(cell);
+    right = path & 1;
+  }
+  if (code & LEXICAL_INDIRECT) {
+    set_cdr(right ? cdr(cell) : car(cell), val);
+  } else if (right) {
+    set_cdr(cell, val);
+  } else {
+    set_car(cell, val);
+  }
+}
+
+#endif
@@ -72,6 +72,9 @@
 #ifndef _MEMORY_H_
 #define _MEMORY_H_
 
+#include <stdint.h>
+#include <stdbool.h>
+
 #define MEMORY_SIZE_64BYTES_TIMES_X(X) (64*(X))
 #define MEMORY_BITMAP_SIZE(X) (4*(X))
 
@@ -93,11 +96,23 @@
 #define MEMORY_BITMAP_SIZE_32K MEMORY_BITMAP_SIZE(512)
 #define MEMORY_BITMAP_SIZE_1M  MEMORY_BITMAP_SIZE(16384)
 
+// memory_init_ext options
+#define MEMORY_SIZE_CLASSES 0x00000001u // Free lists for small blocks (default with memory_init)
+#define MEMORY_NEXT_FIT     0x00000002u // Scan from where the last allocation ended
+
 extern int memory_init(unsigned char *data, uint32_t data_size,
 		       unsigned char *bitmap, uint32_t bitmap_size);
+extern int memory_init_ext(unsigned char *data, uint32_t data_size,
+			   unsigned char *bitmap, uint32_t bitmap_size,
+			   uint32_t options);
 extern uint32_t memory_num_words(void);
 extern uint32_t memory_num_free(void);
+extern uint32_t memory_longest_free(void);
 extern uint32_t *memory_allocate(uint32_t num_words);
 extern int memory_free(uint32_t *ptr);
+extern uint32_t memory_offset(uint32_t *ptr);
+extern uint32_t *memory_address(uint32_t offset);
+extern int memory_compact(bool (*movable)(uint32_t *ptr),
+			  void (*moved)(uint32_t *from, uint32_t *to));
 
 #endif
@@ -23,23 +23,24 @@
 
 #include "typedefs.h"
 
+// The elements of a stack are VALUEs, also with -D_VALUE64
 typedef struct {
-  UINT* data;
+  VALUE* data;
   unsigned int sp;
   unsigned int size;
   bool growable;
 } stack;
 
 extern int stack_allocate(stack *s, unsigned int stack_size, bool growable);
-extern int stack_create(stack *s, UINT* data, unsigned int size);
+extern int stack_create(stack *s, VALUE* data, unsigned int size);
 extern void stack_free(stack *s);
 extern int stack_clear(stack *s);
 extern int stack_copy(stack *dest, stack *src);
-extern UINT *stack_ptr(stack *s, unsigned int n);
+extern VALUE *stack_ptr(stack *s, unsigned int n);
 extern int stack_drop(stack *s, unsigned int n);
-extern int push_u32(stack *s, UINT val);
+extern int push_u32(stack *s, VALUE val);
 extern int push_k(stack *s, VALUE (*k)(VALUE));
-extern int pop_u32(stack *s, UINT *val);
+extern int pop_u32(stack *s, VALUE *val);
 extern int pop_k(stack *s, VALUE (**k)(VALUE));
 
 static inline int stack_is_empty(stack *s) {
@@ -47,20 +48,20 @@ static inline int stack_is_empty(stack *s) {
   return 0;
 }
 
-static inline int stack_arg_ix(stack *s, unsigned int ix, UINT *res) {
+static inline int stack_arg_ix(stack *s, unsigned int ix, VALUE *res) {
   if (ix > s->sp-1) return 0;
   *res = s->data[s->sp-(ix+1)];
   return 1;
 }
 
-static inline int push_u32_2(stack *s, UINT val0, UINT val1) {
+static inline int push_u32_2(stack *s, VALUE val0, VALUE val1) {
   int res = 1;
   res &= push_u32(s,val0);
   res &= push_u32(s,val1);
   return res;
 }
 
-static inline int push_u32_3(stack *s, UINT val0, UINT val1, UINT val2) {
+static inline int push_u32_3(stack *s, VALUE val0, VALUE val1, VALUE val2) {
   int res = 1;
   res &= push_u32(s,val0);
   res &= push_u32(s,val1);
@@ -68,7 +69,7 @@ static inline int push_u32_3(stack *s, UINT val0, UINT val1, UINT val2) {
   return res;
 }
 
-static inline int push_u32_4(stack *s, UINT val0, UINT val1, UINT val2, UINT val3) {
+static inline int push_u32_4(stack *s, VALUE val0, VALUE val1, VALUE val2, VALUE val3) {
   int res = 1;
   res &= push_u32(s,val0);
   res &= push_u32(s,val1);
@@ -77,7 +78,7 @@ static inline int push_u32_4(stack *s, UINT val0, UINT val1, UINT val2, UINT val
   return res;
 }
 
-static inline int push_u32_5(stack *s, UINT val0, UINT val1, UINT val2, UINT val3, UINT val4) {
+static inline int push_u32_5(stack *s, VALUE val0, VALUE val1, VALUE val2, VALUE val3, VALUE val4) {
   int res = 1;
   res &= push_u32(s,val0);
   res &= push_u32(s,val1);
@@ -87,14 +88,14 @@ static inline int push_u32_5(stack *s, UINT val0, UINT val1, UINT val2, UINT val
   return res;
 }
 
-static inline int pop_u32_2(stack *s, UINT *r0, UINT *r1) {
+static inline int pop_u32_2(stack *s, VALUE *r0, VALUE *r1) {
   int res = 1;
   res &= pop_u32(s, r0);
   res &= pop_u32(s, r1);
   return res;
 }
 
-static inline int pop_u32_3(stack *s, UINT *r0, UINT *r1, UINT *r2) {
+static inline int pop_u32_3(stack *s, VALUE *r0, VALUE *r1, VALUE *r2) {
   int res = 1;
   res &= pop_u32(s, r0);
   res &= pop_u32(s, r1);
@@ -102,7 +103,7 @@ static inline int pop_u32_3(stack *s, UINT *r0, UINT *r1, UINT *r2) {
   return res;
 }
 
-static inline int pop_u32_4(stack *s, UINT *r0, UINT *r1, UINT *r2, UINT *r3) {
+static inline int pop_u32_4(stack *s, VALUE *r0, VALUE *r1, VALUE *r2, VALUE *r3) {
   int res = 1;
   res &= pop_u32(s, r0);
   res &= pop_u32(s, r1);
@@ -111,7 +112,7 @@ static inline int pop_u32_4(stack *s, UINT *r0, UINT *r1, UINT *r2, UINT *r3) {
   return res;
 }
 
-static inline int pop_u32_5(stack *s, UINT *r0, UINT *r1, UINT *r2, UINT *r3, UINT *r4) {
+static inline int pop_u32_5(stack *s, VALUE *r0, VALUE *r1, VALUE *r2, VALUE *r3, VALUE *r4) {
   int res = 1;
   res &= pop_u32(s, r0);
   res &= pop_u32(s, r1);
@@ -42,6 +42,10 @@
 //#define DEF_REPR_BACKQUOTE     0xF
 #define DEF_REPR_COMMA         0x10
 #define DEF_REPR_COMMAAT       0x11
+#define DEF_REPR_LAMBDA_LEX    0x12  /* lambda after lexical addressing */
+#define DEF_REPR_LET_LEX       0x13  /* let after lexical addressing */
+#define DEF_REPR_CLOSURE_LEX   0x14  /* closure of a lambda-lex */
+#define DEF_REPR_DEPTH_ERROR   0x15  /* Nesting too deep to read */
 
 // Special symbol ids
 #define DEF_REPR_ARRAY_TYPE     0x20
@@ -66,6 +70,10 @@
 #define DEF_REPR_TYPE_CHAR      0x31
 #define DEF_REPR_TYPE_REF       0x32
 
+#define DEF_REPR_INTERNED_ARRAY_TYPE 0x3D
+// Inline char arrays of size n have type symbol DEF_REPR_INLINE_ARRAY_TYPE + n
+#define DEF_REPR_INLINE_ARRAY_TYPE 0x40  // 0x40 - 0x48
+
 // Fundamental Operations
 #define FUNDAMENTALS_START      0x100
 #define SYM_ADD                 0x100
@@ -108,6 +116,11 @@
 #define SYM_TYPE_OF             0x200
 #define FUNDAMENTALS_END        0x200
 
+// References to local variables, by position in the environment,
+// created by the lexical addressing pass (see lexical.c)
+#define DEF_REPR_LEXICAL_REF    0x800 // 0x800 - 0xFFF
+#define LEXICAL_REF_MAX         0x7FF
+
 #define MAX_SPECIAL_SYMBOLS 4096 // 12bits (highest id allowed is 0xFFFF) 
 
 extern int symrepr_addsym(char *, UINT*);
@@ -123,8 +136,11 @@ static inline UINT symrepr_quote(void)       { return DEF_REPR_QUOTE; }
 static inline UINT symrepr_true(void)        { return DEF_REPR_TRUE; }
 static inline UINT symrepr_if(void)          { return DEF_REPR_IF; }
 static inline UINT symrepr_lambda(void)      { return DEF_REPR_LAMBDA; }
+static inline UINT symrepr_lambda_lex(void)  { return DEF_REPR_LAMBDA_LEX; }
 static inline UINT symrepr_closure(void)     { return DEF_REPR_CLOSURE; }
+static inline UINT symrepr_closure_lex(void) { return DEF_REPR_CLOSURE_LEX; }
 static inline UINT symrepr_let(void)         { return DEF_REPR_LET; }
+static inline UINT symrepr_let_lex(void)     { return DEF_REPR_LET_LEX; }
 static inline UINT symrepr_define(void)      { return DEF_REPR_DEFINE; }
 static inline UINT symrepr_progn(void)       { return DEF_REPR_PROGN; }
 static inline UINT symrepr_comma(void)       { return DEF_REPR_COMMA; }
@@ -148,6 +164,7 @@ static inline UINT symrepr_eerror(void)      { return DEF_REPR_EERROR; }
 static inline UINT symrepr_merror(void)      { return DEF_REPR_MERROR; }
 static inline UINT symrepr_divzero(void)     { return DEF_REPR_DIVZERO; }
 static inline UINT symrepr_fatal_error(void) { return DEF_REPR_FATAL_ERROR; }
+static inline UINT symrepr_depth_error(void) { return DEF_REPR_DEPTH_ERROR; }
 
 static inline UINT symrepr_nonsense(void)    { return DEF_REPR_NONSENSE; }
 static inline UINT symrepr_not_found(void)   { return DEF_REPR_NOT_FOUND; }
@@ -170,8 +187,13 @@ static inline bool symrepr_is_error(UINT symrep){
 	  symrep == DEF_REPR_RERROR ||
 	  symrep == DEF_REPR_MERROR ||
 	  symrep == DEF_REPR_EERROR || 
-	  symrep == DEF_REPR_FATAL_ERROR);
+	  symrep == DEF_REPR_FATAL_ERROR ||
+	  symrep == DEF_REPR_DEPTH_ERROR);
 }
 
+static inline bool symrepr_is_lexical_ref(UINT symrep) {
+  return (symrep >= DEF_REPR_LEXICAL_REF &&
+	  symrep <= DEF_REPR_LEXICAL_REF + LEXICAL_REF_MAX);
+}
 
 #endif
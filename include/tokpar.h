@@ -22,5 +22,14 @@
 
 extern VALUE tokpar_parse(char *str);
 extern VALUE tokpar_parse_compressed(char *bytes);
+/*
+  The parser collects garbage when it runs out of heap. Anything
+  that is live, apart from the global environment, must be marked
+  by a mark callback and, for compaction, updated by the matching
+  relocate callback (see gc_compact_phase). The evaluators add their
+  own. If any relocate callback is NULL the heap is swept instead.
+  Returns 0 if there is no room for more callbacks.
+*/
+extern int tokpar_add_roots_callbacks(void (*mark)(void), void (*relocate)(void));
 
 #endif
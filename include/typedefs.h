@@ -22,14 +22,25 @@
 #include <stdbool.h>
 #include <inttypes.h>
 
+// Compile with -D_VALUE64 for 64 bit values with unboxed 32 bit numbers
+#ifdef _VALUE64
+typedef uint64_t VALUE; // A Lisp value.
+#else
 typedef uint32_t VALUE; // A Lisp value.
+#endif
 typedef uint32_t TYPE;  // Representation of a type.
 
 typedef uint32_t UINT;
 typedef int32_t  INT;
 typedef float    FLOAT;
 
+#ifdef _VALUE64
+#define PRI_VALUE PRIu64
+#define PRI_HEX_VALUE PRIx64
+#else
 #define PRI_VALUE PRIu32
+#define PRI_HEX_VALUE PRIx32
+#endif
 #define PRI_TYPE  PRIu32
 #define PRI_UINT  PRIu32
 #define PRI_INT   PRId32
@@ -110,6 +110,19 @@ void done_callback(eval_context_t *ctx) {
   }
 }
 
+/* Prints one binding of the global environment, for :info */
+void print_binding(VALUE binding) {
+
+  char output[1024];
+  char error[1024];
+
+  if (print_value(output, 1024, error, 1024, binding) >= 0) {
+    chprintf(chp,"  %s\r\n", output);
+  } else {
+    chprintf(chp,"  %s\r\n", error);
+  }
+}
+
 uint32_t timestamp_callback() {
   systime_t t = chVTGetSystemTime();
   return (uint32_t) (100 * t);
@@ -132,10 +145,9 @@ VALUE ext_print(VALUE *args, int argn) {
     VALUE t = args[i];
 
     if (is_ptr(t) && ptr_type(t) == PTR_TYPE_ARRAY) {
-      array_header_t *array = (array_header_t *)car(t);
-      switch (array->elt_type){
+      switch (array_elt_type(t)){
       case VAL_TYPE_CHAR:
-	chprintf(chp,"%s", (char*)array + 8);
+	chprintf(chp,"%s", (char *)array_data(t));
 	break;
       default:
 	return enc_sym(symrepr_nil());
@@ -209,9 +221,6 @@ static THD_FUNCTION(repl, arg) {
   
   size_t len = 1024;
   char *str = malloc(1024);
-  char *outbuf = malloc(2048);
-  char *error = malloc(1024);
-  int res = 0;
   
   heap_state_t heap_state;
 
@@ -222,7 +231,6 @@ static THD_FUNCTION(repl, arg) {
   while (1) {
     chprintf(chp,"# ");
     memset(str,0,len);
-    memset(outbuf,0, 2048);
     inputline(chp,str, len);
     chprintf(chp,"\r\n");
 
@@ -232,19 +240,14 @@ static THD_FUNCTION(repl, arg) {
     } else if (strncmp(str, ":info", 5) == 0) {
       chprintf(chp,"##(ChibiOS)#################################################\r\n");
       chprintf(chp,"Used cons cells: %lu \r\n", heap_size - heap_num_free());
-      res = print_value(outbuf,2048, error, 1024, *env_get_global_ptr());
-      if (res >= 0) {
-	chprintf(chp,"ENV: %s \r\n", outbuf);
-      } else {
-	chprintf(chp,"%s\r\n",error);
-      }
+      chprintf(chp,"ENV:\r\n");
+      env_global_iterate(print_binding);
       heap_get_state(&heap_state);
       chprintf(chp,"GC counter: %lu\r\n", heap_state.gc_num);
       chprintf(chp,"Recovered: %lu\r\n", heap_state.gc_recovered);
       chprintf(chp,"Marked: %lu\r\n", heap_state.gc_marked);
       chprintf(chp,"Free cons cells: %lu\r\n", heap_num_free());
       chprintf(chp,"############################################################\r\n");
-      memset(outbuf,0, 2048);
     } else if (strncmp(str, ":quit", 5) == 0) {
       break;
     } else {
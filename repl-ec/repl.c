@@ -48,10 +48,9 @@ VALUE ext_print(VALUE *args, int argn) {
     VALUE t = args[i];
 
     if (is_ptr(t) && ptr_type(t) == PTR_TYPE_ARRAY) {
-      array_header_t *array = (array_header_t *)car(t);
-      switch (array->elt_type){
+      switch (array_elt_type(t)){
       case VAL_TYPE_CHAR: {
-	char *data = (char *)array + 8;
+	char *data = array_data(t);
 	printf("%s", data);
 	break;
       }
@@ -115,6 +114,18 @@ char * load_file(char *filename) {
   return file_str;
 }
 
+/* Prints one binding of the global environment, for :info */
+void print_binding(VALUE binding) {
+  char output[1024];
+  char error[1024];
+
+  if (print_value(output, 1024, error, 1024, binding) >= 0) {
+    printf("  %s\n", output);
+  } else {
+    printf("  %s\n", error);
+  }
+}
+
 int main(int argc, char **argv) {
   char *str = malloc(1024);;
   unsigned int len = 1024;
@@ -190,19 +201,9 @@ int main(int argc, char **argv) {
     if (n >= 5 && strncmp(str, ":info", 5) == 0) {
       printf("############################################################\n");
       printf("Used cons cells: %d\n", heap_size - heap_num_free());
-      int r = print_value(output, 1024, error, 1024, *env_get_global_ptr());
-      if (r >= 0) {
-	printf("ENV: %s\n", output );
-      } else {
-	printf("%s\n", error);
-      }
-      int env_len = 0;
-      VALUE curr = *env_get_global_ptr();
-      while (type_of(curr) == PTR_TYPE_CONS) {
-	env_len ++;
-	curr = cdr(curr);
-      }
-      printf("Global env num bindings: %d\n", env_len);
+      printf("ENV:\n");
+      env_global_iterate(print_binding);
+      printf("Global env num bindings: %u\n", env_num_global_bindings());
       heap_get_state(&heap_state);
       printf("Symbol table size: %u Bytes\n", symrepr_size());
       printf("Heap size: %u Bytes\n", heap_size * 8);
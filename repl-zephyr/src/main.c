@@ -161,6 +161,18 @@ int inputline(char *buffer, int size) {
   return 0; // Filled up buffer without reading a linebreak
 }
 
+/* Prints one binding of the global environment, for :info */
+void print_binding(VALUE binding) {
+  char output[LISPBM_ERROR_BUFFER_SIZE];
+  char error[LISPBM_ERROR_BUFFER_SIZE];
+
+  if (print_value(output, LISPBM_ERROR_BUFFER_SIZE, error, LISPBM_ERROR_BUFFER_SIZE, binding) >= 0) {
+    usb_printf("  %s\n\r", output);
+  } else {
+    usb_printf("  %s\n\r", error);
+  }
+}
+
 void main(void)
 {
 
@@ -255,12 +267,8 @@ void main(void)
     if (strncmp(str, ":info", 5) == 0) {
       usb_printf("##(REPL - ZephyrOS)#########################################\n\r");
       usb_printf("Used cons cells: %lu \n\r", LISPBM_HEAP_SIZE - heap_num_free());
-      res = print_value(outbuf, LISPBM_OUTPUT_BUFFER_SIZE, error, LISPBM_ERROR_BUFFER_SIZE, *env_get_global_ptr());
-      if (res >= 0) {
-	usb_printf("ENV: %s \n\r", outbuf);
-      } else {
-	usb_printf("%s\n", error);
-      }
+      usb_printf("ENV:\n\r");
+      env_global_iterate(print_binding);
       heap_get_state(&heap_state);
       usb_printf("GC counter: %lu\n\r", heap_state.gc_num);
       usb_printf("Recovered: %lu\n\r", heap_state.gc_recovered);
@@ -15,3 +15,477 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <stdlib.h>
+#include <string.h>
+
+#include "bytecode.h"
+#include "heap.h"
+#include "symrepr.h"
+#include "env.h"
+#include "stack.h"
+#include "fundamental.h"
+#include "extensions.h"
+
+#define BYTECODE_STACK_SIZE 256
+
+static const uint8_t instr_size[OP_NUM_OPCODES] = {
+  1, // jmpcnt
+  5, // jmpimm
+  1, // jmpval
+  6, // movimm
+  3, // mov
+  6, // lookup
+  5, // setglbval
+  2, // push
+  2, // pop
+  5, // bpf
+  5, // exenvargl
+  5, // exenvval
+  3, // cons
+  6, // consimm
+  3, // cdr
+  3, // cadr
+  3, // caddr
+  3, // car
+  1, // callf
+  1, // done
+  5, // bnil
+  5  // modenv
+};
+
+static inline UINT read_u32(uint8_t *p) {
+  return ((UINT)p[0]        |
+	  ((UINT)p[1] << 8)  |
+	  ((UINT)p[2] << 16) |
+	  ((UINT)p[3] << 24));
+}
+
+static inline void write_u32(uint8_t *p, UINT v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+  p[2] = (uint8_t)(v >> 16);
+  p[3] = (uint8_t)(v >> 24);
+}
+
+int bytecode_load(bytecode_t *bc, uint8_t *data, unsigned int size) {
+
+  unsigned int pos = 0;
+
+  if (size < 8) return 0;
+
+  bc->code_size = read_u32(data);
+  pos += 4;
+  if (bc->code_size > size - 8) return 0;
+  bc->code = data + pos;
+  pos += bc->code_size;
+
+  bc->num_indirections = read_u32(data + pos);
+  pos += 4;
+  bc->indirections = NULL;
+
+  if (bc->num_indirections == 0) return 1;
+
+  bc->indirections = malloc(bc->num_indirections * sizeof(symbol_indirection_t));
+  if (!bc->indirections) return 0;
+
+  for (unsigned int i = 0; i < bc->num_indirections; i ++) {
+    if (pos + 4 >= size) {
+      bytecode_del(bc);
+      return 0;
+    }
+    bc->indirections[i].symbol_indirection = read_u32(data + pos);
+    pos += 4;
+    bc->indirections[i].symbol_str = (char *)(data + pos);
+    while (pos < size && data[pos] != 0) pos ++;
+    if (pos == size) {
+      bytecode_del(bc);
+      return 0;
+    }
+    pos ++;
+  }
+  return 1;
+}
+
+void bytecode_del(bytecode_t *bc) {
+  if (bc->indirections) {
+    free(bc->indirections);
+    bc->indirections = NULL;
+  }
+  bc->num_indirections = 0;
+}
+
+static int resolve_indirection(bytecode_t *bc, VALUE v, VALUE *res) {
+  for (unsigned int i = 0; i < bc->num_indirections; i ++) {
+    if (bc->indirections[i].symbol_indirection == v) {
+      UINT sym_id;
+      if (!symrepr_lookup(bc->indirections[i].symbol_str, &sym_id) &&
+	  !symrepr_addsym(bc->indirections[i].symbol_str, &sym_id)) {
+	return 0;
+      }
+      *res = enc_sym(sym_id);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Replace all symbol indirections in the code with the symbols they
+// refer to in this runtime system. After linking, the interpreter does
+// not need to care about indirections.
+static int bytecode_link(bytecode_t *bc) {
+
+  unsigned int pc = 0;
+
+  while (pc < bc->code_size) {
+    uint8_t op = bc->code[pc];
+    unsigned int arg_pos;
+
+    if (op >= OP_NUM_OPCODES ||
+	pc + instr_size[op] > bc->code_size) return 0;
+
+    switch (op) {
+    case OP_MOV:
+    case OP_CONS:
+    case OP_CAR:
+    case OP_CDR:
+    case OP_CADR:
+    case OP_CADDR:
+      if (bc->code[pc + 2] >= REG_NUM_REGS) return 0;
+      /* fall through */
+    case OP_PUSH:
+    case OP_POP:
+      if (bc->code[pc + 1] >= REG_NUM_REGS) return 0;
+      arg_pos = 0;
+      break;
+    case OP_MOVIMM:
+    case OP_LOOKUP:
+    case OP_CONSIMM:
+      if (bc->code[pc + 1] >= REG_NUM_REGS) return 0;
+      arg_pos = pc + 2;
+      break;
+    case OP_SETGLBVAL:
+    case OP_EXENVARGL:
+    case OP_EXENVVAL:
+    case OP_MODENV:
+      arg_pos = pc + 1;
+      break;
+    default:
+      arg_pos = 0;
+      break;
+    }
+
+    if (arg_pos) {
+      VALUE v = read_u32(bc->code + arg_pos);
+      if (is_symbol_indirection(v)) {
+	if (!resolve_indirection(bc, v, &v)) return 0;
+	write_u32(bc->code + arg_pos, (UINT)v);
+      }
+    }
+    pc += instr_size[op];
+  }
+  return 1;
+}
+
+int bytecode_create(VALUE *res, bytecode_t *bc) {
+
+  if (!bytecode_link(bc)) return 0;
+
+  VALUE cell = heap_allocate_cell(PTR_TYPE_CONS);
+  if (type_of(cell) == VAL_TYPE_SYMBOL) {
+    *res = cell;
+    return 0;
+  }
+
+  set_car(cell, (VALUE)bc);
+  set_cdr(cell, enc_sym(DEF_REPR_BYTECODE_TYPE));
+  *res = set_ptr_type(cell, PTR_TYPE_BYTECODE);
+  return 1;
+}
+
+/* ************************************************************
+ * Interpreter
+ * ************************************************************ */
+
+typedef struct {
+  VALUE bc_val;
+  VALUE reg[REG_NUM_REGS];
+  stack S;
+  void (*mark_roots)(void);
+  void (*relocate_roots)(void);
+} vm_state_t;
+
+static vm_state_t *vm_collecting; // The VM whose roots relocate_vm_roots updates
+
+// Roots for compaction: the global environment, the VM and whatever
+// the caller of bytecode_eval holds.
+static void relocate_vm_roots(void) {
+  VALUE *env = env_get_global_ptr();
+  *env = gc_relocate(*env);
+
+  vm_collecting->bc_val = gc_relocate(vm_collecting->bc_val);
+  gc_relocate_aux(vm_collecting->reg, REG_NUM_REGS);
+  gc_relocate_aux(vm_collecting->S.data, vm_collecting->S.sp);
+
+  if (vm_collecting->relocate_roots) vm_collecting->relocate_roots();
+}
+
+static int gc(vm_state_t *vm) {
+
+  gc_state_inc();
+  gc_mark_freelist();
+  gc_mark_phase(*env_get_global_ptr());
+
+  gc_mark_phase(vm->bc_val);
+  for (int i = 0; i < REG_NUM_REGS; i ++) {
+    gc_mark_phase(vm->reg[i]);
+  }
+  gc_mark_aux(vm->S.data, vm->S.sp);
+
+  if (vm->mark_roots) vm->mark_roots();
+
+  vm_state_t *prev = vm_collecting;
+  vm_collecting = vm;
+  int res = gc_compact_phase(vm->relocate_roots ? relocate_vm_roots : NULL);
+  vm_collecting = prev;
+  return res;
+}
+
+static VALUE apply_fundamental(vm_state_t *vm) {
+
+  VALUE proc = vm->reg[REG_PROC];
+  UINT count = 0;
+  VALUE args = vm->reg[REG_ARGL];
+
+  while (type_of(args) == PTR_TYPE_CONS) {
+    if (!push_u32(&vm->S, car(args))) {
+      stack_drop(&vm->S, count);
+      return enc_sym(symrepr_merror());
+    }
+    count ++;
+    args = cdr(args);
+  }
+
+  VALUE *fun_args = stack_ptr(&vm->S, count);
+  VALUE res;
+
+  if (is_fundamental(proc)) {
+    res = fundamental_exec(fun_args, count, proc);
+  } else {
+    extension_fptr f = extensions_lookup(dec_sym(proc));
+    if (f) {
+      res = f(fun_args, (int)count);
+    } else {
+      res = enc_sym(symrepr_eerror());
+    }
+  }
+  stack_drop(&vm->S, count);
+  return res;
+}
+
+static VALUE bytecode_run(vm_state_t *vm, unsigned int pc) {
+
+  bytecode_t *bc = (bytecode_t *)car(vm->bc_val);
+  uint8_t *code = bc->code;
+  bool gc_done = false;
+  VALUE *reg = vm->reg;
+  VALUE nil = enc_sym(symrepr_nil());
+  VALUE v;
+
+  while (pc < bc->code_size) {
+
+    // Minor collections happen between instructions
+    if (heap_nursery_full()) gc(vm);
+
+    uint8_t *instr = code + pc;
+
+    switch (instr[0]) {
+    case OP_JMPCNT:
+      pc = dec_u(reg[REG_CONT]);
+      continue;
+    case OP_JMPIMM:
+      pc = read_u32(instr + 1);
+      continue;
+    case OP_JMPVAL:
+      if (!(type_of(reg[REG_VAL]) == VAL_TYPE_I ||
+	    type_of(reg[REG_VAL]) == VAL_TYPE_U)) {
+	return enc_sym(symrepr_eerror());
+      }
+      pc = dec_u(reg[REG_VAL]);
+      continue;
+    case OP_MOVIMM:
+      reg[instr[1]] = read_u32(instr + 2);
+      break;
+    case OP_MOV:
+      reg[instr[1]] = reg[instr[2]];
+      break;
+    case OP_LOOKUP: {
+      VALUE sym = read_u32(instr + 2);
+      if (is_special(sym) || is_extension(sym)) {
+	reg[instr[1]] = sym;
+	break;
+      }
+      v = env_lookup(sym, reg[REG_ENV]);
+      if (type_of(v) == VAL_TYPE_SYMBOL &&
+	  dec_sym(v) == symrepr_not_found()) {
+	v = env_lookup(sym, *env_get_global_ptr());
+	if (type_of(v) == VAL_TYPE_SYMBOL &&
+	    dec_sym(v) == symrepr_not_found()) {
+	  return enc_sym(symrepr_eerror());
+	}
+      }
+      reg[instr[1]] = v;
+      break;
+    }
+    case OP_SETGLBVAL:
+      v = env_set(*env_get_global_ptr(), read_u32(instr + 1), reg[REG_VAL]);
+      if (is_symbol_merror(v)) goto out_of_memory;
+      *env_get_global_ptr() = v;
+      break;
+    case OP_PUSH:
+      if (!push_u32(&vm->S, reg[instr[1]])) return enc_sym(symrepr_merror());
+      break;
+    case OP_POP:
+      if (stack_is_empty(&vm->S)) return enc_sym(symrepr_fatal_error());
+      pop_u32(&vm->S, &reg[instr[1]]);
+      break;
+    case OP_BPF:
+      if (is_fundamental(reg[REG_PROC]) || is_extension(reg[REG_PROC])) {
+	pc = read_u32(instr + 1);
+	continue;
+      }
+      break;
+    case OP_BNIL:
+      if (reg[REG_VAL] == nil) {
+	pc = read_u32(instr + 1);
+	continue;
+      }
+      break;
+    case OP_EXENVARGL: {
+      VALUE binding = cons(read_u32(instr + 1), car(reg[REG_ARGL]));
+      if (is_symbol_merror(binding)) goto out_of_memory;
+      v = cons(binding, reg[REG_ENV]);
+      if (is_symbol_merror(v)) goto out_of_memory;
+      reg[REG_ENV] = v;
+      reg[REG_ARGL] = cdr(reg[REG_ARGL]);
+      break;
+    }
+    case OP_EXENVVAL: {
+      VALUE binding = cons(read_u32(instr + 1), reg[REG_VAL]);
+      if (is_symbol_merror(binding)) goto out_of_memory;
+      v = cons(binding, reg[REG_ENV]);
+      if (is_symbol_merror(v)) goto out_of_memory;
+      reg[REG_ENV] = v;
+      break;
+    }
+    case OP_MODENV:
+      env_modify_binding(reg[REG_ENV], read_u32(instr + 1), reg[REG_VAL]);
+      break;
+    case OP_CONS:
+      v = cons(reg[instr[2]], reg[instr[1]]);
+      if (is_symbol_merror(v)) goto out_of_memory;
+      reg[instr[1]] = v;
+      break;
+    case OP_CONSIMM:
+      v = cons(read_u32(instr + 2), reg[instr[1]]);
+      if (is_symbol_merror(v)) goto out_of_memory;
+      reg[instr[1]] = v;
+      break;
+    case OP_CAR:
+      reg[instr[1]] = car(reg[instr[2]]);
+      break;
+    case OP_CDR:
+      reg[instr[1]] = cdr(reg[instr[2]]);
+      break;
+    case OP_CADR:
+      reg[instr[1]] = car(cdr(reg[instr[2]]));
+      break;
+    case OP_CADDR:
+      reg[instr[1]] = car(cdr(cdr(reg[instr[2]])));
+      break;
+    case OP_CALLF:
+      v = apply_fundamental(vm);
+      if (is_symbol_merror(v)) goto out_of_memory;
+      if (type_of(v) == VAL_TYPE_SYMBOL &&
+	  dec_sym(v) == symrepr_eerror()) {
+	return v;
+      }
+      reg[REG_VAL] = v;
+      break;
+    case OP_DONE:
+      return reg[REG_VAL];
+    default:
+      return enc_sym(symrepr_fatal_error());
+    }
+
+    pc += instr_size[instr[0]];
+    gc_done = false;
+    continue;
+
+  out_of_memory:
+    // Collect garbage and retry the same instruction once.
+    if (gc_done) return enc_sym(symrepr_merror());
+    gc(vm);
+    gc_done = true;
+  }
+  // Falling off the end of the code is a return from a procedure
+  // applied by bytecode_eval.
+  if (pc == bc->code_size) return reg[REG_VAL];
+  return enc_sym(symrepr_eerror());
+}
+
+/* mark_roots marks and relocate_roots relocates (see gc_compact_phase)
+   the roots of the caller, apart from the global environment. Without
+   relocate_roots the heap is swept and not compacted. */
+VALUE bytecode_eval(VALUE bc, VALUE args,
+		    void (*mark_roots)(void),
+		    void (*relocate_roots)(void)) {
+
+  vm_state_t vm;
+
+  if (type_of(bc) != PTR_TYPE_BYTECODE) {
+    return enc_sym(symrepr_eerror());
+  }
+
+  vm.bc_val = bc;
+  vm.mark_roots = mark_roots;
+  vm.relocate_roots = relocate_roots;
+  for (int i = 0; i < REG_NUM_REGS; i ++) {
+    vm.reg[i] = enc_sym(symrepr_nil());
+  }
+
+  if (!stack_allocate(&vm.S, BYTECODE_STACK_SIZE, true)) {
+    return enc_sym(symrepr_merror());
+  }
+
+  // Run the program. If there are arguments, the program is expected
+  // to evaluate to a compiled procedure (proc entry env) that is then
+  // applied to the arguments, returning to the end of the code. The
+  // arguments are kept at the bottom of the stack meanwhile, where the
+  // collector sees them.
+  if (!push_u32(&vm.S, args)) {
+    stack_free(&vm.S);
+    return enc_sym(symrepr_merror());
+  }
+  VALUE res = bytecode_run(&vm, 0);
+  args = vm.S.data[0];
+
+  if (type_of(args) == PTR_TYPE_CONS &&
+      !(type_of(res) == VAL_TYPE_SYMBOL && symrepr_is_error(dec_sym(res)))) {
+    VALUE entry = enc_sym(symrepr_nil());
+    if (type_of(res) == PTR_TYPE_CONS) {
+      entry = car(cdr(res));
+    }
+    if (!(type_of(entry) == VAL_TYPE_I || type_of(entry) == VAL_TYPE_U)) {
+      res = enc_sym(symrepr_terror());
+    } else {
+      bytecode_t *code = (bytecode_t *)car(vm.bc_val);
+      vm.reg[REG_PROC] = res;
+      vm.reg[REG_ARGL] = args;
+      vm.reg[REG_CONT] = enc_u(code->code_size);
+      res = bytecode_run(&vm, dec_u(entry));
+    }
+  }
+
+  stack_free(&vm.S);
+  return res;
+}
@@ -21,10 +21,12 @@
 #include "stack.h"
 #include "fundamental.h"
 #include "extensions.h"
+#include "bytecode.h"
 #include "typedefs.h"
 #include "ec_eval.h"
 #include "exp_kind.h"
 #include "print.h"
+#include "tokpar.h"
 
 typedef enum {
   CONT_DONE,
@@ -60,7 +62,7 @@ typedef enum {
  */
 
 typedef struct {
-  uint32_t cont;
+  VALUE cont;
   VALUE env;
   VALUE unev;
   VALUE prg;
@@ -77,13 +79,7 @@ register_machine_t rm_state;
 char str[1024];
 char err[1024];
 
-static int gc(VALUE env,
-       register_machine_t *rm) {
-
-  gc_state_inc();
-  gc_mark_freelist();
-  gc_mark_phase(env);
-
+static void mark_registers(register_machine_t *rm) {
   gc_mark_phase(rm->env);
   gc_mark_phase(rm->unev);
   gc_mark_phase(rm->prg);
@@ -92,6 +88,33 @@ static int gc(VALUE env,
   gc_mark_phase(rm->val);
   gc_mark_phase(rm->fun);
   gc_mark_aux(rm->S.data, rm->S.sp);
+}
+
+// Root marking callback for the bytecode interpreter
+static void mark_rm_state(void) {
+  mark_registers(&rm_state);
+}
+
+// Root relocation callback for the bytecode interpreter
+static void relocate_rm_state(void) {
+  rm_state.env  = gc_relocate(rm_state.env);
+  rm_state.unev = gc_relocate(rm_state.unev);
+  rm_state.prg  = gc_relocate(rm_state.prg);
+  rm_state.exp  = gc_relocate(rm_state.exp);
+  rm_state.argl = gc_relocate(rm_state.argl);
+  rm_state.val  = gc_relocate(rm_state.val);
+  rm_state.fun  = gc_relocate(rm_state.fun);
+  gc_relocate_aux(rm_state.S.data, rm_state.S.sp);
+}
+
+static int gc(VALUE env,
+       register_machine_t *rm) {
+
+  gc_state_inc();
+  gc_mark_freelist();
+  gc_mark_phase(env);
+
+  mark_registers(rm);
 
   return gc_sweep_phase();
 }
@@ -298,7 +321,7 @@ static inline void eval_apply_fundamental(eval_state *es) {
     count ++;
     args = cdr(args);
   }
-  UINT *fun_args = stack_ptr(&rm_state.S, count);
+  VALUE *fun_args = stack_ptr(&rm_state.S, count);
   VALUE val = fundamental_exec(fun_args, count, rm_state.fun);
   if (is_symbol_merror(val)) {
     gc(*env_get_global_ptr(), &rm_state);
@@ -350,7 +373,7 @@ static inline void eval_apply_extension(eval_state *es) {
   }
   UINT count = 0;
   VALUE args = rm_state.argl;
-  UINT *fun_args = stack_ptr(&rm_state.S, count);
+  VALUE *fun_args = stack_ptr(&rm_state.S, count);
   while (type_of(args) == PTR_TYPE_CONS) {
     push_u32(&rm_state.S, car(args));
     count ++;
@@ -362,6 +385,20 @@ static inline void eval_apply_extension(eval_state *es) {
   *es = EVAL_CONTINUATION;
 }
 
+static inline void eval_apply_bytecode(eval_state *es) {
+  VALUE val = bytecode_eval(rm_state.fun, rm_state.argl, mark_rm_state, relocate_rm_state);
+  if (type_of(val) == VAL_TYPE_SYMBOL &&
+      symrepr_is_error(dec_sym(val))) {
+    rm_state.cont = enc_u(CONT_ERROR);
+    rm_state.val  = val;
+    *es = EVAL_CONTINUATION;
+    return;
+  }
+  rm_state.val = val;
+  pop_u32(&rm_state.S, &rm_state.cont);
+  *es = EVAL_CONTINUATION;
+}
+
 static inline void eval_eval(eval_state *es) {
   rm_state.exp = car(rm_state.argl);
   pop_u32(&rm_state.S, &rm_state.cont);
@@ -372,6 +409,7 @@ static inline void eval_apply_dispatch(eval_state *es) {
   if (is_symbol_eval(rm_state.fun)) eval_eval(es);
   else if (is_fundamental(rm_state.fun)) eval_apply_fundamental(es);
   else if (is_closure(rm_state.fun)) eval_apply_closure(es);
+  else if (is_bytecode(rm_state.fun)) eval_apply_bytecode(es);
   else if (is_extension(rm_state.fun)) eval_apply_extension(es);
   else {
     rm_state.cont = enc_u(CONT_ERROR);
@@ -589,6 +627,10 @@ void ec_eval(void) {
 
   while (!done) {
 
+    if (heap_nursery_full()) {
+      gc(*env_get_global_ptr(), &rm_state);
+    }
+
     switch(es) {
     case EVAL_DISPATCH:
       switch (exp_kind_of(rm_state.exp)) {
@@ -639,8 +681,14 @@ VALUE ec_eval_program(VALUE prg) {
   rm_state.val = enc_sym(symrepr_nil());
   rm_state.fun = enc_sym(symrepr_nil());
   stack_allocate(&rm_state.S, 256, false);
+  tokpar_add_roots_callbacks(mark_rm_state, relocate_rm_state);
   ec_eval();
 
+  // Nothing is left for a later collection to mark
+  VALUE res = rm_state.val;
   stack_free(&rm_state.S);
-  return rm_state.val;
+  rm_state.S.sp = 0;
+  rm_state.env = rm_state.unev = rm_state.prg = rm_state.exp =
+    rm_state.argl = rm_state.val = rm_state.fun = enc_sym(symrepr_nil());
+  return res;
 }
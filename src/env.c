@@ -22,13 +22,147 @@
 #include "print.h"
 #include "typedefs.h"
 
+/* The global environment is a hash table in the heap: a tree of cons
+   cells env_global_depth levels deep where car or cdr is chosen by one
+   bit of the hash of a symbol at each level. The leaves are buckets
+   that are association lists like a local environment. As it is made
+   of cons cells only, the GC marks and moves it like any other value.
+   The table is created by the first env_set and doubled when there
+   are more than GLOBAL_LOAD bindings per bucket. */
+
+#define GLOBAL_MIN_DEPTH   4   // 16 buckets
+#define GLOBAL_MAX_DEPTH   12  // 4096 buckets
+#define GLOBAL_LOAD        4u
+
 VALUE env_global;
+static unsigned int env_global_depth;   // 0 while env_global is not a table
+static unsigned int env_global_count;
 
 int env_init(void) {
   env_global = enc_sym(symrepr_nil());
+  env_global_depth = 0;
+  env_global_count = 0;
   return 1;
 }
 
+unsigned int env_num_global_bindings(void) {
+  return env_global_count;
+}
+
+static inline bool is_merror(VALUE v) {
+  return (type_of(v) == VAL_TYPE_SYMBOL &&
+	  dec_sym(v) == symrepr_merror());
+}
+
+static inline bool is_global_table(VALUE env) {
+  return (env_global_depth > 0 && env == env_global);
+}
+
+static inline UINT global_bucket(VALUE key, unsigned int depth) {
+  return (dec_sym(key) * 2654435761u) >> (32 - depth);
+}
+
+// The node above bucket b, the bucket is its cdr if right is set
+static VALUE global_parent(VALUE table, unsigned int depth, UINT b, bool *right) {
+  VALUE node = table;
+  for (unsigned int i = depth - 1; i > 0; i --) {
+    node = ((b >> i) & 1) ? cdr(node) : car(node);
+  }
+  *right = b & 1;
+  return node;
+}
+
+// The key-val pair of sym in an association list, or nil
+static VALUE alist_binding(VALUE sym, VALUE env) {
+  VALUE curr = env;
+
+  while (type_of(curr) == PTR_TYPE_CONS) {
+    if (car(car(curr)) == sym) {
+      return car(curr);
+    }
+    curr = cdr(curr);
+  }
+  return enc_sym(symrepr_nil());
+}
+
+static VALUE global_binding(VALUE sym) {
+  bool right;
+  VALUE parent = global_parent(env_global, env_global_depth,
+			       global_bucket(sym, env_global_depth), &right);
+  return alist_binding(sym, right ? cdr(parent) : car(parent));
+}
+
+// An empty table, or merror. Nothing is collected while it is built.
+static VALUE global_table(unsigned int depth) {
+  if (depth == 0) return enc_sym(symrepr_nil());
+
+  VALUE l = global_table(depth - 1);
+  if (is_merror(l)) return l;
+  VALUE r = global_table(depth - 1);
+  if (is_merror(r)) return r;
+  return cons(l, r);
+}
+
+static bool global_insert(VALUE table, unsigned int depth, VALUE keyval) {
+  bool right;
+  VALUE parent = global_parent(table, depth,
+			       global_bucket(car(keyval), depth), &right);
+  VALUE bucket = cons(keyval, right ? cdr(parent) : car(parent));
+  if (is_merror(bucket)) return false;
+
+  if (right) set_cdr(parent, bucket);
+  else set_car(parent, bucket);
+  return true;
+}
+
+// Adds the key-val pairs of node, a table of the given depth or an
+// association list if depth is 0, to table
+static bool global_copy(VALUE node, unsigned int depth,
+			VALUE table, unsigned int table_depth) {
+  if (depth > 0) {
+    return (global_copy(car(node), depth - 1, table, table_depth) &&
+	    global_copy(cdr(node), depth - 1, table, table_depth));
+  }
+  for (VALUE curr = node; type_of(curr) == PTR_TYPE_CONS; curr = cdr(curr)) {
+    if (!global_insert(table, table_depth, car(curr))) return false;
+  }
+  return true;
+}
+
+// Moves the global bindings to a new table, false if out of memory
+static bool global_rehash(unsigned int depth) {
+  VALUE table = global_table(depth);
+  if (is_merror(table) ||
+      !global_copy(env_global, env_global_depth, table, depth)) {
+    return false;
+  }
+  env_global = table;
+  env_global_depth = depth;
+  return true;
+}
+
+static void global_iterate(VALUE node, unsigned int depth, void (*f)(VALUE)) {
+  if (depth > 0) {
+    global_iterate(car(node), depth - 1, f);
+    global_iterate(cdr(node), depth - 1, f);
+    return;
+  }
+  for (VALUE curr = node; type_of(curr) == PTR_TYPE_CONS; curr = cdr(curr)) {
+    VALUE val = cdr(car(curr));
+    // define adds the binding before the value is known
+    if (type_of(val) == VAL_TYPE_SYMBOL &&
+	dec_sym(val) == symrepr_not_found()) {
+      continue;
+    }
+    f(car(curr));
+  }
+}
+
+// Calls f with each key-val pair of the global environment
+void env_global_iterate(void (*f)(VALUE binding)) {
+  global_iterate(env_global, env_global_depth, f);
+}
+
 VALUE *env_get_global_ptr(void) {
   return &env_global;
 }
@@ -63,6 +197,14 @@ VALUE env_lookup(VALUE sym, VALUE env) {
     return sym;
   }
 
+  if (is_global_table(env)) {
+    VALUE keyval = global_binding(sym);
+    if (type_of(keyval) == PTR_TYPE_CONS) {
+      return cdr(keyval);
+    }
+    return enc_sym(symrepr_not_found());
+  }
+
   while (type_of(curr) == PTR_TYPE_CONS) {
     if (car(car(curr)) == sym) {
       return cdr(car(curr));
@@ -72,12 +214,56 @@ VALUE env_lookup(VALUE sym, VALUE env) {
   return enc_sym(symrepr_not_found());
 }
 
+// The key-val pair of sym, or nil if sym is not bound in env
+VALUE env_binding(VALUE sym, VALUE env) {
+  if (is_global_table(env)) {
+    return global_binding(sym);
+  }
+  return alist_binding(sym, env);
+}
+
+static VALUE global_set(VALUE key, VALUE val) {
+
+  VALUE keyval = global_binding(key);
+  if (type_of(keyval) == PTR_TYPE_CONS) {
+    set_cdr(keyval, val);
+    return env_global;
+  }
+
+  keyval = cons(key, val);
+  if (type_of(keyval) == VAL_TYPE_SYMBOL) {
+    return keyval;
+  }
+  if (!global_insert(env_global, env_global_depth, keyval)) {
+    return enc_sym(symrepr_merror());
+  }
+  env_global_count ++;
+
+  // The table is still usable if it cannot grow
+  if (env_global_count > (GLOBAL_LOAD << env_global_depth) &&
+      env_global_depth < GLOBAL_MAX_DEPTH) {
+    global_rehash(env_global_depth + 1);
+  }
+  return env_global;
+}
+
 VALUE env_set(VALUE env, VALUE key, VALUE val) {
 
   VALUE curr = env;
   VALUE new_env;
   VALUE keyval;
 
+  if (env == env_global) {
+    if (env_global_depth == 0) {
+      unsigned int n = length(env_global);
+      if (!global_rehash(GLOBAL_MIN_DEPTH)) {
+	return enc_sym(symrepr_merror());
+      }
+      env_global_count = n;
+    }
+    return global_set(key, val);
+  }
+
   while(type_of(curr) == PTR_TYPE_CONS) {
     if (car(car(curr)) == key) {
       set_cdr(car(curr),val);
@@ -104,6 +290,15 @@ VALUE env_modify_binding(VALUE env, VALUE key, VALUE val) {
 
   VALUE curr = env;
 
+  if (is_global_table(env)) {
+    VALUE keyval = global_binding(key);
+    if (type_of(keyval) != PTR_TYPE_CONS) {
+      return enc_sym(symrepr_not_found());
+    }
+    set_cdr(keyval, val);
+    return env;
+  }
+
   while (type_of(curr) == PTR_TYPE_CONS) {
     if (car(car(curr)) == key) {
       set_cdr(car(curr), val);
@@ -22,6 +22,9 @@
 #include "stack.h"
 #include "fundamental.h"
 #include "extensions.h"
+#include "bytecode.h"
+#include "tokpar.h"
+#include "lexical.h"
 #include "typedefs.h"
 #ifdef VISUALIZE_HEAP
 #include "heap_vis.h"
@@ -83,6 +86,9 @@ static void (*usleep_callback)(uint32_t) = NULL;
 static uint32_t (*timestamp_us_callback)(void) = NULL;
 static void (*ctx_done_callback)(eval_context_t *) = NULL;
 
+static void mark_contexts(void);
+static void relocate_contexts(void);
+
 void eval_cps_set_usleep_callback(void (*fptr)(uint32_t)) {
   usleep_callback = fptr;
 }
@@ -266,6 +272,9 @@ CID create_ctx(VALUE program, VALUE env, uint32_t stack_size, bool grow_stack) {
   ctx = malloc(sizeof(eval_context_t));
   if (ctx == NULL) return 0;
   
+  // program is not reachable from the roots of an incremental
+  // collection that is already marking.
+  gc_write_barrier(program);
   ctx->program = cdr(program);
   ctx->curr_exp = car(program);
   ctx->curr_env = env;
@@ -278,7 +287,7 @@ CID create_ctx(VALUE program, VALUE env, uint32_t stack_size, bool grow_stack) {
     free(ctx);
     return 0;
   }
-  if (!push_u32(&ctx->K, enc_u(DONE))) {
+  if (!push_u32_2(&ctx->K, env, enc_u(DONE))) {
     free(ctx);
     stack_free(&ctx->K);
     return 0;
@@ -292,7 +301,7 @@ CID create_ctx(VALUE program, VALUE env, uint32_t stack_size, bool grow_stack) {
 void advance_ctx(void) {
 
   if (type_of(ctx_running->program) == PTR_TYPE_CONS) {
-    push_u32(&ctx_running->K, enc_u(DONE));
+    push_u32_2(&ctx_running->K, ctx_running->curr_env, enc_u(DONE));
     ctx_running->curr_exp = car(ctx_running->program);
     ctx_running->program = cdr(ctx_running->program);
     ctx_running->r = NIL;
@@ -344,6 +353,9 @@ void apply_continuation(eval_context_t *ctx, bool *perform_gc){
 
   switch(dec_u(k)) {
   case DONE:
+    // The rest of the program is evaluated in the environment it
+    // started in.
+    pop_u32(&ctx->K, &ctx->curr_env);
     advance_ctx();
     return;
   case SET_GLOBAL_ENV:
@@ -369,6 +381,7 @@ void apply_continuation(eval_context_t *ctx, bool *perform_gc){
     if (type_of(cdr(rest)) == VAL_TYPE_SYMBOL &&
 	cdr(rest) == NIL) {
       ctx->curr_exp = car(rest);
+      ctx->curr_env = env;
       return;
     }
     // Else create a continuation
@@ -429,46 +442,66 @@ void apply_continuation(eval_context_t *ctx, bool *perform_gc){
     VALUE count;
     pop_u32(&ctx->K, &count);
 
-    UINT *fun_args = stack_ptr(&ctx->K, dec_u(count)+1);
+    VALUE *fun_args = stack_ptr(&ctx->K, dec_u(count)+1);
 
     VALUE fun = fun_args[0];
 
-    if (type_of(fun) == PTR_TYPE_CONS) { // a closure (it better be)
-      VALUE args = NIL;
-      for (UINT i = dec_u(count); i > 0; i --) {
-	args = cons(fun_args[i], args);
-	if (type_of(args) == VAL_TYPE_SYMBOL) {
-	  FATAL_ON_FAIL(ctx->done, push_u32_2(&ctx->K, count, enc_u(APPLICATION)));
-	  *perform_gc = true;
-	  ctx->app_cont = true;
-	  ctx->r = fun;
-	  return;
-	}
-      }
+    if (type_of(fun) == PTR_TYPE_CONS &&
+	dec_sym(car(fun)) == symrepr_closure_lex()) {
       VALUE params  = car(cdr(fun));
       VALUE exp     = car(cdr(cdr(fun)));
       VALUE clo_env = car(cdr(cdr(cdr(fun))));
 
-      if (length(params) != length(args)) { // programmer error
+      if (length(params) != dec_u(count)) { // programmer error
 	ERROR
 	error_ctx(enc_sym(symrepr_eerror()));
 	return;
       }
 
-      VALUE local_env = env_build_params_args(params, args, clo_env);
-      if (type_of(local_env) == VAL_TYPE_SYMBOL) {
-	if (dec_sym(local_env) == symrepr_merror() ) {
+      // One frame of the arguments on the stack
+      VALUE local_env = clo_env;
+      if (dec_u(count) > 0) {
+	local_env = lexical_frame(&fun_args[1], dec_u(count), clo_env);
+	if (type_of(local_env) == VAL_TYPE_SYMBOL) {
 	  FATAL_ON_FAIL(ctx->done, push_u32_2(&ctx->K, count, enc_u(APPLICATION)));
 	  *perform_gc = true;
 	  ctx->app_cont = true;
 	  ctx->r = fun;
 	  return;
 	}
+      }
+      stack_drop(&ctx->K, dec_u(count)+1);
+      ctx->curr_exp = exp;
+      ctx->curr_env = local_env;
+      return;
+    } else if (type_of(fun) == PTR_TYPE_CONS) { // a closure (it better be)
+      VALUE params  = car(cdr(fun));
+      VALUE exp     = car(cdr(cdr(fun)));
+      VALUE clo_env = car(cdr(cdr(cdr(fun))));
 
-	if (dec_sym(local_env) == symrepr_fatal_error()) {
-	  ctx->r = local_env;
+      // Bind the parameters directly to the arguments on the stack
+      VALUE local_env = clo_env;
+      VALUE curr_param = params;
+      UINT i;
+      for (i = 1; i <= dec_u(count); i ++) {
+	if (type_of(curr_param) != PTR_TYPE_CONS) break;
+	VALUE binding = cons(car(curr_param), fun_args[i]);
+	local_env = cons(binding, local_env);
+	if (type_of(binding) == VAL_TYPE_SYMBOL ||
+	    type_of(local_env) == VAL_TYPE_SYMBOL) {
+	  FATAL_ON_FAIL(ctx->done, push_u32_2(&ctx->K, count, enc_u(APPLICATION)));
+	  *perform_gc = true;
+	  ctx->app_cont = true;
+	  ctx->r = fun;
 	  return;
 	}
+	curr_param = cdr(curr_param);
+      }
+
+      if (i <= dec_u(count) || curr_param != NIL) { // programmer error
+	ERROR
+	error_ctx(enc_sym(symrepr_eerror()));
+	return;
       }
 
       /* ************************************************************
@@ -485,6 +518,30 @@ void apply_continuation(eval_context_t *ctx, bool *perform_gc){
       ctx->curr_exp = exp;
       ctx->curr_env = local_env;
       return;
+    } else if (type_of(fun) == PTR_TYPE_BYTECODE) {
+      VALUE args = NIL;
+      for (UINT i = dec_u(count); i > 0; i --) {
+	args = cons(fun_args[i], args);
+	if (type_of(args) == VAL_TYPE_SYMBOL) {
+	  FATAL_ON_FAIL(ctx->done, push_u32_2(&ctx->K, count, enc_u(APPLICATION)));
+	  *perform_gc = true;
+	  ctx->app_cont = true;
+	  ctx->r = fun;
+	  return;
+	}
+      }
+
+      VALUE res = bytecode_eval(fun, args, mark_contexts, relocate_contexts);
+      if (type_of(res) == VAL_TYPE_SYMBOL &&
+	  symrepr_is_error(dec_sym(res))) {
+	ERROR
+	error_ctx(res);
+	return;
+      }
+      stack_drop(&ctx->K, dec_u(count)+1);
+      ctx->app_cont = true;
+      ctx->r = res;
+      return;
     } else if (type_of(fun) == VAL_TYPE_SYMBOL) {
 
 
@@ -547,8 +604,6 @@ void apply_continuation(eval_context_t *ctx, bool *perform_gc){
     }
 
     // It may be an extension
-    printf("Trying to apply to: %u\n", dec_sym(fun));
-
     extension_fptr f = extensions_lookup(dec_sym(fun));
     if (f == NULL) {
       ERROR
@@ -674,7 +729,11 @@ void apply_continuation(eval_context_t *ctx, bool *perform_gc){
 
     pop_u32_3(&ctx->K, &key, &env, &rest);
 
-    env_modify_binding(env, key, arg);
+    if (symrepr_is_lexical_ref(dec_sym(key))) {
+      lexical_set(key, env, arg);
+    } else {
+      env_modify_binding(env, key, arg);
+    }
 
     if ( type_of(rest) == PTR_TYPE_CONS ){
       VALUE keyn = car(car(rest));
@@ -697,14 +756,16 @@ void apply_continuation(eval_context_t *ctx, bool *perform_gc){
   case IF: {
     VALUE then_branch;
     VALUE else_branch;
+    VALUE env;
 
-    pop_u32_2(&ctx->K, &then_branch, &else_branch);
+    pop_u32_3(&ctx->K, &then_branch, &else_branch, &env);
 
     if (type_of(arg) == VAL_TYPE_SYMBOL && dec_sym(arg) == symrepr_true()) {
       ctx->curr_exp = then_branch;
     } else {
       ctx->curr_exp = else_branch;
     }
+    ctx->curr_env = env;
     return;
   }
   } // end switch
@@ -713,14 +774,9 @@ void apply_continuation(eval_context_t *ctx, bool *perform_gc){
   return;
 }
 
-static int gc(VALUE env,
-	      eval_context_t *runnable,
-	      eval_context_t *done,
-	      eval_context_t *running) {
-
-  gc_state_inc();
-  gc_mark_freelist();
-  gc_mark_phase(env);
+static void mark_contexts_aux(eval_context_t *runnable,
+			      eval_context_t *done,
+			      eval_context_t *running) {
 
   eval_context_t *curr = runnable;
   while (curr) {
@@ -738,18 +794,74 @@ static int gc(VALUE env,
     curr = curr->next;
   }
 
-  gc_mark_phase(running->curr_env);
-  gc_mark_phase(running->curr_exp);
-  gc_mark_phase(running->program);
-  gc_mark_phase(running->r);
-  gc_mark_aux(running->K.data, running->K.sp);
+  if (running) {
+    gc_mark_phase(running->curr_env);
+    gc_mark_phase(running->curr_exp);
+    gc_mark_phase(running->program);
+    gc_mark_phase(running->r);
+    gc_mark_aux(running->K.data, running->K.sp);
+  }
+
+  lexical_mark_cache();
+}
+
+// Used as a root marking callback by the bytecode interpreter and
+// by the parser when they need to collect garbage.
+static void mark_contexts(void) {
+  mark_contexts_aux(ctx_queue, ctx_done, ctx_running);
+}
+
+// Roots for incremental collection
+static void mark_roots(void) {
+  gc_mark_phase(*env_get_global_ptr());
+  mark_contexts();
+}
+
+static void relocate_ctx(eval_context_t *ctx) {
+  ctx->curr_env = gc_relocate(ctx->curr_env);
+  ctx->curr_exp = gc_relocate(ctx->curr_exp);
+  ctx->program = gc_relocate(ctx->program);
+  ctx->r = gc_relocate(ctx->r);
+  gc_relocate_aux(ctx->K.data, ctx->K.sp);
+}
+
+static void relocate_contexts(void) {
+  for (eval_context_t *curr = ctx_queue; curr; curr = curr->next) {
+    relocate_ctx(curr);
+  }
+  for (eval_context_t *curr = ctx_done; curr; curr = curr->next) {
+    curr->r = gc_relocate(curr->r);
+  }
+  if (ctx_running) {
+    relocate_ctx(ctx_running);
+  }
+  lexical_relocate_cache();
+}
+
+// Roots for compaction. Everything the evaluator holds between
+// steps is in the global environment and in the contexts.
+static void relocate_roots(void) {
+  VALUE *env = env_get_global_ptr();
+  *env = gc_relocate(*env);
+  relocate_contexts();
+}
+
+static int gc(VALUE env,
+	      eval_context_t *runnable,
+	      eval_context_t *done,
+	      eval_context_t *running) {
+
+  gc_state_inc();
+  gc_mark_freelist();
+  gc_mark_phase(env);
 
+  mark_contexts_aux(runnable, done, running);
 
 #ifdef VISUALIZE_HEAP
   heap_vis_gen_image();
 #endif
 
-  return gc_sweep_phase();
+  return gc_compact_phase(relocate_roots);
 }
 
 void evaluation_step(bool *perform_gc, bool *last_iteration_gc){
@@ -773,6 +885,14 @@ void evaluation_step(bool *perform_gc, bool *last_iteration_gc){
     *perform_gc = false;
   } else {
     *last_iteration_gc = false;;
+    if (heap_nursery_full()) {
+      gc(*env_get_global_ptr(),
+	 ctx_queue,
+	 ctx_done,
+	 ctx_running);
+    } else {
+      gc_incremental_step(mark_roots);
+    }
   }
 
   if (ctx->app_cont) {
@@ -787,7 +907,9 @@ void evaluation_step(bool *perform_gc, bool *last_iteration_gc){
 
   case VAL_TYPE_SYMBOL:
 
-    if (is_special(ctx->curr_exp) ||
+    if (symrepr_is_lexical_ref(dec_sym(ctx->curr_exp))) {
+      value = lexical_lookup(ctx->curr_exp, ctx->curr_env);
+    } else if (is_special(ctx->curr_exp) ||
 	(extensions_lookup(dec_sym(ctx->curr_exp)) != NULL)) {
       // Special symbols and extension symbols evaluate to themself
       value = ctx->curr_exp; 
@@ -811,9 +933,23 @@ void evaluation_step(bool *perform_gc, bool *last_iteration_gc){
   case VAL_TYPE_U:
   case VAL_TYPE_CHAR:
   case PTR_TYPE_ARRAY:
+  case PTR_TYPE_BYTECODE:
     ctx->app_cont = true;
     ctx->r = ctx->curr_exp;
     break;
+  case PTR_TYPE_GLOBAL_REF: {
+    VALUE binding = dec_global_ref(ctx->curr_exp);
+    value = cdr(binding);
+    // Still unbound, the name may have become an extension since
+    if (type_of(value) == VAL_TYPE_SYMBOL &&
+	dec_sym(value) == symrepr_not_found() &&
+	extensions_lookup(dec_sym(car(binding))) != NULL) {
+      value = car(binding);
+    }
+    ctx->app_cont = true;
+    ctx->r = value;
+    break;
+  }
   case PTR_TYPE_REF:
   case PTR_TYPE_STREAM:
     ERROR
@@ -845,6 +981,22 @@ void evaluation_step(bool *perform_gc, bool *last_iteration_gc){
 	  return;
 	}
 
+	// The binding is added, unbound, before the value is evaluated
+	// so that references to key in a lambda can point at it
+	VALUE *global = env_get_global_ptr();
+	if (type_of(env_binding(key, *global)) != PTR_TYPE_CONS) {
+	  VALUE new_env = env_set(*global, key, enc_sym(symrepr_not_found()));
+	  if (type_of(new_env) == VAL_TYPE_SYMBOL) {
+	    if (dec_sym(new_env) == symrepr_merror()) {
+	      *perform_gc = true;
+	      ctx->app_cont = false;
+	      return;
+	    }
+	  } else {
+	    *global = new_env;
+	  }
+	}
+
 	FOF(push_u32_2(&ctx->K, key, enc_u(SET_GLOBAL_ENV)));
 	ctx->curr_exp = val_exp;
 	return;
@@ -891,9 +1043,27 @@ void evaluation_step(bool *perform_gc, bool *last_iteration_gc){
       }
 
       // Special form: LAMBDA
+      VALUE lam = ctx->curr_exp;
       if (sym_id == symrepr_lambda()) {
+	lam = lexical_resolve_lambda(ctx->curr_exp, ctx->curr_env);
+	if (type_of(lam) == VAL_TYPE_SYMBOL &&
+	    dec_sym(lam) == symrepr_merror()) {
+	  *perform_gc = true;
+	  ctx->app_cont = false;
+	  return;
+	}
+	// Still a lambda if it cannot be resolved
+	sym_id = dec_sym(car(lam));
+      }
+      if (sym_id == symrepr_lambda() ||
+	  sym_id == symrepr_lambda_lex()) {
 
-	VALUE env_cpy = env_copy_shallow(ctx->curr_env);
+	VALUE env_cpy;
+	if (sym_id == symrepr_lambda_lex()) {
+	  env_cpy = lexical_capture(lam, ctx->curr_env);
+	} else {
+	  env_cpy = env_copy_shallow(ctx->curr_env);
+	}
 
 	if (type_of(env_cpy) == VAL_TYPE_SYMBOL &&
 	    dec_sym(env_cpy) == symrepr_merror()) {
@@ -907,9 +1077,11 @@ void evaluation_step(bool *perform_gc, bool *last_iteration_gc){
 	VALUE params;
 	VALUE closure;
 	env_end = cons(env_cpy,NIL);
-	body    = cons(car(cdr(cdr(ctx->curr_exp))), env_end);
-	params  = cons(car(cdr(ctx->curr_exp)), body);
-	closure = cons(enc_sym(symrepr_closure()), params);
+	body    = cons(car(cdr(cdr(lam))), env_end);
+	params  = cons(car(cdr(lam)), body);
+	closure = cons(enc_sym(sym_id == symrepr_lambda_lex() ?
+			       symrepr_closure_lex() :
+			       symrepr_closure()), params);
 
 	if (type_of(env_end) == VAL_TYPE_SYMBOL ||
 	    type_of(body)    == VAL_TYPE_SYMBOL ||
@@ -928,7 +1100,8 @@ void evaluation_step(bool *perform_gc, bool *last_iteration_gc){
       // Special form: IF
       if (sym_id == symrepr_if()) {
 
-	FOF(push_u32_3(&ctx->K,
+	FOF(push_u32_4(&ctx->K,
+		       ctx->curr_env,
 		       car(cdr(cdr(cdr(ctx->curr_exp)))), // Else branch
 		       car(cdr(cdr(ctx->curr_exp))),      // Then branch
 		       enc_u(IF)));
@@ -936,7 +1109,8 @@ void evaluation_step(bool *perform_gc, bool *last_iteration_gc){
 	return;
       }
       // Special form: LET
-      if (sym_id == symrepr_let()) {
+      if (sym_id == symrepr_let() ||
+	  sym_id == symrepr_let_lex()) {
 	VALUE orig_env = ctx->curr_env;
 	VALUE binds    = car(cdr(ctx->curr_exp)); // key value pairs.
 	VALUE exp      = car(cdr(cdr(ctx->curr_exp))); // exp to evaluate in the new env.
@@ -950,6 +1124,17 @@ void evaluation_step(bool *perform_gc, bool *last_iteration_gc){
 	  return;
 	}
 
+	// The keys of a let-lex are slots of one frame
+	if (sym_id == symrepr_let_lex()) {
+	  new_env = lexical_let_frame(binds, orig_env);
+	  if (type_of(new_env) == VAL_TYPE_SYMBOL) {
+	    *perform_gc = true;
+	    ctx->app_cont = false;
+	    return;
+	  }
+	  curr = NIL;
+	}
+
 	// Implements letrec by "preallocating" the key parts
 	while (type_of(curr) == PTR_TYPE_CONS) {
 	  VALUE key = car(car(curr));
@@ -1044,6 +1229,7 @@ VALUE eval_cps_program_nc(VALUE lisp) {
 
   if (type_of(lisp) != PTR_TYPE_CONS)
     return enc_sym(symrepr_eerror());
+  gc_write_barrier(lisp);
   ctx_non_concurrent.program = cdr(lisp);
   ctx_non_concurrent.curr_exp = car(lisp);
   ctx_non_concurrent.curr_env = NIL;
@@ -1055,7 +1241,7 @@ VALUE eval_cps_program_nc(VALUE lisp) {
 
   stack_clear(&ctx_non_concurrent.K);
 
-  if (!push_u32(&ctx_non_concurrent.K, enc_u(DONE)))
+  if (!push_u32_2(&ctx_non_concurrent.K, NIL, enc_u(DONE)))
     return enc_sym(symrepr_merror());
 
   ctx_running = &ctx_non_concurrent;
@@ -1068,16 +1254,16 @@ int eval_cps_init_nc(unsigned int stack_size, bool grow_stack) {
   NIL = enc_sym(symrepr_nil());
   NONSENSE = enc_sym(symrepr_nonsense());
  
-  VALUE nil_entry = cons(NIL, NIL);
-  *env_get_global_ptr() = cons(nil_entry, *env_get_global_ptr());
-
-  if (type_of(nil_entry) == VAL_TYPE_SYMBOL ||
-      type_of(*env_get_global_ptr()) == VAL_TYPE_SYMBOL)
-    return 0;
+  VALUE env = env_set(*env_get_global_ptr(), NIL, NIL);
+  if (type_of(env) == VAL_TYPE_SYMBOL) return 0;
+  *env_get_global_ptr() = env;
 
   if (!stack_allocate(&ctx_non_concurrent.K, stack_size, grow_stack))
     return 0;
 
+  lexical_init();
+  tokpar_add_roots_callbacks(mark_contexts, relocate_contexts);
+
   return 1;
 }
 
@@ -1086,14 +1272,15 @@ int eval_cps_init() {
   NIL = enc_sym(symrepr_nil());
   NONSENSE = enc_sym(symrepr_nonsense());
 
-  VALUE nil_entry = cons(NIL, NIL);
-  *env_get_global_ptr() = cons(nil_entry, *env_get_global_ptr());
-
-  if (type_of(nil_entry) == VAL_TYPE_SYMBOL ||
-      type_of(*env_get_global_ptr()) == VAL_TYPE_SYMBOL) res = 0;
+  VALUE env = env_set(*env_get_global_ptr(), NIL, NIL);
+  if (type_of(env) == VAL_TYPE_SYMBOL) res = 0;
+  else *env_get_global_ptr() = env;
 
   eval_running = true;
 
+  lexical_init();
+  tokpar_add_roots_callbacks(mark_contexts, relocate_contexts);
+
   return res;
 }
 
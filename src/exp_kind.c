@@ -32,6 +32,7 @@ exp_kind exp_kind_of(VALUE exp) {
   case VAL_TYPE_U:
   case VAL_TYPE_CHAR:
   case PTR_TYPE_ARRAY:
+  case PTR_TYPE_BYTECODE:
     return EXP_SELF_EVALUATING;
   case PTR_TYPE_CONS: {
     VALUE head = car(exp);
@@ -22,49 +22,83 @@
 
 #include "extensions.h"
 
-typedef struct s_extension_function{
-  VALUE sym;
-  extension_fptr ext_fun;
-  struct s_extension_function* next;
-} extension_function_t;
+/* The extension functions, in an open addressing (linear probing)
+   hash table keyed by symbol id. Extension names are added to the
+   symbol table like any other symbol, so their ids can be far apart,
+   and the table is sized by the number of extensions rather than by
+   the largest id. An empty slot has sym 0, no extension has that id.
+   The table doubles when it is half full. */
+#define EXTENSIONS_INIT_SIZE 16 // must be a power of two
 
-extension_function_t* extensions = NULL;
+typedef struct {
+  UINT sym;
+  extension_fptr fptr;
+} extension_t;
+
+static extension_t *extensions = NULL;
+static UINT extensions_size = 0;
+static UINT extensions_num = 0;
+
+static inline UINT ext_hash(UINT sym) {
+  return (UINT)(sym * 2654435761u);
+}
+
+// The slot of sym, or the empty slot where it goes
+static extension_t *ext_slot(extension_t *table, UINT size, UINT sym) {
+  UINT mask = size - 1;
+  UINT i = ext_hash(sym) & mask;
+  while (table[i].sym != 0 && table[i].sym != sym) {
+    i = (i + 1) & mask;
+  }
+  return &table[i];
+}
 
 extension_fptr extensions_lookup(UINT sym) {
-  extension_function_t *t = extensions;
-  while (t != NULL) {
-    if (t->sym == sym) {
-      return t->ext_fun;
-    }
-    t = t->next;
+  if (sym < MAX_SPECIAL_SYMBOLS || extensions_num == 0) {
+    return NULL;
   }
-  return NULL;
+  return ext_slot(extensions, extensions_size, sym)->fptr;
 }
 
-bool extensions_add(char *sym_str, extension_fptr ext) {
-  VALUE symbol;
-  int res = symrepr_addsym(sym_str, &symbol);
+static bool ext_grow(void) {
+  UINT size = extensions_size ? extensions_size * 2 : EXTENSIONS_INIT_SIZE;
+  extension_t *t = calloc(size, sizeof(extension_t));
+  if (!t) return false;
 
-  if (!res) return false;
+  for (UINT i = 0; i < extensions_size; i ++) {
+    if (extensions[i].sym != 0) {
+      *ext_slot(t, size, extensions[i].sym) = extensions[i];
+    }
+  }
+  free(extensions);
+  extensions = t;
+  extensions_size = size;
+  return true;
+}
 
-  extension_function_t *extension = malloc(sizeof(extension_function_t));
+bool extensions_add(char *sym_str, extension_fptr ext) {
+  UINT symbol;
+  // Code read before the extension is added uses the same symbol
+  int res = (symrepr_lookup(sym_str, &symbol) ||
+	     symrepr_addsym(sym_str, &symbol));
 
-  if (!extension) return false;
+  if (!res || symbol < MAX_SPECIAL_SYMBOLS) return false;
 
-  extension->sym = symbol;
-  extension->ext_fun = ext;
-  extension->next = extensions;
-  extensions = extension;
+  if (2 * (extensions_num + 1) > extensions_size && !ext_grow()) {
+    return false;
+  }
+  extension_t *e = ext_slot(extensions, extensions_size, symbol);
+  if (e->sym == 0) {
+    e->sym = symbol;
+    extensions_num ++;
+  }
+  e->fptr = ext;
   return true;
 }
 
 void extensions_del(void) {
-  extension_function_t *curr = extensions;
-  extension_function_t *t;
-  while (curr) {
-    t = curr;
-    curr = curr->next;
-    free(t);
-  }
+  free(extensions);
   extensions = NULL;
+  extensions_size = 0;
+  extensions_num = 0;
 }
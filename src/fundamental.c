@@ -23,10 +23,7 @@
 
 #include <stdio.h>
 
-static UINT as_i(UINT a) {
-
-  UINT tmp;
-  FLOAT f_tmp;
+static UINT as_i(VALUE a) {
 
   switch (type_of(a)) {
   case VAL_TYPE_I:
@@ -35,19 +32,14 @@ static UINT as_i(UINT a) {
     return (INT) dec_u(a);
   case PTR_TYPE_BOXED_I:
   case PTR_TYPE_BOXED_U:
-    return (INT)car(a);
+    return (INT)dec_boxed(a);
   case PTR_TYPE_BOXED_F:
-    tmp = car(a);
-    memcpy(&f_tmp, &tmp, sizeof(FLOAT));
-    return (INT)f_tmp;
+    return (INT)dec_f(a);
   }
   return 0;
 }
 
-static UINT as_u(UINT a) {
-
-  UINT tmp;
-  FLOAT f_tmp;
+static UINT as_u(VALUE a) {
 
   switch (type_of(a)) {
   case VAL_TYPE_I:
@@ -56,19 +48,14 @@ static UINT as_u(UINT a) {
     return dec_u(a);
   case PTR_TYPE_BOXED_I:
   case PTR_TYPE_BOXED_U:
-    return (UINT)car(a);
+    return dec_boxed(a);
   case PTR_TYPE_BOXED_F:
-    tmp = car(a);
-    memcpy(&f_tmp, &tmp, sizeof(FLOAT));
-    return (UINT)f_tmp;
+    return (UINT)dec_f(a);
   }
   return 0;
 }
 
-static UINT as_f(UINT a) {
-
-  UINT tmp;
-  FLOAT f_tmp;
+static FLOAT as_f(VALUE a) {
 
   switch (type_of(a)) {
   case VAL_TYPE_I:
@@ -77,20 +64,26 @@ static UINT as_f(UINT a) {
     return (FLOAT)dec_u(a);
   case PTR_TYPE_BOXED_I:
   case PTR_TYPE_BOXED_U:
-    return (FLOAT)car(a);
+    return (FLOAT)dec_boxed(a);
   case PTR_TYPE_BOXED_F:
-    tmp = car(a);
-    memcpy(&f_tmp, &tmp, sizeof(FLOAT));
-    return f_tmp;
+    return dec_f(a);
   }
   return 0;
 }
 
-static UINT add2(UINT a, UINT b) {
+static VALUE add2(VALUE a, VALUE b) {
 
-  UINT retval = enc_sym(symrepr_terror());
-  UINT t_min;
-  UINT t_max;
+  // Same type small numbers need no conversion
+  if (type_of(a) == VAL_TYPE_I && type_of(b) == VAL_TYPE_I) {
+    return enc_i(dec_i(a) + dec_i(b));
+  }
+  if (type_of(a) == VAL_TYPE_U && type_of(b) == VAL_TYPE_U) {
+    return enc_u(dec_u(a) + dec_u(b));
+  }
+
+  VALUE retval = enc_sym(symrepr_terror());
+  VALUE t_min;
+  VALUE t_max;
   INT i0;
   INT i1;
   UINT u0;
@@ -142,11 +135,19 @@ static UINT add2(UINT a, UINT b) {
   return retval;
 }
 
-static UINT mul2(UINT a, UINT b) {
+static VALUE mul2(VALUE a, VALUE b) {
 
-  UINT retval = enc_sym(symrepr_terror());
-  UINT t_min;
-  UINT t_max;
+  // Same type small numbers need no conversion
+  if (type_of(a) == VAL_TYPE_I && type_of(b) == VAL_TYPE_I) {
+    return enc_i(dec_i(a) * dec_i(b));
+  }
+  if (type_of(a) == VAL_TYPE_U && type_of(b) == VAL_TYPE_U) {
+    return enc_u(dec_u(a) * dec_u(b));
+  }
+
+  VALUE retval = enc_sym(symrepr_terror());
+  VALUE t_min;
+  VALUE t_max;
   INT i0;
   INT i1;
   UINT u0;
@@ -196,11 +197,21 @@ static UINT mul2(UINT a, UINT b) {
   return retval;
 }
 
-static UINT div2(UINT a, UINT b) {
+static VALUE div2(VALUE a, VALUE b) {
+
+  // Same type small numbers need no conversion
+  if (type_of(a) == VAL_TYPE_I && type_of(b) == VAL_TYPE_I) {
+    if (dec_i(b) == 0) return enc_sym(symrepr_divzero());
+    return enc_i(dec_i(a) / dec_i(b));
+  }
+  if (type_of(a) == VAL_TYPE_U && type_of(b) == VAL_TYPE_U) {
+    if (dec_u(b) == 0) return enc_sym(symrepr_divzero());
+    return enc_u(dec_u(a) / dec_u(b));
+  }
 
-  UINT retval = enc_sym(symrepr_terror());
-  UINT t_min;
-  UINT t_max;
+  VALUE retval = enc_sym(symrepr_terror());
+  VALUE t_min;
+  VALUE t_max;
   INT i0;
   INT i1;
   UINT u0;
@@ -255,11 +266,11 @@ static UINT div2(UINT a, UINT b) {
   return retval;
 }
 
-static UINT mod2(UINT a, UINT b) {
+static VALUE mod2(VALUE a, VALUE b) {
 
-  UINT retval = enc_sym(symrepr_terror());
-  UINT t_min;
-  UINT t_max;
+  VALUE retval = enc_sym(symrepr_terror());
+  VALUE t_min;
+  VALUE t_max;
   INT i0;
   INT i1;
   UINT u0;
@@ -307,9 +318,9 @@ static UINT mod2(UINT a, UINT b) {
   return retval;
 }
 
-static UINT negate(UINT a) {
+static VALUE negate(VALUE a) {
 
-  UINT retval = enc_sym(symrepr_terror());
+  VALUE retval = enc_sym(symrepr_terror());
   INT i0;
   UINT u0;
   FLOAT f0;
@@ -343,11 +354,19 @@ static UINT negate(UINT a) {
   return retval;
 }
 
-static UINT sub2(UINT a, UINT b) {
+static VALUE sub2(VALUE a, VALUE b) {
 
-  UINT retval = enc_sym(symrepr_terror());
-  UINT t_min;
-  UINT t_max;
+  // Same type small numbers need no conversion
+  if (type_of(a) == VAL_TYPE_I && type_of(b) == VAL_TYPE_I) {
+    return enc_i(dec_i(a) - dec_i(b));
+  }
+  if (type_of(a) == VAL_TYPE_U && type_of(b) == VAL_TYPE_U) {
+    return enc_u(dec_u(a) - dec_u(b));
+  }
+
+  VALUE retval = enc_sym(symrepr_terror());
+  VALUE t_min;
+  VALUE t_max;
   INT i0;
   INT i1;
   UINT u0;
@@ -399,25 +418,30 @@ static UINT sub2(UINT a, UINT b) {
 static bool array_equality(VALUE a, VALUE b) {
   if (type_of(a) == PTR_TYPE_ARRAY &&
       type_of(a) == type_of(b)) {
-    array_header_t *a_ = (array_header_t*)car(a);
-    array_header_t *b_ = (array_header_t*)car(b);
-
-    if (a_->elt_type == b_->elt_type &&
-	a_->size == b_->size) {
-      switch(a_->elt_type) {
+    // Equal interned strings are the same array
+    if (a == b) return true;
+    if (array_is_interned(a) && array_is_interned(b)) return false;
+    TYPE elt_type = array_elt_type(a);
+    uint32_t size = array_size(a);
+    char *a_ = array_data(a);
+    char *b_ = array_data(b);
+
+    if (elt_type == array_elt_type(b) &&
+	size == array_size(b)) {
+      switch(elt_type) {
       case VAL_TYPE_U:
       case PTR_TYPE_BOXED_U:
-	if (memcmp((char*)a_+8, (char*)b_+8, a_->size * sizeof(UINT)) == 0) return true;
+	if (memcmp(a_, b_, size * sizeof(UINT)) == 0) return true;
 	break;
       case VAL_TYPE_I:
       case PTR_TYPE_BOXED_I:
-	if (memcmp((char*)a_+8, (char*)b_+8, a_->size * sizeof(INT)) == 0) return true;
+	if (memcmp(a_, b_, size * sizeof(INT)) == 0) return true;
 	break;
       case VAL_TYPE_CHAR:
-	if (memcmp((char*)a_+8, (char*)b_+8, a_->size) == 0) return true;
+	if (memcmp(a_, b_, size) == 0) return true;
 	break;
       case PTR_TYPE_BOXED_F:
-	if (memcmp((char*)a_+8, (char*)b_+8, a_->size * sizeof(FLOAT)) == 0) return true;
+	if (memcmp(a_, b_, size * sizeof(FLOAT)) == 0) return true;
 	break;
       default:
 	break; 
@@ -429,6 +453,24 @@ static bool array_equality(VALUE a, VALUE b) {
 
 static bool struct_eq(VALUE a, VALUE b) {
 
+  if (type_of(a) == VAL_TYPE_I && type_of(b) == VAL_TYPE_I) {
+    return (dec_i(a) == dec_i(b));
+  }
+
+  // Boxed numbers are not pointers when unboxed with -D_VALUE64
+  if (type_of(a) == type_of(b)) {
+    switch (type_of(a)) {
+    case PTR_TYPE_BOXED_I:
+      return (dec_I(a) == dec_I(b));
+    case PTR_TYPE_BOXED_U:
+      return (dec_U(a) == dec_U(b));
+    case PTR_TYPE_BOXED_F:
+      return (dec_f(a) == dec_f(b));
+    default:
+      break;
+    }
+  }
+
   if (!is_ptr(a) && !is_ptr(b)) {
     if (val_type(a) == val_type(b)){
       switch (val_type(a)) {
@@ -457,12 +499,6 @@ static bool struct_eq(VALUE a, VALUE b) {
       case PTR_TYPE_CONS:
 	return ( struct_eq(car(a),car(b)) &&
 		 struct_eq(cdr(a),cdr(b)) );
-      case PTR_TYPE_BOXED_I:
-	return ((INT)car(a) == (INT)car(b));
-      case PTR_TYPE_BOXED_U:
-	return (car(a) == car(b));
-      case PTR_TYPE_BOXED_F:
-	return ((FLOAT)car(a) == (FLOAT)car(b));
       case PTR_TYPE_ARRAY:
 	return array_equality(a, b);
       default:
@@ -490,9 +526,9 @@ static int cmpf(FLOAT a, FLOAT b, bool swapped) {
 
 
 /* returns -1 if a < b; 0 if a = b; 1 if a > b */
-static int compare(UINT a, UINT b) {
+static int compare(VALUE a, VALUE b) {
   int retval = 1;
-  UINT tmp;
+  VALUE tmp;
   INT i0;
   INT i1;
   UINT u0;
@@ -501,6 +537,13 @@ static int compare(UINT a, UINT b) {
   FLOAT f1;
   bool swapped = false;
 
+  if (type_of(a) == VAL_TYPE_I && type_of(b) == VAL_TYPE_I) {
+    return cmpi(dec_i(a), dec_i(b), false);
+  }
+  if (type_of(a) == VAL_TYPE_U && type_of(b) == VAL_TYPE_U) {
+    return cmpu(dec_u(a), dec_u(b), false);
+  }
+
   if (type_of(a) < type_of(b)) {
     tmp = a;
     a   = b;
@@ -541,7 +584,7 @@ static int compare(UINT a, UINT b) {
 }
 
 
-void array_read(VALUE *args, UINT nargs, UINT *result) {
+void array_read(VALUE *args, UINT nargs, VALUE *result) {
   (void) nargs;
   // Args are: array, index
   VALUE arr = args[0];
@@ -581,37 +624,33 @@ void array_read(VALUE *args, UINT nargs, UINT *result) {
   }
 
   if (type_of(arr) == PTR_TYPE_ARRAY) {
-    array_header_t *array = (array_header_t*)car(arr);
+    uint32_t size = array_size(arr);
+    TYPE elt_type = array_elt_type(arr);
+    void *array = array_data(arr);
 
-    if (ix >= array->size){
+    if (ix >= size){
       *result = enc_sym(symrepr_nil());
       return;
     }
 
-    switch(array->elt_type) {
+    switch(elt_type) {
     case VAL_TYPE_CHAR:
-      *result = enc_char((UINT) ((char*)array+8)[ix]);
+      *result = enc_char((UINT) ((char*)array)[ix]);
       break;
     case VAL_TYPE_U:
-      *result = enc_u(((UINT*)array + 2)[ix]);
+      *result = enc_u(((UINT*)array)[ix]);
       break;
     case VAL_TYPE_I:
-      *result = enc_i(((INT*)array + 2)[ix]);
+      *result = enc_i(((INT*)array)[ix]);
       break;
     case PTR_TYPE_BOXED_U:
-      *result = cons(((UINT*)array + 2)[ix], enc_sym(DEF_REPR_BOXED_U_TYPE));
-      if (type_of(*result) == VAL_TYPE_SYMBOL) return;
-      *result = set_ptr_type(*result, PTR_TYPE_BOXED_U);
+      *result = enc_U(((UINT*)array)[ix]);
       break;
     case PTR_TYPE_BOXED_I:
-      *result = cons(((INT*)array + 2)[ix], enc_sym(DEF_REPR_BOXED_I_TYPE));
-      if (type_of(*result) == VAL_TYPE_SYMBOL) return;
-      *result = set_ptr_type(*result, PTR_TYPE_BOXED_I);
+      *result = enc_I(((INT*)array)[ix]);
       break;
     case PTR_TYPE_BOXED_F:
-      *result = cons(((UINT*)array+2)[ix], enc_sym(DEF_REPR_BOXED_F_TYPE));
-      if (type_of(*result) == VAL_TYPE_SYMBOL) return;
-      *result = set_ptr_type(*result, PTR_TYPE_BOXED_F);
+      *result = enc_F(((FLOAT*)array)[ix]);
       break;
     default:
       *result = enc_sym(symrepr_eerror());
@@ -622,7 +661,7 @@ void array_read(VALUE *args, UINT nargs, UINT *result) {
   *result = enc_sym(symrepr_eerror());
 }
 
-void array_write(VALUE *args, UINT nargs, UINT *result) {
+void array_write(VALUE *args, UINT nargs, VALUE *result) {
   (void) nargs;
   VALUE arr = args[0];
   VALUE index = args[1];
@@ -642,10 +681,10 @@ void array_write(VALUE *args, UINT nargs, UINT *result) {
     ix = (UINT) tmp;
     break;
   case PTR_TYPE_BOXED_U:
-    ix = car(index);
+    ix = dec_U(index);
     break;
   case PTR_TYPE_BOXED_I:
-    tmp = (INT)car(index);
+    tmp = dec_I(index);
     if (tmp < 0) {
       *result = enc_sym(symrepr_eerror());
       return;
@@ -658,45 +697,50 @@ void array_write(VALUE *args, UINT nargs, UINT *result) {
   }
 
   if (type_of(arr) == PTR_TYPE_ARRAY) {
-    array_header_t *array = (array_header_t*)car(arr);
+    // Interned strings are shared constants
+    if (array_is_interned(arr)) {
+      *result = enc_sym(symrepr_eerror());
+      return;
+    }
+    uint32_t size = array_size(arr);
+    TYPE elt_type = array_elt_type(arr);
+    void *array = array_data(arr);
 
-    if (type_of(val) != array->elt_type ||
-	ix >= array->size) {
+    if (type_of(val) != elt_type ||
+	ix >= size) {
       *result =  enc_sym(symrepr_nil());
       return;
     }
 
-    switch(array->elt_type) {
+    switch(elt_type) {
     case VAL_TYPE_CHAR: { 
-      char * data = (char *)array + 8;
+      char * data = (char *)array;
       data[ix] = dec_char(val);
       break;
     }
     case VAL_TYPE_U: {
-      UINT* data = (UINT*)array + 2;
+      UINT* data = (UINT*)array;
       data[ix] = dec_u(val);
       break;
     }
     case VAL_TYPE_I: {
-      INT *data = (INT*)array + 2;
+      INT *data = (INT*)array;
       data[ix] = dec_i(val);
       break;
     }
     case PTR_TYPE_BOXED_U: {
-      UINT *data = (UINT*)array + 2;
+      UINT *data = (UINT*)array;
       data[ix] = dec_U(val);
       break;
     }
     case PTR_TYPE_BOXED_I: {
-      INT *data = (INT*)array + 2;
+      INT *data = (INT*)array;
       data[ix] = dec_I(val);
       break;
     }
     case PTR_TYPE_BOXED_F: {
-      //uv = car(val);
-      //memcpy(&v, &uv, sizeof(FLOAT));
-      UINT *data = (UINT*)array + 2;
-      data[ix] = car(val);
+      FLOAT *data = (FLOAT*)array;
+      data[ix] = dec_f(val);
       break;
     }
     default:
@@ -710,7 +754,7 @@ void array_write(VALUE *args, UINT nargs, UINT *result) {
 }
 
 
-void array_create(VALUE *args, UINT nargs, UINT *result) {
+void array_create(VALUE *args, UINT nargs, VALUE *result) {
   (void) args;
   (void) nargs;
   (void) result;
@@ -729,295 +773,330 @@ VALUE index_list(VALUE l, int n) {
   return car(curr);
 }
 
-VALUE fundamental_exec(VALUE* args, UINT nargs, VALUE op) {
+static VALUE fundamental_is_fundamental(VALUE *args, UINT nargs) {
+  if (nargs < 1 ||
+      type_of(args[0]) != VAL_TYPE_SYMBOL)
+    return enc_sym(symrepr_nil());
+  else if (is_fundamental(args[0]))
+    return enc_sym(symrepr_true());
+  else
+    return enc_sym(symrepr_nil());
+}
 
-  UINT result = enc_sym(symrepr_eerror());
-  int cmp_res = -1;
-
-  switch (dec_sym(op)) {
-  case SYM_IS_FUNDAMENTAL:
-    if (nargs < 1 ||
-	type_of(args[0]) != VAL_TYPE_SYMBOL)
-      result = enc_sym(symrepr_nil());
-    else if (is_fundamental(args[0]))
-      result = enc_sym(symrepr_true());
-    else
-      result = enc_sym(symrepr_nil());
-    break;
-	
-  case SYM_SYMBOL_TO_STRING: {
-    if (nargs < 1 ||
-	type_of(args[0]) != VAL_TYPE_SYMBOL)
-      return enc_sym(symrepr_nil());
-    VALUE sym = args[0];
-    const char *sym_str = symrepr_lookup_name(dec_sym(sym));
-    if (sym_str == NULL) return enc_sym(symrepr_nil());
-    size_t len = strlen(sym_str);
-
-    VALUE v;
-    if (heap_allocate_array(&v, len+1, VAL_TYPE_CHAR)) {
-      array_header_t *arr = (array_header_t*)car(v);
-      if (!arr) return enc_sym(symrepr_merror());
-      char *data = (char *)arr+8;
-      memset(data,0,len+1);
-      memcpy(data,sym_str,len);
-    } else {
-      return enc_sym(symrepr_merror());
-    }
-    result = v;
-    break;
-  }
-  case SYM_STRING_TO_SYMBOL: {
-    result = enc_sym(symrepr_eerror());
-    if (nargs < 1 ||
-	type_of(args[0] != PTR_TYPE_ARRAY))
-      break;
-    array_header_t *arr = (array_header_t *)car(args[0]);
-    if (arr->elt_type != VAL_TYPE_CHAR)
-      break;
-    char *str = (char *)arr+8;
-    UINT sym;
-    if (symrepr_lookup(str, &sym)) {
-      result = enc_sym(sym);
-    } else if (symrepr_addsym(str, &sym)) {
-      result = enc_sym(sym);
-    } 
-    break;
-  }
-  case SYM_SYMBOL_TO_UINT: {
-    VALUE s = args[0];
-    if (type_of(s) == VAL_TYPE_SYMBOL)
-      result = enc_u(dec_sym(s));
-    else
-      result = enc_sym(symrepr_eerror());
-    break;
-  }
-  case SYM_UINT_TO_SYMBOL: {
-    VALUE s = args[0];
-    if (type_of(s) == VAL_TYPE_U)
-      result = enc_sym(dec_u(s));
-    else
-      result = enc_sym(symrepr_eerror());
-    break;
-  }
-  //  Create a symbol indirection from an unsigned 
-  case SYM_MK_SYMBOL_INDIRECT: {
-    VALUE s = args[0];
-    if (type_of(s) == VAL_TYPE_U &&
-	dec_u(s) < 33554432)
-      result = enc_symbol_indirection(dec_u(s));
-    else
-      result = enc_sym(symrepr_eerror());
-    break;
-  }
-  case SYM_CONS: {
-    UINT a = args[0];
-    UINT b = args[1];
-    result = cons(a,b);
-    break;
-  }
-  case SYM_CAR: {
-    result = car(args[0]);
-    break;
-  }
-  case SYM_CDR: {
-    result = cdr(args[0]);
-    break;
+static VALUE fundamental_symbol_to_string(VALUE *args, UINT nargs) {
+  if (nargs < 1 ||
+      type_of(args[0]) != VAL_TYPE_SYMBOL)
+    return enc_sym(symrepr_nil());
+  VALUE sym = args[0];
+  const char *sym_str = symrepr_lookup_name(dec_sym(sym));
+  if (sym_str == NULL) return enc_sym(symrepr_nil());
+  size_t len = strlen(sym_str);
+
+  VALUE v;
+  if (heap_allocate_array(&v, len+1, VAL_TYPE_CHAR)) {
+    char *data = array_data(v);
+    memset(data,0,len+1);
+    memcpy(data,sym_str,len);
+  } else {
+    return enc_sym(symrepr_merror());
   }
-  case SYM_LIST: {
-    result = enc_sym(symrepr_nil());
-    for (UINT i = 1; i <= nargs; i ++) {
-      result = cons(args[nargs-i], result);
-      if (type_of(result) == VAL_TYPE_SYMBOL)
-	break;
-    }
-    break;
+  return v;
+}
+
+static VALUE fundamental_string_to_symbol(VALUE *args, UINT nargs) {
+  VALUE result = enc_sym(symrepr_eerror());
+  if (nargs < 1 ||
+      type_of(args[0] != PTR_TYPE_ARRAY))
+    return result;
+  if (array_elt_type(args[0]) != VAL_TYPE_CHAR)
+    return result;
+  char *str = array_data(args[0]);
+  UINT sym;
+  if (symrepr_lookup(str, &sym)) {
+    result = enc_sym(sym);
+  } else if (symrepr_addsym(str, &sym)) {
+    result = enc_sym(sym);
   }
-  case SYM_APPEND: {
-    if (nargs != 2) break;
+  return result;
+}
 
-    VALUE a = args[0];
-    VALUE b = args[1];
+static VALUE fundamental_symbol_to_uint(VALUE *args, UINT nargs) {
+  (void) nargs;
+  VALUE s = args[0];
+  if (type_of(s) == VAL_TYPE_SYMBOL)
+    return enc_u(dec_sym(s));
+  return enc_sym(symrepr_eerror());
+}
 
-    result = b;
-    VALUE curr = a;
-    int n = 0;
-    while (type_of(curr) == PTR_TYPE_CONS) {
-      n++;
-      curr = cdr(curr);
-    }
+static VALUE fundamental_uint_to_symbol(VALUE *args, UINT nargs) {
+  (void) nargs;
+  VALUE s = args[0];
+  if (type_of(s) == VAL_TYPE_U)
+    return enc_sym(dec_u(s));
+  return enc_sym(symrepr_eerror());
+}
 
-    for (int i = n-1; i >= 0; i --) {
-      result = cons(index_list(a,i), result);
-      if (type_of(result) == VAL_TYPE_SYMBOL)
-	break;
-    }
-    break;
+//  Create a symbol indirection from an unsigned
+static VALUE fundamental_mk_symbol_indirect(VALUE *args, UINT nargs) {
+  (void) nargs;
+  VALUE s = args[0];
+  if (type_of(s) == VAL_TYPE_U &&
+      dec_u(s) <= (SYM_IND_MASK >> SYM_IND_SHIFT))
+    return enc_symbol_indirection(dec_u(s));
+  return enc_sym(symrepr_eerror());
+}
+
+static VALUE fundamental_cons(VALUE *args, UINT nargs) {
+  (void) nargs;
+  return cons(args[0], args[1]);
+}
+
+static VALUE fundamental_car(VALUE *args, UINT nargs) {
+  (void) nargs;
+  return car(args[0]);
+}
+
+static VALUE fundamental_cdr(VALUE *args, UINT nargs) {
+  (void) nargs;
+  return cdr(args[0]);
+}
+
+static VALUE fundamental_list(VALUE *args, UINT nargs) {
+  VALUE result = enc_sym(symrepr_nil());
+  for (UINT i = 1; i <= nargs; i ++) {
+    result = cons(args[nargs-i], result);
+    if (type_of(result) == VAL_TYPE_SYMBOL)
+      break;
   }
-  case SYM_ADD: {
-    UINT sum = args[0];
-    for (UINT i = 1; i < nargs; i ++) {
-      sum = add2(sum, args[i]);
-      if (type_of(sum) == VAL_TYPE_SYMBOL) {
-	break;
-      }
-    }
-    result = sum;
-    break;
+  return result;
+}
+
+static VALUE fundamental_append(VALUE *args, UINT nargs) {
+  if (nargs != 2) return enc_sym(symrepr_eerror());
+
+  VALUE a = args[0];
+  VALUE b = args[1];
+
+  VALUE result = b;
+  VALUE curr = a;
+  int n = 0;
+  while (type_of(curr) == PTR_TYPE_CONS) {
+    n++;
+    curr = cdr(curr);
   }
-  case SYM_SUB: {
-    UINT res = args[0];
 
-    if (nargs == 1) {
-      res = negate(res);
-    } else {
-      for (UINT i = 1; i < nargs; i ++) {
-	res = sub2(res, args[i]);
-	if (type_of(res) == VAL_TYPE_SYMBOL)
-	  break;
-      }
-    }
-    result = res;
-    break;
+  for (int i = n-1; i >= 0; i --) {
+    result = cons(index_list(a,i), result);
+    if (type_of(result) == VAL_TYPE_SYMBOL)
+      break;
   }
-  case SYM_MUL: {
-    UINT prod = args[0];
-    for (UINT i = 1; i < nargs; i ++) {
-      prod = mul2(prod, args[i]);
-      if (type_of(prod) == VAL_TYPE_SYMBOL) {
-	break;
-      }
+  return result;
+}
+
+static VALUE fundamental_add(VALUE *args, UINT nargs) {
+  VALUE sum = args[0];
+  for (UINT i = 1; i < nargs; i ++) {
+    sum = add2(sum, args[i]);
+    if (type_of(sum) == VAL_TYPE_SYMBOL) {
+      break;
     }
-    result = prod;
-    break;
   }
-  case SYM_DIV:  {
-    UINT res = args[0];
-    for (UINT i = 1; i < nargs; i ++) {
-      res = div2(res, args[i]);
-      if (type_of(res) == VAL_TYPE_SYMBOL) {
-	break;
-      }
-    }
-    result = res;
-    break;
+  return sum;
+}
+
+static VALUE fundamental_sub(VALUE *args, UINT nargs) {
+  VALUE res = args[0];
+
+  if (nargs == 1) {
+    return negate(res);
   }
-  case SYM_MOD: {
-    UINT res = args[0];
-    for (UINT i = 1; i < nargs; i ++) {
-      res = mod2(res, args[i]);
-      if (type_of(res) == VAL_TYPE_SYMBOL) {
-	break;
-      }
-    }
-    result = res;
-    break;
+  for (UINT i = 1; i < nargs; i ++) {
+    res = sub2(res, args[i]);
+    if (type_of(res) == VAL_TYPE_SYMBOL)
+      break;
   }
-  case SYM_EQ: {
-    UINT a = args[0];
-    UINT b;
-    bool r = true;
+  return res;
+}
 
-    for (UINT i = 1; i < nargs; i ++) {
-      b = args[i];
-      r = r && struct_eq(a, b);
-    }
-    if (r) {
-      result = enc_sym(symrepr_true());
-    } else {
-      result = enc_sym(symrepr_nil());
-    }
-    break;
-  }
-  case SYM_NUMEQ:
-    cmp_res = 0;
-    /* fall through */
-  case SYM_GT:
-    if (dec_sym(op) == SYM_GT) cmp_res = 1;
-    /* fall through */
-  case SYM_LT: {
-    UINT a = args[0];
-    UINT b;
-    bool r = true;
-    bool ok = true;
-
-    if (!is_number(a)) {
-      result = enc_sym(symrepr_terror());
+static VALUE fundamental_mul(VALUE *args, UINT nargs) {
+  VALUE prod = args[0];
+  for (UINT i = 1; i < nargs; i ++) {
+    prod = mul2(prod, args[i]);
+    if (type_of(prod) == VAL_TYPE_SYMBOL) {
       break;
     }
-    for (UINT i = 1; i < nargs; i ++) {
-      b = args[i];
-      if (!is_number(b)) {
-	ok = false;
-	break;
-      }
-      r = r && (compare(a, b) == cmp_res);
-    }
-    if (ok) {
-      if (r) {
-	result = enc_sym(symrepr_true());
-      } else {
-	result = enc_sym(symrepr_nil());
-      }
-    } else {
-      result = enc_sym(symrepr_terror());
-    }
-    break;
   }
-  case SYM_NOT: {
-    if (nargs == 0) {
-      return enc_sym(symrepr_nil());
+  return prod;
+}
+
+static VALUE fundamental_div(VALUE *args, UINT nargs) {
+  VALUE res = args[0];
+  for (UINT i = 1; i < nargs; i ++) {
+    res = div2(res, args[i]);
+    if (type_of(res) == VAL_TYPE_SYMBOL) {
       break;
     }
-    UINT a = args[0];
-    if (type_of(a) == VAL_TYPE_SYMBOL &&
-	dec_sym(a) == symrepr_nil()) {
-      result = enc_sym(symrepr_true());
+  }
+  return res;
+}
+
+static VALUE fundamental_mod(VALUE *args, UINT nargs) {
+  VALUE res = args[0];
+  for (UINT i = 1; i < nargs; i ++) {
+    res = mod2(res, args[i]);
+    if (type_of(res) == VAL_TYPE_SYMBOL) {
       break;
     }
-    result = enc_sym(symrepr_nil());
-    break;
   }
-  case SYM_ARRAY_READ:
-    array_read(args, nargs, &result);
-    break;
-  case SYM_ARRAY_WRITE:
-    array_write(args, nargs, &result);
-    break;
-  case SYM_ARRAY_CREATE:
-    array_create(args, nargs, &result);
-    break;
+  return res;
+}
 
-  case SYM_TYPE_OF:
-    if (nargs != 1) return enc_sym(symrepr_nil());
-    VALUE val = args[0];
-    switch(type_of(val)) {
-    case PTR_TYPE_CONS:
-      return enc_sym(symrepr_type_list());
-    case PTR_TYPE_ARRAY:
-      return enc_sym(symrepr_type_array());
-    case PTR_TYPE_BOXED_I:
-      return enc_sym(symrepr_type_i32());
-    case PTR_TYPE_BOXED_U:
-      return enc_sym(symrepr_type_u32());
-    case PTR_TYPE_BOXED_F:
-      return enc_sym(symrepr_type_float());
-    case VAL_TYPE_I:
-      return enc_sym(symrepr_type_i28());
-    case VAL_TYPE_U:
-      return enc_sym(symrepr_type_u28());
-    case VAL_TYPE_CHAR:
-      return enc_sym(symrepr_type_char());
-    case VAL_TYPE_SYMBOL:
-      return enc_sym(symrepr_type_symbol());
-    default:
+static VALUE fundamental_eq(VALUE *args, UINT nargs) {
+  VALUE a = args[0];
+  bool r = true;
+
+  for (UINT i = 1; i < nargs; i ++) {
+    r = r && struct_eq(a, args[i]);
+  }
+  if (r) {
+    return enc_sym(symrepr_true());
+  }
+  return enc_sym(symrepr_nil());
+}
+
+/* Compares args[0] to each of the other arguments and returns t if
+   compare gives cmp_res for all of them */
+static VALUE compare_all(VALUE *args, UINT nargs, int cmp_res) {
+  VALUE a = args[0];
+  bool r = true;
+
+  if (!is_number(a)) {
+    return enc_sym(symrepr_terror());
+  }
+  for (UINT i = 1; i < nargs; i ++) {
+    VALUE b = args[i];
+    if (!is_number(b)) {
       return enc_sym(symrepr_terror());
     }
-    break;
-  default:
-    result = enc_sym(symrepr_eerror());
-    break;
+    r = r && (compare(a, b) == cmp_res);
+  }
+  if (r) {
+    return enc_sym(symrepr_true());
   }
+  return enc_sym(symrepr_nil());
+}
+
+static VALUE fundamental_numeq(VALUE *args, UINT nargs) {
+  return compare_all(args, nargs, 0);
+}
+
+static VALUE fundamental_gt(VALUE *args, UINT nargs) {
+  return compare_all(args, nargs, 1);
+}
+
+static VALUE fundamental_lt(VALUE *args, UINT nargs) {
+  return compare_all(args, nargs, -1);
+}
 
+static VALUE fundamental_not(VALUE *args, UINT nargs) {
+  if (nargs == 0) {
+    return enc_sym(symrepr_nil());
+  }
+  VALUE a = args[0];
+  if (type_of(a) == VAL_TYPE_SYMBOL &&
+      dec_sym(a) == symrepr_nil()) {
+    return enc_sym(symrepr_true());
+  }
+  return enc_sym(symrepr_nil());
+}
+
+static VALUE fundamental_array_read(VALUE *args, UINT nargs) {
+  VALUE result;
+  array_read(args, nargs, &result);
+  return result;
+}
+
+static VALUE fundamental_array_write(VALUE *args, UINT nargs) {
+  VALUE result;
+  array_write(args, nargs, &result);
+  return result;
+}
+
+static VALUE fundamental_array_create(VALUE *args, UINT nargs) {
+  VALUE result = enc_sym(symrepr_eerror());
+  array_create(args, nargs, &result);
   return result;
 }
+
+static VALUE fundamental_type_of(VALUE *args, UINT nargs) {
+  if (nargs != 1) return enc_sym(symrepr_nil());
+  VALUE val = args[0];
+  switch(type_of(val)) {
+  case PTR_TYPE_CONS:
+    return enc_sym(symrepr_type_list());
+  case PTR_TYPE_ARRAY:
+    return enc_sym(symrepr_type_array());
+  case PTR_TYPE_BOXED_I:
+    return enc_sym(symrepr_type_i32());
+  case PTR_TYPE_BOXED_U:
+    return enc_sym(symrepr_type_u32());
+  case PTR_TYPE_BOXED_F:
+    return enc_sym(symrepr_type_float());
+  case VAL_TYPE_I:
+    return enc_sym(symrepr_type_i28());
+  case VAL_TYPE_U:
+    return enc_sym(symrepr_type_u28());
+  case VAL_TYPE_CHAR:
+    return enc_sym(symrepr_type_char());
+  case VAL_TYPE_SYMBOL:
+    return enc_sym(symrepr_type_symbol());
+  default:
+    return enc_sym(symrepr_terror());
+  }
+}
+
+typedef VALUE (*fundamental_fun)(VALUE *, UINT);
+
+#define FUNDAMENTAL(sym) [(sym) - FUNDAMENTALS_START]
+
+/* Indexed by symbol id - FUNDAMENTALS_START. Fundamentals that the
+   evaluator handles itself (eval, and, or, yield, ...) and the unused
+   ids in between are NULL */
+static const fundamental_fun fundamentals[FUNDAMENTALS_END - FUNDAMENTALS_START + 1] = {
+  FUNDAMENTAL(SYM_ADD)                = fundamental_add,
+  FUNDAMENTAL(SYM_SUB)                = fundamental_sub,
+  FUNDAMENTAL(SYM_MUL)                = fundamental_mul,
+  FUNDAMENTAL(SYM_DIV)                = fundamental_div,
+  FUNDAMENTAL(SYM_MOD)                = fundamental_mod,
+  FUNDAMENTAL(SYM_EQ)                 = fundamental_eq,
+  FUNDAMENTAL(SYM_NUMEQ)              = fundamental_numeq,
+  FUNDAMENTAL(SYM_LT)                 = fundamental_lt,
+  FUNDAMENTAL(SYM_GT)                 = fundamental_gt,
+  FUNDAMENTAL(SYM_NOT)                = fundamental_not,
+  FUNDAMENTAL(SYM_CONS)               = fundamental_cons,
+  FUNDAMENTAL(SYM_CAR)                = fundamental_car,
+  FUNDAMENTAL(SYM_CDR)                = fundamental_cdr,
+  FUNDAMENTAL(SYM_LIST)               = fundamental_list,
+  FUNDAMENTAL(SYM_APPEND)             = fundamental_append,
+  FUNDAMENTAL(SYM_ARRAY_READ)         = fundamental_array_read,
+  FUNDAMENTAL(SYM_ARRAY_WRITE)        = fundamental_array_write,
+  FUNDAMENTAL(SYM_ARRAY_CREATE)       = fundamental_array_create,
+  FUNDAMENTAL(SYM_SYMBOL_TO_STRING)   = fundamental_symbol_to_string,
+  FUNDAMENTAL(SYM_STRING_TO_SYMBOL)   = fundamental_string_to_symbol,
+  FUNDAMENTAL(SYM_SYMBOL_TO_UINT)     = fundamental_symbol_to_uint,
+  FUNDAMENTAL(SYM_UINT_TO_SYMBOL)     = fundamental_uint_to_symbol,
+  FUNDAMENTAL(SYM_MK_SYMBOL_INDIRECT) = fundamental_mk_symbol_indirect,
+  FUNDAMENTAL(SYM_IS_FUNDAMENTAL)     = fundamental_is_fundamental,
+  FUNDAMENTAL(SYM_TYPE_OF)            = fundamental_type_of,
+};
+
+VALUE fundamental_exec(VALUE* args, UINT nargs, VALUE op) {
+
+  UINT sym = dec_sym(op);
+
+  if (sym < FUNDAMENTALS_START || sym > FUNDAMENTALS_END ||
+      fundamentals[sym - FUNDAMENTALS_START] == NULL) {
+    return enc_sym(symrepr_eerror());
+  }
+  return fundamentals[sym - FUNDAMENTALS_START](args, nargs);
+}
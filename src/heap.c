@@ -33,7 +33,45 @@ static heap_state_t heap_state;
 static VALUE        NIL;
 static VALUE        RECOVERED;
 
-// ref_cell: returns a reference to the cell addressed by bits 3 - 26
+#define GC_STACK_SIZE          1024
+#define GC_DEFAULT_STEP_BUDGET 64
+#define GC_INCREMENTAL_START   4   // Start when less than 1/4 of the heap is free
+#define GC_NURSERY_FRACTION    8   // Nursery is 1/8 of the heap
+#define GC_MIN_NURSERY_SIZE    64
+
+// Incremental collection, see gc_incremental_step
+#define GC_IDLE      0
+#define GC_MARKING   1
+#define GC_SWEEPING  2
+
+static int          gc_phase = GC_IDLE;
+static stack        gc_grey;              // Cells to mark, kept between steps
+static VALUE        gc_freelist_cursor;   // Next free cell to mark
+static unsigned int gc_rescan_pos;        // Next cell to rescan after mark stack overflow
+static unsigned int gc_pause_work;        // Cells swept by the collection in progress
+
+// Generational collection, see gc_remember
+static uint32_t    *gc_young;             // Cells allocated since the last collection
+static unsigned int gc_num_young;
+static uint32_t    *gc_remembered;        // Old cells that point to young cells
+static uint32_t    *gc_remembered_bits;   // One bit per cell, set if remembered
+static unsigned int gc_num_remembered;
+static unsigned int gc_remembered_size;
+static bool         gc_remembered_overflow;
+static bool         gc_minor;             // The collection in progress is minor
+
+// String interning, see heap_intern_string
+#define INTERN_MIN_CAPACITY    64
+
+typedef struct {
+  VALUE    arr;                           // 0 if the slot is empty
+  uint32_t hash;
+} intern_entry_t;
+
+static intern_entry_t *intern_table;
+static unsigned int    intern_capacity;   // A power of two
+
+// ref_cell: returns a reference to the cell addressed by the pointer
 //           Assumes user has checked that is_ptr was set
 cons_t* ref_cell(VALUE addr) {
   return &heap_state.heap[dec_ptr(addr)];
@@ -56,21 +94,46 @@ static void set_cdr_(cons_t *cell, VALUE v) {
   cell->cdr = v;
 }
 
+/* GC mark bits are kept either in bit 1 of the cdr of each cell or,
+   if the heap is initialized with HEAP_GC_MARK_BITMAP, in a bitmap
+   with one bit per cell. */
+static inline unsigned int cell_ix(cons_t *cell) {
+  return (unsigned int)(cell - heap_state.heap);
+}
+
 static void set_gc_mark(cons_t *cell) {
+  if (heap_state.gc_bitmap) {
+    unsigned int ix = cell_ix(cell);
+    heap_state.gc_bitmap[ix >> 5] |= (1u << (ix & 0x1F));
+    return;
+  }
   VALUE cdr = read_cdr(cell);
   set_cdr_(cell, val_set_gc_mark(cdr));
 }
 
 static void clr_gc_mark(cons_t *cell) {
+  if (heap_state.gc_bitmap) {
+    unsigned int ix = cell_ix(cell);
+    heap_state.gc_bitmap[ix >> 5] &= ~(1u << (ix & 0x1F));
+    return;
+  }
   VALUE cdr = read_cdr(cell);
   set_cdr_(cell, val_clr_gc_mark(cdr));
 }
 
 static bool get_gc_mark(cons_t* cell) {
+  if (heap_state.gc_bitmap) {
+    unsigned int ix = cell_ix(cell);
+    return (heap_state.gc_bitmap[ix >> 5] >> (ix & 0x1F)) & 1;
+  }
   VALUE cdr = read_cdr(cell);
   return val_get_gc_mark(cdr);
 }
 
+static inline unsigned int gc_bitmap_words(unsigned int num_cells) {
+  return (num_cells + 31) / 32;
+}
+
 int generate_freelist(size_t num_cells) {
   size_t i = 0;
 
@@ -96,9 +159,14 @@ int generate_freelist(size_t num_cells) {
 
 static void heap_init_state(cons_t *addr, unsigned int num_cells, bool malloced) {
   heap_state.heap         = addr;
+  heap_state.gc_bitmap    = NULL;
   heap_state.heap_bytes   = (unsigned int)(num_cells * sizeof(cons_t));
   heap_state.heap_size    = num_cells;
   heap_state.malloced = malloced;
+  heap_state.lazy_sweep   = false;
+  heap_state.incremental  = false;
+  heap_state.generational = false;
+  heap_state.compacting   = false;
 
   heap_state.num_alloc           = 0;
   heap_state.num_alloc_arrays    = 0;
@@ -106,6 +174,57 @@ static void heap_init_state(cons_t *addr, unsigned int num_cells, bool malloced)
   heap_state.gc_marked           = 0;
   heap_state.gc_recovered        = 0;
   heap_state.gc_recovered_arrays = 0;
+  heap_state.gc_mark_rescans     = 0;
+  heap_state.gc_sweep_pos        = num_cells;
+  heap_state.gc_step_budget      = GC_DEFAULT_STEP_BUDGET;
+  heap_state.gc_num_incremental  = 0;
+  heap_state.gc_max_pause        = 0;
+  heap_state.gc_max_step         = 0;
+  heap_state.nursery_size        = 0;
+  heap_state.gc_num_minor        = 0;
+  heap_state.gc_promoted         = 0;
+  heap_state.gc_compact_interval = 1;
+  heap_state.gc_num_compactions  = 0;
+  heap_state.num_array_compactions = 0;
+  heap_state.intern_strings      = false;
+  heap_state.num_interned        = 0;
+  heap_state.num_intern_hits     = 0;
+
+  gc_phase = GC_IDLE;
+  gc_num_young = 0;
+  gc_num_remembered = 0;
+  gc_remembered_overflow = false;
+  gc_minor = false;
+}
+
+static void gc_generational_del(void) {
+  free(gc_young);
+  free(gc_remembered);
+  free(gc_remembered_bits);
+  gc_young = NULL;
+  gc_remembered = NULL;
+  gc_remembered_bits = NULL;
+}
+
+static int gc_generational_init(unsigned int num_cells) {
+
+  unsigned int nursery_size = num_cells / GC_NURSERY_FRACTION;
+  if (nursery_size < GC_MIN_NURSERY_SIZE) nursery_size = GC_MIN_NURSERY_SIZE;
+  unsigned int words = gc_bitmap_words(num_cells);
+
+  heap_state.nursery_size = nursery_size;
+  gc_remembered_size = nursery_size / 4;
+
+  gc_young = (uint32_t *)malloc(nursery_size * sizeof(uint32_t));
+  gc_remembered = (uint32_t *)malloc(gc_remembered_size * sizeof(uint32_t));
+  gc_remembered_bits = (uint32_t *)malloc(words * sizeof(uint32_t));
+
+  if (!gc_young || !gc_remembered || !gc_remembered_bits) {
+    gc_generational_del();
+    return 0;
+  }
+  memset(gc_remembered_bits, 0, words * sizeof(uint32_t));
+  return 1;
 }
 
 int heap_init_addr(cons_t *addr, unsigned int num_cells) {
@@ -113,32 +232,122 @@ int heap_init_addr(cons_t *addr, unsigned int num_cells) {
   NIL = enc_sym(symrepr_nil());
   RECOVERED = enc_sym(DEF_REPR_RECOVERED);
 
+#ifndef _VALUE64 // Any unsigned int is a cell index with -D_VALUE64
+  if (num_cells > HEAP_MAX_CELLS) return 0;
+#endif
+
   heap_init_state(addr, num_cells, false);
 
   return generate_freelist(num_cells);
 }
 
 int heap_init(unsigned int num_cells) {
+  return heap_init_ext(num_cells, 0);
+}
+
+int heap_init_ext(unsigned int num_cells, uint32_t options) {
 
   NIL = enc_sym(symrepr_nil());
   RECOVERED = enc_sym(DEF_REPR_RECOVERED);
 
+  if ((options & HEAP_GENERATIONAL) &&
+      (options & (HEAP_LAZY_SWEEP | HEAP_INCREMENTAL_GC | HEAP_COMPACTING))) {
+    return 0;
+  }
+
+#ifndef _VALUE64 // Any unsigned int is a cell index with -D_VALUE64
+  if (num_cells > HEAP_MAX_CELLS) return 0;
+#endif
+
   cons_t *heap = (cons_t *)malloc(num_cells * sizeof(cons_t));
 
   if (!heap) return 0;
   heap_init_state(heap, num_cells, true);
 
+  if (options & HEAP_COMPACTING) {
+    heap_state.compacting = true;
+  }
+
+  if (options & HEAP_INTERN_STRINGS) {
+    heap_state.intern_strings = true;
+  }
+
+  if (options & HEAP_GENERATIONAL) {
+    heap_state.generational = true;
+    options |= HEAP_GC_MARK_BITMAP;
+  }
+
+  if (options & HEAP_INCREMENTAL_GC) {
+    heap_state.incremental = true;
+    options |= HEAP_LAZY_SWEEP;
+  }
+
+  if (options & HEAP_LAZY_SWEEP) {
+    heap_state.lazy_sweep = true;
+    options |= HEAP_GC_MARK_BITMAP;
+  }
+
+  if (options & HEAP_GC_MARK_BITMAP) {
+    unsigned int words = gc_bitmap_words(num_cells);
+    heap_state.gc_bitmap = (uint32_t *)malloc(words * sizeof(uint32_t));
+    if (!heap_state.gc_bitmap) {
+      free(heap);
+      heap_state.heap = NULL;
+      return 0;
+    }
+    memset(heap_state.gc_bitmap, 0, words * sizeof(uint32_t));
+  }
+
+  if (heap_state.incremental &&
+      !stack_allocate(&gc_grey, GC_STACK_SIZE, false)) {
+    free(heap_state.gc_bitmap);
+    heap_state.gc_bitmap = NULL;
+    free(heap);
+    heap_state.heap = NULL;
+    return 0;
+  }
+
+  if (heap_state.generational && !gc_generational_init(num_cells)) {
+    free(heap_state.gc_bitmap);
+    heap_state.gc_bitmap = NULL;
+    free(heap);
+    heap_state.heap = NULL;
+    return 0;
+  }
+
   return generate_freelist(num_cells);
 }
 
 void heap_del(void) {
   if (heap_state.heap && heap_state.malloced)
     free(heap_state.heap);
+  if (heap_state.gc_bitmap) {
+    free(heap_state.gc_bitmap);
+    heap_state.gc_bitmap = NULL;
+  }
+  if (heap_state.incremental) {
+    stack_free(&gc_grey);
+    gc_grey.data = NULL;
+  }
+  if (heap_state.generational) {
+    gc_generational_del();
+  }
+  free(intern_table);
+  intern_table = NULL;
+  intern_capacity = 0;
 }
 
+static void gc_sweep_finish(void);
+static void gc_sweep_lazy(void);
+static unsigned int gc_num_unswept(void);
+static void intern_remove(cons_t *cell);
+static void gc_remember_cell(unsigned int ix);
+
 unsigned int heap_num_free(void) {
 
-  unsigned int count = 0;
+  // Unswept garbage is free as well
+  unsigned int count = gc_num_unswept();
+
   VALUE curr = heap_state.freelist;
 
   while (type_of(curr) == PTR_TYPE_CONS) {
@@ -158,6 +367,11 @@ VALUE heap_allocate_cell(TYPE ptr_type) {
 
   VALUE res;
 
+  if (!is_ptr(heap_state.freelist) &&
+      heap_state.gc_sweep_pos < heap_state.heap_size) {
+    gc_sweep_lazy();
+  }
+
   if (!is_ptr(heap_state.freelist)) {
     // Free list not a ptr (should be Symbol NIL)
     if ((type_of(heap_state.freelist) == VAL_TYPE_SYMBOL) &&
@@ -179,32 +393,60 @@ VALUE heap_allocate_cell(TYPE ptr_type) {
 
   heap_state.freelist = cdr(heap_state.freelist);
 
+  if (res == gc_freelist_cursor) {
+    gc_freelist_cursor = heap_state.freelist;
+  }
+
   heap_state.num_alloc++;
 
+  // Past a full nursery cells are allocated old, see gc_remember
+  bool old = false;
+  if (heap_state.generational) {
+    if (gc_num_young < heap_state.nursery_size) {
+      gc_young[gc_num_young++] = dec_ptr(res);
+    } else {
+      gc_remember_cell(dec_ptr(res));
+      old = true;
+    }
+  }
+
   // set some ok initial values (nil . nil)
   set_car_(ref_cell(res), NIL);
   set_cdr_(ref_cell(res), NIL);
 
-  // clear GC bit on allocated cell
-  clr_gc_mark(ref_cell(res));
+  // clear GC bit on allocated cell, unless the cell is ahead of
+  // the lazy sweep that would then take it back, or an incremental
+  // collection is marking.
+  if (!old && gc_phase != GC_MARKING &&
+      dec_ptr(res) < heap_state.gc_sweep_pos) {
+    clr_gc_mark(ref_cell(res));
+  } else {
+    set_gc_mark(ref_cell(res));
+  }
 
   res = res | ptr_type;
   return res;
 }
 
 unsigned int heap_num_allocated(void) {
-  return heap_state.num_alloc;
+  // Unswept garbage is counted as free
+  return heap_state.num_alloc - gc_num_unswept();
 }
 unsigned int heap_size(void) {
   return heap_state.heap_size;
 }
 
+unsigned int heap_num_gc(void) {
+  return heap_state.gc_num;
+}
+
 unsigned int heap_size_bytes(void) {
   return heap_state.heap_bytes;
 }
 
 void heap_get_state(heap_state_t *res) {
   res->heap                = heap_state.heap;
+  res->gc_bitmap           = heap_state.gc_bitmap;
   res->malloced            = heap_state.malloced;
   res->freelist            = heap_state.freelist;
   res->heap_size           = heap_state.heap_size;
@@ -215,51 +457,162 @@ void heap_get_state(heap_state_t *res) {
   res->gc_marked           = heap_state.gc_marked;
   res->gc_recovered        = heap_state.gc_recovered;
   res->gc_recovered_arrays = heap_state.gc_recovered_arrays;
+  res->gc_mark_rescans     = heap_state.gc_mark_rescans;
+  res->lazy_sweep          = heap_state.lazy_sweep;
+  res->gc_sweep_pos        = heap_state.gc_sweep_pos;
+  res->incremental         = heap_state.incremental;
+  res->gc_step_budget      = heap_state.gc_step_budget;
+  res->gc_num_incremental  = heap_state.gc_num_incremental;
+  res->gc_max_pause        = heap_state.gc_max_pause;
+  res->gc_max_step         = heap_state.gc_max_step;
+  res->generational        = heap_state.generational;
+  res->nursery_size        = heap_state.nursery_size;
+  res->gc_num_minor        = heap_state.gc_num_minor;
+  res->gc_promoted         = heap_state.gc_promoted;
+  res->compacting          = heap_state.compacting;
+  res->gc_compact_interval = heap_state.gc_compact_interval;
+  res->gc_num_compactions  = heap_state.gc_num_compactions;
+  res->num_array_compactions = heap_state.num_array_compactions;
+  res->intern_strings      = heap_state.intern_strings;
+  res->num_interned        = heap_state.num_interned;
+  res->num_intern_hits     = heap_state.num_intern_hits;
 }
 
-int gc_mark_phase(VALUE env) {
+/* Marking uses a fixed size stack. If the stack overflows, the
+   children that did not fit are left unmarked and the overflow is
+   recorded. Once the stack is empty, the heap is scanned for marked
+   cells with unmarked children, and marking continues from those,
+   until no overflow occurs. This is correct for structures of any
+   depth while using only the fixed stack. */
+
+static bool gc_mark_overflow = false;
+
+/* Arrays are either in the array memory, with the car of the cell
+   pointing to an array_header_t followed by the data, or, for char
+   arrays of up to INLINE_ARRAY_MAX_SIZE bytes, inline in the car of
+   the cell with the size in the type symbol in the cdr. */
+static inline bool is_inline_array_cell(cons_t *cell) {
+  VALUE cdr = val_clr_gc_mark(read_cdr(cell));
+  return (type_of(cdr) == VAL_TYPE_SYMBOL &&
+	  dec_sym(cdr) >= DEF_REPR_INLINE_ARRAY_TYPE &&
+	  dec_sym(cdr) <= DEF_REPR_INLINE_ARRAY_TYPE + INLINE_ARRAY_MAX_SIZE);
+}
 
-  VALUE stack_storage[1024];
-  stack s;
-  stack_create(&s, stack_storage, 1024);
+// Cells of arrays in the array memory
+static inline bool is_array_cell(cons_t *cell) {
+  VALUE cdr = val_clr_gc_mark(read_cdr(cell));
+  return (cdr == enc_sym(DEF_REPR_ARRAY_TYPE) ||
+	  cdr == enc_sym(DEF_REPR_INTERNED_ARRAY_TYPE));
+}
 
-  if (!is_ptr(env)) {
-      return 1; // Nothing to mark here
+// Cells holding boxed values, arrays and bytecode have a type
+// symbol in the cdr and no pointers to follow.
+static inline bool is_leaf_cell(cons_t *cell) {
+  VALUE cdr = val_clr_gc_mark(read_cdr(cell));
+  return (cdr == enc_sym(DEF_REPR_BOXED_I_TYPE) ||
+	  cdr == enc_sym(DEF_REPR_BOXED_U_TYPE) ||
+	  cdr == enc_sym(DEF_REPR_BOXED_F_TYPE) ||
+	  cdr == enc_sym(DEF_REPR_BYTECODE_TYPE) ||
+	  is_array_cell(cell) ||
+	  is_inline_array_cell(cell));
+}
+
+static inline bool needs_mark(VALUE v) {
+  return (is_ptr(v) &&
+	  dec_ptr(v) < heap_state.heap_size &&
+	  !get_gc_mark(ref_cell(v)));
+}
+
+static void gc_push_children(stack *s, cons_t *cell) {
+  VALUE cdr = val_clr_gc_mark(read_cdr(cell));
+  VALUE car = read_car(cell);
+
+  if (needs_mark(cdr) && !push_u32(s, cdr)) gc_mark_overflow = true;
+  if (needs_mark(car) && !push_u32(s, car)) gc_mark_overflow = true;
+}
+
+static void gc_mark_cell(stack *s, VALUE curr) {
+
+  cons_t *cell = ref_cell(curr);
+
+  // Circular object on heap, or visited..
+  if (get_gc_mark(cell)) {
+    return;
   }
 
-  push_u32(&s, env);
+  // There is at least a pointer to one cell here. Mark it and add children to stack
+  heap_state.gc_marked ++;
+
+  set_gc_mark(cell);
+
+  VALUE t_ptr = type_of(curr);
 
-  while (!stack_is_empty(&s)) {
+  if (t_ptr == PTR_TYPE_BOXED_I ||
+      t_ptr == PTR_TYPE_BOXED_U ||
+      t_ptr == PTR_TYPE_BOXED_F ||
+      t_ptr == PTR_TYPE_ARRAY ||
+      t_ptr == PTR_TYPE_BYTECODE) {
+    return;
+  }
+  gc_push_children(s, cell);
+}
+
+static void gc_mark_stack(stack *s) {
+
+  while (!stack_is_empty(s)) {
     VALUE curr;
-    int res = 1;
-    pop_u32(&s, &curr);
+    pop_u32(s, &curr);
+    gc_mark_cell(s, curr);
+  }
+}
 
-    if (!is_ptr(curr)) {
-      continue;
-    }
+/* Incremental collection marks a snapshot of the heap taken when the
+   collection begins. The roots are marked at the beginning, cells
+   allocated while marking are marked right away, and set_car and
+   set_cdr (and so env_set and env_modify_binding) mark the value they
+   overwrite. Everything reachable at the beginning is then marked
+   even if the evaluator rearranges the heap in between steps. */
+void gc_write_barrier(VALUE v) {
+  if (gc_phase == GC_MARKING && needs_mark(v)) {
+    gc_mark_cell(&gc_grey, v);
+  }
+}
 
-    // Circular object on heap, or visited..
-    if (get_gc_mark(ref_cell(curr))) {
-      continue;
-    }
+void heap_set_gc_step_budget(unsigned int cells) {
+  heap_state.gc_step_budget = cells ? cells : 1;
+}
 
-    // There is at least a pointer to one cell here. Mark it and add children to stack
-    heap_state.gc_marked ++;
+int gc_mark_phase(VALUE env) {
 
-    set_gc_mark(ref_cell(curr));
+  // Roots of an incremental collection are marked one level deep
+  // and the rest is left to gc_incremental_step.
+  if (gc_phase == GC_MARKING) {
+    gc_write_barrier(env);
+    return 1;
+  }
 
-    VALUE t_ptr = type_of(curr);
+  VALUE stack_storage[GC_STACK_SIZE];
+  stack s;
+  stack_create(&s, stack_storage, GC_STACK_SIZE);
 
-    if (t_ptr == PTR_TYPE_BOXED_I ||
-	t_ptr == PTR_TYPE_BOXED_U ||
-	t_ptr == PTR_TYPE_BOXED_F ||
-	t_ptr == PTR_TYPE_ARRAY) {
-      continue;
-    }
-    res &= push_u32(&s, cdr(curr));
-    res &= push_u32(&s, car(curr));
+  if (!needs_mark(env)) {
+    return 1; // Nothing to mark here
+  }
+
+  push_u32(&s, env);
+  gc_mark_stack(&s);
 
-    if (!res) return 0;
+  while (gc_mark_overflow) {
+    gc_mark_overflow = false;
+    heap_state.gc_mark_rescans ++;
+
+    for (unsigned int i = 0; i < heap_state.heap_size; i ++) {
+      cons_t *cell = &heap_state.heap[i];
+      if (get_gc_mark(cell) && !is_leaf_cell(cell)) {
+	gc_push_children(&s, cell);
+	gc_mark_stack(&s);
+      }
+    }
   }
 
   return 1;
@@ -269,6 +622,9 @@ int gc_mark_phase(VALUE env) {
 // Using a while loop to traverse over the cdrs
 int gc_mark_freelist() {
 
+  // Free cells are not young
+  if (gc_minor) return 1;
+
   VALUE curr;
   cons_t *t;
   VALUE fl = heap_state.freelist;
@@ -294,7 +650,7 @@ int gc_mark_freelist() {
   return 1;
 }
 
-int gc_mark_aux(UINT *aux_data, unsigned int aux_size) {
+int gc_mark_aux(VALUE *aux_data, unsigned int aux_size) {
 
   for (unsigned int i = 0; i < aux_size; i ++) {
     if (is_ptr(aux_data[i])) {
@@ -307,6 +663,8 @@ int gc_mark_aux(UINT *aux_data, unsigned int aux_size) {
 	    pt_t == PTR_TYPE_BOXED_U ||
 	    pt_t == PTR_TYPE_BOXED_F ||
 	    pt_t == PTR_TYPE_ARRAY ||
+	    pt_t == PTR_TYPE_BYTECODE ||
+	    pt_t == PTR_TYPE_GLOBAL_REF ||
 	    pt_t == PTR_TYPE_REF ||
 	    pt_t == PTR_TYPE_STREAM) &&
 	   pt_v < heap_state.heap_size) {
@@ -320,44 +678,573 @@ int gc_mark_aux(UINT *aux_data, unsigned int aux_size) {
 }
 
 
+// Move a non-marked cell to the free list.
+static inline void gc_sweep_cell(unsigned int i) {
+
+  cons_t *cell = &heap_state.heap[i];
+
+  // Check if this cell is a pointer to an array
+  // and free it.
+  if (is_array_cell(cell)) {
+    array_header_t *arr = (array_header_t*)cell->car;
+    intern_remove(cell);
+    memory_free((uint32_t *)arr);
+    heap_state.gc_recovered_arrays++;
+  }
+
+  // create pointer to use as new freelist
+  VALUE addr = enc_cons_ptr(i);
+
+  // Clear the "freed" cell.
+  cell->car = RECOVERED;
+  cell->cdr = heap_state.freelist;
+  heap_state.freelist = addr;
+
+  heap_state.num_alloc --;
+  heap_state.gc_recovered ++;
+}
+
+// With a mark bitmap, unmarked cells are found 32 at a time.
+static void gc_sweep_word(unsigned int w) {
+
+  uint32_t *bitmap = heap_state.gc_bitmap;
+  unsigned int words = gc_bitmap_words(heap_state.heap_size);
+  unsigned int rest = heap_state.heap_size & 0x1F;
+
+  uint32_t unmarked = ~bitmap[w];
+  if (rest && w == words - 1) {
+    unmarked &= (1u << rest) - 1;
+  }
+  while (unmarked) {
+    gc_sweep_cell((w << 5) + (unsigned int)__builtin_ctz(unmarked));
+    unmarked &= unmarked - 1;
+  }
+  if (!heap_state.generational) {
+    bitmap[w] = 0;
+  }
+  gc_pause_work += 32;
+}
+
+static void gc_sweep_bitmap(void) {
+
+  unsigned int words = gc_bitmap_words(heap_state.heap_size);
+
+  for (unsigned int w = 0; w < words; w ++) {
+    gc_sweep_word(w);
+  }
+}
+
+/* Lazy sweep: gc_sweep_phase only resets gc_sweep_pos and
+   heap_allocate_cell sweeps 32 cells at a time when the free list
+   runs empty. Cells ahead of gc_sweep_pos keep their marks until
+   swept, and the unmarked ones there are garbage. A collection that
+   begins before the sweep is done clears the marks ahead of
+   gc_sweep_pos and leaves that garbage to its own sweep, which finds
+   it unmarked still. */
+static void gc_sweep_lazy(void) {
+
+  while (!is_ptr(heap_state.freelist) &&
+	 heap_state.gc_sweep_pos < heap_state.heap_size) {
+    gc_sweep_word(heap_state.gc_sweep_pos >> 5);
+    heap_state.gc_sweep_pos += 32;
+  }
+  if (heap_state.gc_sweep_pos > heap_state.heap_size) {
+    heap_state.gc_sweep_pos = heap_state.heap_size;
+  }
+}
+
+// Unmarked cells ahead of gc_sweep_pos, counted but not swept
+static unsigned int gc_num_unswept(void) {
+
+  if (heap_state.gc_sweep_pos >= heap_state.heap_size) return 0;
+
+  uint32_t *bitmap = heap_state.gc_bitmap;
+  unsigned int words = gc_bitmap_words(heap_state.heap_size);
+  unsigned int rest = heap_state.heap_size & 0x1F;
+  unsigned int count = 0;
+
+  for (unsigned int w = heap_state.gc_sweep_pos >> 5; w < words; w ++) {
+    uint32_t unmarked = ~bitmap[w];
+    if (rest && w == words - 1) {
+      unmarked &= (1u << rest) - 1;
+    }
+    count += (unsigned int)__builtin_popcount(unmarked);
+  }
+  return count;
+}
+
+// Starts a collection while the lazy sweep is not done
+static void gc_sweep_restart(void) {
+
+  if (heap_state.gc_sweep_pos >= heap_state.heap_size) return;
+
+  unsigned int w = heap_state.gc_sweep_pos >> 5;
+  unsigned int words = gc_bitmap_words(heap_state.heap_size);
+  memset(&heap_state.gc_bitmap[w], 0, (words - w) * sizeof(uint32_t));
+  gc_pause_work += words - w;
+}
+
+static void gc_sweep_finish(void) {
+
+  while (heap_state.gc_sweep_pos < heap_state.heap_size) {
+    gc_sweep_word(heap_state.gc_sweep_pos >> 5);
+    heap_state.gc_sweep_pos += 32;
+  }
+  heap_state.gc_sweep_pos = heap_state.heap_size;
+}
+
+/* Generational collection keeps the mark bits between collections
+   (sticky marks) so that every marked cell is old and every cell
+   allocated since the last collection is young and recorded in
+   gc_young. The cells do not move; the nursery is the set of cells
+   in gc_young and is full after nursery_size allocations. The
+   evaluators then run a minor collection at their next step, see
+   heap_nursery_full. Cells allocated until then are old and are
+   remembered right away, as cons fills them in without set_car.
+
+   A minor collection marks from the roots and from the remembered
+   set, without going into old cells, and sweeps the cells in
+   gc_young. Marked young cells stay marked, which promotes them.
+   The cost is proportional to the nursery and the survivors rather
+   than to the heap. set_car and set_cdr remember an old cell when a
+   pointer to a young cell is stored into it.
+
+   A collection is major, clearing all marks and sweeping the heap,
+   when the heap rather than the nursery is out of free cells or when
+   the remembered set has overflowed. */
+static void gc_remember_cell(unsigned int ix) {
+
+  if (gc_remembered_bits[ix >> 5] & (1u << (ix & 0x1F))) {
+    return;
+  }
+  if (gc_num_remembered == gc_remembered_size) {
+    gc_remembered_overflow = true;
+    return;
+  }
+  gc_remembered_bits[ix >> 5] |= (1u << (ix & 0x1F));
+  gc_remembered[gc_num_remembered++] = ix;
+}
+
+static void gc_remember(cons_t *cell, VALUE v) {
+
+  if (!is_ptr(v) ||
+      dec_ptr(v) >= heap_state.heap_size ||
+      !get_gc_mark(cell) ||
+      get_gc_mark(ref_cell(v))) {
+    return;
+  }
+  gc_remember_cell(cell_ix(cell));
+}
+
+bool heap_nursery_full(void) {
+  return heap_state.generational && gc_num_young == heap_state.nursery_size;
+}
+
+static void gc_forget_all(void) {
+  for (unsigned int i = 0; i < gc_num_remembered; i ++) {
+    unsigned int ix = gc_remembered[i];
+    gc_remembered_bits[ix >> 5] &= ~(1u << (ix & 0x1F));
+  }
+  gc_num_remembered = 0;
+  gc_remembered_overflow = false;
+  gc_num_young = 0;
+  gc_minor = false;
+}
+
+static void gc_mark_remembered(void) {
+  for (unsigned int i = 0; i < gc_num_remembered; i ++) {
+    cons_t *cell = &heap_state.heap[gc_remembered[i]];
+    if (!is_leaf_cell(cell)) {
+      gc_mark_phase(read_car(cell));
+      gc_mark_phase(read_cdr(cell));
+    }
+  }
+}
+
+static void gc_sweep_nursery(void) {
+  heap_state.gc_promoted = 0;
+  for (unsigned int i = 0; i < gc_num_young; i ++) {
+    if (get_gc_mark(&heap_state.heap[gc_young[i]])) {
+      heap_state.gc_promoted ++;
+    } else {
+      gc_sweep_cell(gc_young[i]);
+    }
+  }
+  gc_pause_work += gc_num_young;
+}
+
 // Sweep moves non-marked heap objects to the free list.
 int gc_sweep_phase(void) {
 
   unsigned int i = 0;
   cons_t *heap = (cons_t *)heap_state.heap;
 
+  if (gc_minor) {
+    gc_sweep_nursery();
+  } else if (heap_state.lazy_sweep) {
+    heap_state.gc_sweep_pos = 0;
+    gc_phase = GC_SWEEPING;
+  } else if (heap_state.gc_bitmap) {
+    gc_sweep_bitmap();
+  } else {
+    for (i = 0; i < heap_state.heap_size; i ++) {
+      if ( !get_gc_mark(&heap[i])){
+	gc_sweep_cell(i);
+      }
+      clr_gc_mark(&heap[i]);
+    }
+    gc_pause_work += heap_state.heap_size;
+  }
+
+  if (heap_state.generational) {
+    gc_forget_all();
+  }
+
+  unsigned int work = heap_state.gc_marked + gc_pause_work;
+  if (work > heap_state.gc_max_pause) {
+    heap_state.gc_max_pause = work;
+  }
+  return 1;
+}
+
+static void gc_incremental_abort(void) {
+  memset(heap_state.gc_bitmap, 0,
+	 gc_bitmap_words(heap_state.heap_size) * sizeof(uint32_t));
+  stack_clear(&gc_grey);
+  gc_mark_overflow = false;
+  gc_phase = GC_IDLE;
+}
+
+static unsigned int gc_incremental_mark(unsigned int budget) {
+
+  unsigned int work = 0;
+
+  while (work < budget) {
+    if (!stack_is_empty(&gc_grey)) {
+      VALUE curr;
+      pop_u32(&gc_grey, &curr);
+      gc_mark_cell(&gc_grey, curr);
+    } else if (is_ptr(gc_freelist_cursor)) {
+      // Free cells are not garbage
+      cons_t *cell = ref_cell(gc_freelist_cursor);
+      set_gc_mark(cell);
+      heap_state.gc_marked ++;
+      gc_freelist_cursor = read_cdr(cell);
+    } else if (gc_rescan_pos < heap_state.heap_size) {
+      cons_t *cell = &heap_state.heap[gc_rescan_pos++];
+      if (get_gc_mark(cell) && !is_leaf_cell(cell)) {
+	gc_push_children(&gc_grey, cell);
+      }
+    } else if (gc_mark_overflow) {
+      gc_mark_overflow = false;
+      gc_rescan_pos = 0;
+      heap_state.gc_mark_rescans ++;
+    } else {
+      heap_state.gc_num_incremental ++;
+      heap_state.gc_sweep_pos = 0;
+      gc_phase = GC_SWEEPING;
+      break;
+    }
+    work ++;
+  }
+  return work;
+}
+
+/* Performs a bounded amount of collection work, at most
+   gc_step_budget cells marked or swept, if the heap was initialized
+   with HEAP_INCREMENTAL_GC. A collection begins when less than a
+   quarter of the heap is free, and mark_roots is then called to
+   mark the roots using gc_mark_phase. A stop the world collection
+   started with gc_state_inc while marking abandons the incremental
+   one. */
+int gc_incremental_step(void (*mark_roots)(void)) {
+
+  if (!heap_state.incremental) return 0;
+
+  unsigned int work = 0;
+
+  switch (gc_phase) {
+  case GC_IDLE:
+    if (heap_state.heap_size - heap_state.num_alloc >=
+	heap_state.heap_size / GC_INCREMENTAL_START) {
+      return 1;
+    }
+    heap_state.gc_num ++;
+    heap_state.gc_recovered = 0;
+    heap_state.gc_marked = 0;
+    gc_freelist_cursor = heap_state.freelist;
+    gc_rescan_pos = heap_state.heap_size;
+    gc_mark_overflow = false;
+    stack_clear(&gc_grey);
+    gc_phase = GC_MARKING;
+    if (mark_roots) mark_roots();
+    work = heap_state.gc_marked;
+    break;
+  case GC_MARKING:
+    work = gc_incremental_mark(heap_state.gc_step_budget);
+    break;
+  case GC_SWEEPING:
+    while (work < heap_state.gc_step_budget &&
+	   heap_state.gc_sweep_pos < heap_state.heap_size) {
+      gc_sweep_word(heap_state.gc_sweep_pos >> 5);
+      heap_state.gc_sweep_pos += 32;
+      work += 32;
+    }
+    if (heap_state.gc_sweep_pos >= heap_state.heap_size) {
+      heap_state.gc_sweep_pos = heap_state.heap_size;
+      gc_phase = GC_IDLE;
+    }
+    break;
+  }
+
+  if (work > heap_state.gc_max_step) {
+    heap_state.gc_max_step = work;
+  }
+  return 1;
+}
+
+/* Compaction slides the live cells to the beginning of the heap in
+   the order of a traversal from the roots that follows cdrs before
+   cars, so the spine of a list ends up in consecutive cells and the
+   free cells in one block after the live ones. If the heap was
+   initialized with HEAP_COMPACTING, gc_compact_phase compacts every
+   gc_compact_interval collections and sweeps otherwise.
+
+   Compaction rewrites every pointer to a cell, so all roots must be
+   known. roots is called twice, first to number the live cells and
+   then to update the roots, and should do root = gc_relocate(root)
+   for every root and gc_relocate_aux for arrays of values such as
+   stacks. Live cells are found by the numbering and not by the
+   marks, but marking must still be done in case there is no memory
+   for the forwarding table and the heap is swept instead. */
+
+#define GC_UNNUMBERED 0xFFFFFFFFu
+
+static uint32_t    *gc_fwd;            // New index of every cell, while compacting
+static unsigned int gc_num_live;
+static bool         gc_relocating;     // The roots are being updated
+static stack       *gc_number_stack;
+
+static inline bool is_cell_ptr(VALUE v) {
+  if (!is_ptr(v) || dec_ptr(v) >= heap_state.heap_size) return false;
+  TYPE t = ptr_type(v);
+  return (t == PTR_TYPE_CONS ||
+	  t == PTR_TYPE_BOXED_I ||
+	  t == PTR_TYPE_BOXED_U ||
+	  t == PTR_TYPE_BOXED_F ||
+	  t == PTR_TYPE_ARRAY ||
+	  t == PTR_TYPE_BYTECODE ||
+	  t == PTR_TYPE_GLOBAL_REF ||
+	  t == PTR_TYPE_REF ||
+	  t == PTR_TYPE_STREAM);
+}
+
+static inline bool needs_number(VALUE v) {
+  return is_cell_ptr(v) && gc_fwd[dec_ptr(v)] == GC_UNNUMBERED;
+}
+
+static void gc_number_push(VALUE v) {
+  if (needs_number(v) && !push_u32(gc_number_stack, v)) {
+    gc_mark_overflow = true;
+  }
+}
+
+// Numbers the spine of a list and leaves the elements on the stack
+static void gc_number(VALUE v) {
+  while (needs_number(v)) {
+    cons_t *cell = ref_cell(v);
+    gc_fwd[dec_ptr(v)] = gc_num_live++;
+    if (is_leaf_cell(cell)) return;
+    gc_number_push(read_car(cell));
+    v = val_clr_gc_mark(read_cdr(cell));
+  }
+}
+
+static void gc_number_stack_drain(void) {
+  while (!stack_is_empty(gc_number_stack)) {
+    VALUE v;
+    pop_u32(gc_number_stack, &v);
+    gc_number(v);
+  }
+}
+
+static inline VALUE gc_forward(VALUE v) {
+  if (!is_cell_ptr(v)) return v;
+  uint32_t ix = gc_fwd[dec_ptr(v)];
+  if (ix == GC_UNNUMBERED) return v;
+  return (v & ~(VALUE)PTR_VAL_MASK) | ((VALUE)ix << ADDRESS_SHIFT);
+}
+
+VALUE gc_relocate(VALUE v) {
+
+  if (!gc_fwd) return v;
+
+  if (!gc_relocating) {
+    gc_number(v);
+    gc_number_stack_drain();
+    return v;
+  }
+  return gc_forward(v);
+}
+
+void gc_relocate_aux(VALUE *data, unsigned int n) {
+  for (unsigned int i = 0; i < n; i ++) {
+    data[i] = gc_relocate(data[i]);
+  }
+}
+
+// The contents of a cell as they will be at its new index
+static cons_t gc_relocated_cell(cons_t *cell) {
+  cons_t res;
+  res.car = read_car(cell);
+  res.cdr = val_clr_gc_mark(read_cdr(cell));
+  if (!is_leaf_cell(cell)) {
+    res.car = gc_forward(res.car);
+    res.cdr = gc_forward(res.cdr);
+  }
+  return res;
+}
+
+static void gc_compact(void (*roots)(void)) {
+
+  cons_t *heap = heap_state.heap;
+  unsigned int i;
+
+  VALUE stack_storage[GC_STACK_SIZE];
+  stack s;
+  stack_create(&s, stack_storage, GC_STACK_SIZE);
+  gc_number_stack = &s;
+
+  memset(gc_fwd, 0xFF, heap_state.heap_size * sizeof(uint32_t));
+  gc_num_live = 0;
+  gc_relocating = false;
+  gc_mark_overflow = false;
+
+  roots();
+
+  while (gc_mark_overflow) {
+    gc_mark_overflow = false;
+    heap_state.gc_mark_rescans ++;
+
+    for (i = 0; i < heap_state.heap_size; i ++) {
+      if (gc_fwd[i] != GC_UNNUMBERED && !is_leaf_cell(&heap[i])) {
+	gc_number_push(val_clr_gc_mark(read_cdr(&heap[i])));
+	gc_number_push(read_car(&heap[i]));
+	gc_number_stack_drain();
+      }
+    }
+  }
+
+  // Free the arrays of dead cells. From here on the mark of a cell
+  // is set if the cell is live and still at its old index.
   for (i = 0; i < heap_state.heap_size; i ++) {
-    if ( !get_gc_mark(&heap[i])){
-
-      // Check if this cell is a pointer to an array
-      // and free it.
-      if (type_of(heap[i].cdr) == VAL_TYPE_SYMBOL &&
-	  dec_sym(heap[i].cdr) == DEF_REPR_ARRAY_TYPE) {
-	array_header_t *arr = (array_header_t*)heap[i].car;
-	memory_free((uint32_t *)arr);
+    if (gc_fwd[i] == GC_UNNUMBERED) {
+      if (is_array_cell(&heap[i])) {
+	intern_remove(&heap[i]);
+	memory_free((uint32_t *)read_car(&heap[i]));
 	heap_state.gc_recovered_arrays++;
       }
+      clr_gc_mark(&heap[i]);
+    } else {
+      set_gc_mark(&heap[i]);
+    }
+  }
 
-      // create pointer to use as new freelist
-      UINT addr = enc_cons_ptr(i);
+  // Move the cells along the cycles of the permutation gc_fwd
+  for (i = 0; i < heap_state.heap_size; i ++) {
+    if (gc_fwd[i] == GC_UNNUMBERED || !get_gc_mark(&heap[i])) continue;
 
-      // Clear the "freed" cell.
-      heap[i].car = RECOVERED;
-      heap[i].cdr = heap_state.freelist;
-      heap_state.freelist = addr;
+    cons_t carry = gc_relocated_cell(&heap[i]);
+    clr_gc_mark(&heap[i]);
+    unsigned int j = gc_fwd[i];
+
+    while (gc_fwd[j] != GC_UNNUMBERED && get_gc_mark(&heap[j])) {
+      cons_t next = gc_relocated_cell(&heap[j]);
+      clr_gc_mark(&heap[j]);
+      heap[j] = carry;
+      carry = next;
+      j = gc_fwd[j];
+    }
+    heap[j] = carry;
+  }
+
+  // All free cells follow the live ones
+  heap_state.freelist = NIL;
+  for (i = heap_state.heap_size; i > gc_num_live; i --) {
+    heap[i - 1].car = RECOVERED;
+    heap[i - 1].cdr = heap_state.freelist;
+    heap_state.freelist = enc_cons_ptr(i - 1);
+  }
+
+  gc_relocating = true;
+  roots();
+  gc_relocating = false;
 
-      heap_state.num_alloc --;
-      heap_state.gc_recovered ++;
+  // Only live strings are left in the intern table
+  for (i = 0; i < intern_capacity; i ++) {
+    if (intern_table[i].arr) {
+      intern_table[i].arr = gc_forward(intern_table[i].arr);
     }
-    clr_gc_mark(&heap[i]);
+  }
+
+  heap_state.gc_recovered = heap_state.num_alloc - gc_num_live;
+  heap_state.num_alloc = gc_num_live;
+  heap_state.gc_num_compactions ++;
+  gc_pause_work += 2 * heap_state.heap_size;
+}
+
+int gc_compact_phase(void (*roots)(void)) {
+
+  if (!heap_state.compacting || !roots ||
+      heap_state.gc_num % heap_state.gc_compact_interval != 0) {
+    return gc_sweep_phase();
+  }
+
+  gc_fwd = (uint32_t *)malloc(heap_state.heap_size * sizeof(uint32_t));
+  if (!gc_fwd) {
+    return gc_sweep_phase();
+  }
+
+  gc_compact(roots);
+  free(gc_fwd);
+  gc_fwd = NULL;
+  // Nothing is left to sweep
+  heap_state.gc_sweep_pos = heap_state.heap_size;
+
+  unsigned int work = heap_state.gc_marked + gc_pause_work;
+  if (work > heap_state.gc_max_pause) {
+    heap_state.gc_max_pause = work;
   }
   return 1;
 }
 
+void heap_set_gc_compact_interval(unsigned int collections) {
+  heap_state.gc_compact_interval = collections ? collections : 1;
+}
+
 void gc_state_inc(void) {
+  if (gc_phase == GC_MARKING) {
+    gc_incremental_abort();
+  }
+  gc_pause_work = 0;
+  gc_sweep_restart();
+  gc_phase = GC_IDLE;
   heap_state.gc_num ++;
   heap_state.gc_recovered = 0;
   heap_state.gc_marked = 0;
+
+  if (heap_state.generational) {
+    gc_minor = (gc_num_young == heap_state.nursery_size &&
+		is_ptr(heap_state.freelist) &&
+		!gc_remembered_overflow);
+    if (gc_minor) {
+      heap_state.gc_num_minor ++;
+      gc_mark_remembered();
+    } else {
+      memset(heap_state.gc_bitmap, 0,
+	     gc_bitmap_words(heap_state.heap_size) * sizeof(uint32_t));
+    }
+  }
 }
 
 
@@ -386,7 +1273,7 @@ int heap_perform_gc_extra(VALUE env, VALUE env2, VALUE exp, VALUE exp2, VALUE li
   return gc_sweep_phase();
 }
 
-int heap_perform_gc_aux(VALUE env, VALUE env2, VALUE exp, VALUE exp2, VALUE exp3, UINT *aux_data, unsigned int aux_size) {
+int heap_perform_gc_aux(VALUE env, VALUE env2, VALUE exp, VALUE exp2, VALUE exp3, VALUE *aux_data, unsigned int aux_size) {
   gc_state_inc();
 
   gc_mark_freelist();
@@ -447,6 +1334,8 @@ VALUE cdr(VALUE c){
 void set_car(VALUE c, VALUE v) {
   if (is_ptr(c) && ptr_type(c) == PTR_TYPE_CONS) {
     cons_t *cell = ref_cell(c);
+    if (gc_phase == GC_MARKING) gc_write_barrier(read_car(cell));
+    if (heap_state.generational) gc_remember(cell, v);
     set_car_(cell,v);
   }
 }
@@ -454,6 +1343,8 @@ void set_car(VALUE c, VALUE v) {
 void set_cdr(VALUE c, VALUE v) {
   if (type_of(c) == PTR_TYPE_CONS){
     cons_t *cell = ref_cell(c);
+    if (gc_phase == GC_MARKING) gc_write_barrier(read_cdr(cell));
+    if (heap_state.generational) gc_remember(cell, v);
     set_cdr_(cell,v);
   }
 }
@@ -511,14 +1402,94 @@ VALUE copy(VALUE list) {
 // Arrays are part of the heap module because their lifespan is managed
 // by the garbage collector. The data in the array is not stored
 // in the "heap of cons cells".
+/* An array is referenced only from the car of its cell, so the array
+   memory can be defragmented by sliding the arrays together and
+   updating the cars. Other blocks in the memory, like symbol names,
+   stay where they are. Done by heap_allocate_array when there is
+   enough free memory for an array but not in one block, so pointers
+   to array data must not be kept across heap_allocate_array. */
+
+typedef struct {
+  uint32_t *ptr;
+  unsigned int cell;
+} array_owner_t;
+
+static array_owner_t *array_owners;
+static unsigned int   num_array_owners;
+static unsigned int   next_array_owner;
+
+static int array_owner_cmp(const void *a, const void *b) {
+  uint32_t *pa = ((const array_owner_t *)a)->ptr;
+  uint32_t *pb = ((const array_owner_t *)b)->ptr;
+  return (pa > pb) - (pa < pb);
+}
+
+// Called in address order by memory_compact
+static bool array_movable(uint32_t *ptr) {
+  while (next_array_owner < num_array_owners &&
+	 array_owners[next_array_owner].ptr < ptr) {
+    next_array_owner ++;
+  }
+  return (next_array_owner < num_array_owners &&
+	  array_owners[next_array_owner].ptr == ptr);
+}
+
+static void array_moved(uint32_t *from, uint32_t *to) {
+  (void)from;
+  cons_t *cell = &heap_state.heap[array_owners[next_array_owner].cell];
+  set_car_(cell, (VALUE)to);
+}
+
+int heap_compact_arrays(void) {
+
+  unsigned int n = 0;
+  for (unsigned int i = 0; i < heap_state.heap_size; i ++) {
+    if (is_array_cell(&heap_state.heap[i])) n ++;
+  }
+  if (n == 0) return 0;
+
+  array_owners = (array_owner_t *)malloc(n * sizeof(array_owner_t));
+  if (!array_owners) return 0;
+
+  num_array_owners = 0;
+  for (unsigned int i = 0; i < heap_state.heap_size; i ++) {
+    cons_t *cell = &heap_state.heap[i];
+    if (is_array_cell(cell)) {
+      array_owners[num_array_owners].ptr = (uint32_t *)read_car(cell);
+      array_owners[num_array_owners].cell = i;
+      num_array_owners ++;
+    }
+  }
+  qsort(array_owners, num_array_owners, sizeof(array_owner_t), array_owner_cmp);
+
+  next_array_owner = 0;
+  int r = memory_compact(array_movable, array_moved);
+
+  free(array_owners);
+  array_owners = NULL;
+  if (r) heap_state.num_array_compactions ++;
+  return r;
+}
+
 int heap_allocate_array(VALUE *res, unsigned int size, TYPE type){
 
   array_header_t *array = NULL;
   // allocating a cell that will, to start with, be a cons cell.
   VALUE cell  = heap_allocate_cell(PTR_TYPE_CONS);
 
-  if (type_of(cell) == VAL_TYPE_SYMBOL) // Out of heap memory
-    return cell;
+  if (type_of(cell) == VAL_TYPE_SYMBOL) { // Out of heap memory
+    *res = cell;
+    return 0;
+  }
+
+  // Short strings are kept in the car of the cell
+  if (type == VAL_TYPE_CHAR && size <= INLINE_ARRAY_MAX_SIZE) {
+    set_car_(ref_cell(cell), 0);
+    set_cdr_(ref_cell(cell), enc_sym(DEF_REPR_INLINE_ARRAY_TYPE + size));
+    *res = set_ptr_type(cell, PTR_TYPE_ARRAY);
+    heap_state.num_alloc_arrays ++;
+    return 1;
+  }
 
   int allocate_size = 0;
   if (type == VAL_TYPE_CHAR) {
@@ -533,12 +1504,29 @@ int heap_allocate_array(VALUE *res, unsigned int size, TYPE type){
 
   array = (array_header_t*)memory_allocate(2 + allocate_size);
 
-  if (array == NULL) return 0;
+  // Arrays of unswept garbage are not yet freed
+  if (array == NULL &&
+      heap_state.gc_sweep_pos < heap_state.heap_size) {
+    gc_sweep_finish();
+    array = (array_header_t*)memory_allocate(2 + allocate_size);
+  }
+
+  // Enough memory is free but not in one block
+  if (array == NULL &&
+      memory_num_free() >= (uint32_t)(2 + allocate_size) &&
+      heap_compact_arrays()) {
+    array = (array_header_t*)memory_allocate(2 + allocate_size);
+  }
+
+  if (array == NULL) {
+    *res = enc_sym(symrepr_merror());
+    return 0;
+  }
 
   array->elt_type = type;
   array->size = size;
 
-  set_car(cell, (UINT)array);
+  set_car(cell, (VALUE)array);
   set_cdr(cell, enc_sym(DEF_REPR_ARRAY_TYPE));
 
   cell = cell | PTR_TYPE_ARRAY;
@@ -549,3 +1537,163 @@ int heap_allocate_array(VALUE *res, unsigned int size, TYPE type){
 
   return 1;
 }
+
+uint32_t array_size(VALUE arr) {
+  cons_t *cell = ref_cell(arr);
+  if (is_inline_array_cell(cell)) {
+    return dec_sym(val_clr_gc_mark(read_cdr(cell))) - DEF_REPR_INLINE_ARRAY_TYPE;
+  }
+  return ((array_header_t *)read_car(cell))->size;
+}
+
+TYPE array_elt_type(VALUE arr) {
+  cons_t *cell = ref_cell(arr);
+  if (is_inline_array_cell(cell)) {
+    return VAL_TYPE_CHAR;
+  }
+  return ((array_header_t *)read_car(cell))->elt_type;
+}
+
+void *array_data(VALUE arr) {
+  cons_t *cell = ref_cell(arr);
+  if (is_inline_array_cell(cell)) {
+    return &cell->car;
+  }
+  return (uint32_t *)read_car(cell) + 2;
+}
+
+/* String constants, like the string literals read by the parser, can
+   be interned with heap_intern_string if the heap was initialized
+   with HEAP_INTERN_STRINGS. Equal strings then share one array, the
+   cdr of which is DEF_REPR_INTERNED_ARRAY_TYPE, and are equal if
+   and only if they are the same pointer. Interned arrays must not be
+   written to.
+
+   The intern table is an open addressing hash table that does not
+   keep its strings alive. The sweep removes a string from the table
+   when its cell is freed and compaction forwards the strings that
+   are left. Strings too short to be worth sharing are stored inline
+   and not interned. */
+
+static uint32_t intern_hash(char *str, unsigned int len) {
+  uint32_t h = 2166136261u;
+  for (unsigned int i = 0; i < len; i ++) {
+    h = (h ^ (uint8_t)str[i]) * 16777619u;
+  }
+  return h;
+}
+
+/* A string in the table can be dead but not yet swept, if it is
+   ahead of the lazy sweep and unmarked. A string that is handed out
+   while an incremental collection is marking must be marked. */
+static bool intern_live(VALUE arr) {
+  if (dec_ptr(arr) >= heap_state.gc_sweep_pos &&
+      !get_gc_mark(ref_cell(arr))) {
+    return false;
+  }
+  gc_write_barrier(arr);
+  return true;
+}
+
+static int intern_grow(void) {
+
+  unsigned int capacity = intern_capacity ? 2 * intern_capacity : INTERN_MIN_CAPACITY;
+  intern_entry_t *table = (intern_entry_t *)calloc(capacity, sizeof(intern_entry_t));
+  if (!table) return 0;
+
+  for (unsigned int i = 0; i < intern_capacity; i ++) {
+    if (intern_table[i].arr) {
+      unsigned int j = intern_table[i].hash & (capacity - 1);
+      while (table[j].arr) j = (j + 1) & (capacity - 1);
+      table[j] = intern_table[i];
+    }
+  }
+  free(intern_table);
+  intern_table = table;
+  intern_capacity = capacity;
+  return 1;
+}
+
+// Called with the cell of an array that is about to be freed
+static void intern_remove(cons_t *cell) {
+
+  if (val_clr_gc_mark(read_cdr(cell)) != enc_sym(DEF_REPR_INTERNED_ARRAY_TYPE)) {
+    return;
+  }
+
+  array_header_t *header = (array_header_t *)read_car(cell);
+  VALUE arr = set_ptr_type(enc_cons_ptr(cell_ix(cell)), PTR_TYPE_ARRAY);
+  unsigned int mask = intern_capacity - 1;
+  unsigned int i = intern_hash((char *)((uint32_t *)header + 2), header->size - 1) & mask;
+
+  while (intern_table[i].arr != arr) {
+    if (!intern_table[i].arr) return;
+    i = (i + 1) & mask;
+  }
+
+  // Move back the entries after i that would not be found otherwise
+  unsigned int j = i;
+  while (true) {
+    j = (j + 1) & mask;
+    if (!intern_table[j].arr) break;
+    unsigned int k = intern_table[j].hash & mask;
+    if ((j > i && (k <= i || k > j)) ||
+	(j < i && (k <= i && k > j))) {
+      intern_table[i] = intern_table[j];
+      i = j;
+    }
+  }
+  intern_table[i].arr = 0;
+  heap_state.num_interned --;
+}
+
+int heap_intern_string(VALUE *res, char *str, unsigned int len) {
+
+  bool intern = heap_state.intern_strings && len + 1 > INLINE_ARRAY_MAX_SIZE;
+  uint32_t hash = 0;
+
+  if (intern) {
+    hash = intern_hash(str, len);
+    unsigned int mask = intern_capacity - 1;
+    for (unsigned int i = hash & mask;
+	 intern_capacity && intern_table[i].arr;
+	 i = (i + 1) & mask) {
+      VALUE arr = intern_table[i].arr;
+      if (intern_table[i].hash == hash &&
+	  array_size(arr) == len + 1 &&
+	  memcmp(array_data(arr), str, len) == 0 &&
+	  intern_live(arr)) {
+	heap_state.num_intern_hits ++;
+	*res = arr;
+	return 1;
+      }
+    }
+    // Keep the table at most half full
+    if (2 * (heap_state.num_interned + 1) > intern_capacity &&
+	!intern_grow()) {
+      intern = false;
+    }
+  }
+
+  if (!heap_allocate_array(res, len + 1, VAL_TYPE_CHAR)) {
+    return 0;
+  }
+  char *data = array_data(*res);
+  memcpy(data, str, len);
+  data[len] = 0;
+
+  if (intern) {
+    unsigned int mask = intern_capacity - 1;
+    unsigned int i = hash & mask;
+    while (intern_table[i].arr) i = (i + 1) & mask;
+    intern_table[i].arr = *res;
+    intern_table[i].hash = hash;
+    heap_state.num_interned ++;
+    set_cdr_(ref_cell(*res), enc_sym(DEF_REPR_INTERNED_ARRAY_TYPE));
+  }
+  return 1;
+}
+
+bool array_is_interned(VALUE arr) {
+  return val_clr_gc_mark(read_cdr(ref_cell(arr))) == enc_sym(DEF_REPR_INTERNED_ARRAY_TYPE);
+}
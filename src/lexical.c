@@ -0,0 +1,761 @@
+/*
+    Copyright 2020 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Lexical addressing and closure conversion.
+
+   A lambda is resolved into a copy, (lambda-lex params body
+   captures), where every reference to a local variable is replaced by
+   a lexical reference to a slot of a frame. Lexical references are
+   symbol ids in the range DEF_REPR_LEXICAL_REF to
+   DEF_REPR_LEXICAL_REF + LEXICAL_REF_MAX, see lexical.h.
+
+   The environment of resolved code is a chain of frames. Applying a
+   closure makes one frame of the arguments, let makes one frame of
+   its keys, and a closure keeps one frame of the free variables of its
+   lambda that are bound where it is created, listed in captures. So
+   the frame and the slot of every local variable are known before the
+   body runs, and a reference holds how many frames up the variable
+   is and the path to its slot in that frame.
+
+   Lambdas nested in the body are rewritten in the same pass and
+   capture from the frames they are created in. The outermost lambda
+   is evaluated in an environment of named bindings and captures the
+   bindings it finds there by name. A let key that a lambda in one of
+   the binding expressions refers to is kept in a binding as well, in
+   its slot, as that lambda may be evaluated before the key is bound
+   (letrec). References to variables kept in bindings are indirect. A
+   lambda that refers to eval is not resolved, eval needs all of the
+   environment it is called in.
+
+   Free variables that are not captured are globals. A reference to a
+   defined global is replaced by a PTR_TYPE_GLOBAL_REF pointer to its
+   key-val pair in the global environment, that acts as an inline
+   cache for the reference. define sets the value of an existing pair
+   in place, so the cache never goes stale. define adds the pair before
+   it evaluates the value, so recursive references are cached too. A
+   global that is not defined yet gets a pair bound to not_found, that
+   define fills in later, so references to functions defined after the
+   lambda, as in mutual recursion, are cached as well.
+
+   The pass runs twice: once to check that the lambda can be resolved
+   and to count the cells the copy and the capture lists need, and
+   once, with the cells allocated, to rewrite the copy. The lambda
+   itself is never changed, the code may be quoted data that the
+   program still uses. A lambda that cannot be resolved is evaluated
+   the old way.
+
+   Each lambda is resolved once. The copy is kept in a small cache
+   keyed by the lambda, with the names of the globals it refers to,
+   and is used again as long as the environment the lambda is
+   evaluated in binds the variables it captures and none of those
+   globals. The cache is a root of the evaluator's collections. A
+   collection that does not mark it, made by another evaluator, empties
+   it. */
+
+#include "lexical.h"
+#include "extensions.h"
+#include "env.h"
+
+#define LEXICAL_MAX_NAMES  256
+#define LEXICAL_MAX_DEPTH  64
+#define LEXICAL_MAX_FRAMES ((LEXICAL_REF_MAX >> LEXICAL_DEPTH_SHIFT) + 1)
+#define LEXICAL_CACHE_SIZE 16
+
+/* Names bound around the expression being resolved, the innermost
+   last, and whether they are kept in bindings. */
+static VALUE scope[LEXICAL_MAX_NAMES];
+static bool scope_boxed[LEXICAL_MAX_NAMES];
+static unsigned int scope_n;
+
+/* The frames the names are in, the innermost last. The body of each
+   lambda is resolved with its own frames, from chain_base. */
+typedef struct {
+  unsigned int base;       // index of the first name in scope
+  unsigned int n;          // number of slots
+} frame_t;
+
+static frame_t frames[2 * LEXICAL_MAX_DEPTH];
+static unsigned int frames_n;
+static unsigned int chain_base;
+
+/* Free variables of the lambdas being resolved */
+static VALUE free_vars[LEXICAL_MAX_NAMES];
+static bool free_boxed[LEXICAL_MAX_NAMES];
+static unsigned int free_n;
+
+/* Free variables of the outermost lambda that are globals */
+static VALUE globals[LEXICAL_MAX_NAMES];
+static unsigned int globals_n;
+
+static bool rewrite;       // false when counting cells
+static unsigned int cells; // cells needed for the copy and captures
+static VALUE pool;         // the cells, allocated before rewriting
+static VALUE root_env;     // environment of the outermost lambda
+
+typedef struct {
+  VALUE src;               // the lambda, 0 if the entry is empty
+  VALUE res;               // its copy, or src if it cannot be resolved
+  VALUE globals;           // names of the globals it refers to
+} cache_entry_t;
+
+static cache_entry_t cache[LEXICAL_CACHE_SIZE];
+static unsigned int cache_next;
+static unsigned int cache_gc_num; // the last collection that marked the cache
+
+static bool push_name(VALUE *names, unsigned int *n, VALUE name) {
+  if (*n >= LEXICAL_MAX_NAMES) return false;
+  names[(*n)++] = name;
+  return true;
+}
+
+static bool is_variable(VALUE exp) {
+  return (type_of(exp) == VAL_TYPE_SYMBOL &&
+	  !is_special(exp) &&
+	  extensions_lookup(dec_sym(exp)) == NULL);
+}
+
+// Index of the innermost sym in scope[base..scope_n) or -1
+static int scope_find(unsigned int base, VALUE sym) {
+  for (unsigned int i = scope_n; i > base; i --) {
+    if (scope[i - 1] == sym) return (int)(i - 1);
+  }
+  return -1;
+}
+
+static bool is_proper_list(VALUE list) {
+  while (type_of(list) == PTR_TYPE_CONS) list = cdr(list);
+  return (type_of(list) == VAL_TYPE_SYMBOL &&
+	  dec_sym(list) == symrepr_nil());
+}
+
+static bool push_scope(VALUE name, bool boxed) {
+  if (scope_n >= LEXICAL_MAX_NAMES) return false;
+  scope_boxed[scope_n] = boxed;
+  scope[scope_n++] = name;
+  return true;
+}
+
+static bool push_params(VALUE params) {
+  if (!is_proper_list(params)) return false;
+  for (VALUE curr = params; type_of(curr) == PTR_TYPE_CONS; curr = cdr(curr)) {
+    if (!push_scope(car(curr), false)) return false;
+  }
+  return true;
+}
+
+static bool push_let_keys(VALUE binds) {
+  for (VALUE curr = binds; type_of(curr) == PTR_TYPE_CONS; curr = cdr(curr)) {
+    if (type_of(car(curr)) != PTR_TYPE_CONS ||
+	!push_scope(car(car(curr)), false)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Makes the names in scope[base..scope_n) a frame. There is no frame
+   if there are no names. */
+static bool push_frame(unsigned int base) {
+  unsigned int n = scope_n - base;
+  if (n == 0) return true;
+  if (n > LEXICAL_MAX_SLOTS ||
+      frames_n - chain_base >= LEXICAL_MAX_FRAMES) {
+    return false;
+  }
+  frames[frames_n].base = base;
+  frames[frames_n].n = n;
+  frames_n ++;
+  return true;
+}
+
+/* The path to slot i of a frame of n slots, see lexical.h. The slots
+   are a balanced tree with the first half of them in the car. */
+static UINT slot_path(unsigned int n, unsigned int i) {
+  UINT path = 0;
+  unsigned int len = 0;
+  while (n > 1) {
+    unsigned int h = (n + 1) / 2;
+    if (i >= h) {
+      path |= 1u << len;
+      i -= h;
+      n -= h;
+    } else {
+      n = h;
+    }
+    len ++;
+  }
+  return path | (1u << len);
+}
+
+// The innermost sym in the frames of the lambda being resolved
+static bool chain_find(VALUE sym, VALUE *ref) {
+  for (unsigned int f = frames_n; f > chain_base; f --) {
+    frame_t *fr = &frames[f - 1];
+    for (unsigned int i = fr->n; i > 0; i --) {
+      unsigned int ix = fr->base + i - 1;
+      if (scope[ix] == sym) {
+	UINT code = (((UINT)(frames_n - f) << LEXICAL_DEPTH_SHIFT) |
+		     (scope_boxed[ix] ? LEXICAL_INDIRECT : 0) |
+		     slot_path(fr->n, i - 1));
+	*ref = enc_sym(DEF_REPR_LEXICAL_REF + code);
+	return true;
+      }
+    }
+  }
+  return false;
+}
+
+static bool is_indirect(VALUE ref) {
+  return (dec_sym(ref) - DEF_REPR_LEXICAL_REF) & LEXICAL_INDIRECT;
+}
+
+static bool is_member(VALUE sym, VALUE list) {
+  for (VALUE curr = list; type_of(curr) == PTR_TYPE_CONS; curr = cdr(curr)) {
+    if (car(curr) == sym) return true;
+  }
+  return false;
+}
+
+static bool is_let_key(VALUE sym, VALUE binds) {
+  for (VALUE curr = binds; type_of(curr) == PTR_TYPE_CONS; curr = cdr(curr)) {
+    if (type_of(car(curr)) == PTR_TYPE_CONS && car(car(curr)) == sym) return true;
+  }
+  return false;
+}
+
+/* True if a lambda in exp refers to sym, that is bound outside of exp.
+   True as well if exp is too deep to tell. */
+static bool captured_in(VALUE exp, VALUE sym, bool in_lambda, unsigned int depth) {
+  if (exp == sym) return in_lambda;
+  if (type_of(exp) != PTR_TYPE_CONS) return false;
+  if (depth >= LEXICAL_MAX_DEPTH) return true;
+
+  VALUE head = car(exp);
+  if (type_of(head) == VAL_TYPE_SYMBOL) {
+    UINT sym_id = dec_sym(head);
+
+    if (sym_id == symrepr_quote()) return false;
+    if (sym_id == symrepr_lambda()) {
+      return (!is_member(sym, car(cdr(exp))) &&
+	      captured_in(car(cdr(cdr(exp))), sym, true, depth + 1));
+    }
+    if (sym_id == symrepr_let() &&
+	is_let_key(sym, car(cdr(exp)))) {
+      return false;
+    }
+  }
+  for (VALUE curr = exp; type_of(curr) == PTR_TYPE_CONS; curr = cdr(curr)) {
+    if (captured_in(car(curr), sym, in_lambda, depth + 1)) return true;
+  }
+  return false;
+}
+
+/* Adds the variables referenced in exp that are not bound in
+   scope[bound..scope_n) to free_vars[fv_base..free_n). */
+static bool collect(VALUE exp, unsigned int bound, unsigned int fv_base,
+		    unsigned int depth) {
+
+  // eval looks up by name in the environment it is called in, a
+  // lambda that calls it has to keep all of it
+  if (type_of(exp) == VAL_TYPE_SYMBOL &&
+      dec_sym(exp) == symrepr_eval()) {
+    return false;
+  }
+  if (is_variable(exp)) {
+    if (scope_find(bound, exp) >= 0) return true;
+    for (unsigned int i = fv_base; i < free_n; i ++) {
+      if (free_vars[i] == exp) return true;
+    }
+    return push_name(free_vars, &free_n, exp);
+  }
+  if (type_of(exp) != PTR_TYPE_CONS) return true;
+  if (depth >= LEXICAL_MAX_DEPTH) return false;
+
+  unsigned int n = scope_n;
+  bool ok = true;
+  VALUE head = car(exp);
+
+  if (type_of(head) == VAL_TYPE_SYMBOL) {
+    UINT sym_id = dec_sym(head);
+
+    if (sym_id == symrepr_quote()) return true;
+    // Already resolved elsewhere, its free variables are not known
+    if (sym_id == symrepr_lambda_lex()) return false;
+
+    if (sym_id == symrepr_lambda()) {
+      ok = (push_params(car(cdr(exp))) &&
+	    collect(car(cdr(cdr(exp))), bound, fv_base, depth + 1));
+      scope_n = n;
+      return ok;
+    }
+    if (sym_id == symrepr_let()) {
+      VALUE binds = car(cdr(exp));
+      ok = push_let_keys(binds);
+      for (VALUE curr = binds; ok && type_of(curr) == PTR_TYPE_CONS; curr = cdr(curr)) {
+	ok = collect(car(cdr(car(curr))), bound, fv_base, depth + 1);
+      }
+      ok = ok && collect(car(cdr(cdr(exp))), bound, fv_base, depth + 1);
+      scope_n = n;
+      return ok;
+    }
+    if (sym_id == symrepr_define()) {
+      return collect(car(cdr(cdr(exp))), bound, fv_base, depth + 1);
+    }
+  }
+  for (VALUE curr = exp; ok && type_of(curr) == PTR_TYPE_CONS; curr = cdr(curr)) {
+    ok = collect(car(curr), bound, fv_base, depth + 1);
+  }
+  return ok;
+}
+
+static VALUE take_cell(void) {
+  VALUE cell = pool;
+  pool = cdr(pool);
+  return cell;
+}
+
+static bool is_quote(VALUE exp) {
+  return (type_of(exp) == PTR_TYPE_CONS &&
+	  type_of(car(exp)) == VAL_TYPE_SYMBOL &&
+	  dec_sym(car(exp)) == symrepr_quote());
+}
+
+/* Adds the cells of exp to cells. Quoted data is not rewritten and is
+   not counted, it is shared with the copy. */
+static bool count_copy(VALUE exp, unsigned int depth) {
+  if (is_quote(exp)) return true;
+  if (depth >= LEXICAL_MAX_DEPTH) return false;
+  for (VALUE curr = exp; type_of(curr) == PTR_TYPE_CONS; curr = cdr(curr)) {
+    cells ++;
+    if (type_of(car(curr)) == PTR_TYPE_CONS &&
+	!count_copy(car(curr), depth + 1)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Copies exp into cells from the pool
+static VALUE copy_exp(VALUE exp) {
+  if (type_of(exp) != PTR_TYPE_CONS || is_quote(exp)) return exp;
+
+  VALUE res = take_cell();
+  VALUE last = res;
+  VALUE curr = exp;
+  while (true) {
+    set_car(last, copy_exp(car(curr)));
+    curr = cdr(curr);
+    if (type_of(curr) != PTR_TYPE_CONS) break;
+    VALUE c = take_cell();
+    set_cdr(last, c);
+    last = c;
+  }
+  set_cdr(last, curr);
+  return res;
+}
+
+static bool env_binds(VALUE env, VALUE sym) {
+  for (VALUE curr = env; type_of(curr) == PTR_TYPE_CONS; curr = cdr(curr)) {
+    if (car(car(curr)) == sym) return true;
+  }
+  return false;
+}
+
+static bool resolve(VALUE cell, unsigned int depth);
+
+/* Resolves (lambda params body). The free variables are captured from
+   the frames the lambda is created in, or for the outermost lambda
+   from root_env, where they are bindings. */
+static bool resolve_lambda(VALUE exp, bool root, unsigned int depth) {
+  VALUE params = car(cdr(exp));
+  VALUE body_cell = cdr(cdr(exp));
+  unsigned int n = scope_n;
+  unsigned int fv_base = free_n;
+
+  if (type_of(body_cell) != PTR_TYPE_CONS ||
+      !push_params(params) ||
+      !collect(car(body_cell), n, fv_base, depth)) {
+    return false;
+  }
+  scope_n = n;
+
+  // Keep the free variables bound where the lambda is created, with
+  // where to find them.
+  VALUE captures = enc_sym(symrepr_nil());
+  unsigned int m = 0;
+  for (unsigned int i = fv_base; i < free_n; i ++) {
+    VALUE src;
+    bool boxed;
+    if (root) {
+      if (!env_binds(root_env, free_vars[i])) {
+	globals[globals_n++] = free_vars[i];
+	continue;
+      }
+      src = free_vars[i];
+      boxed = true;
+    } else {
+      if (!chain_find(free_vars[i], &src)) continue;
+      boxed = is_indirect(src);
+    }
+    free_vars[fv_base + m] = free_vars[i];
+    free_boxed[fv_base + m] = boxed;
+    m ++;
+    if (rewrite) {
+      VALUE c = take_cell();
+      set_car(c, src);
+      set_cdr(c, captures);
+      captures = c;
+    }
+  }
+  free_n = fv_base;
+  if (m > LEXICAL_MAX_SLOTS) return false;
+  cells += m + 1;
+
+  if (rewrite) {
+    // The capture list is built backwards, reverse it in place
+    VALUE prev = enc_sym(symrepr_nil());
+    while (type_of(captures) == PTR_TYPE_CONS) {
+      VALUE next = cdr(captures);
+      set_cdr(captures, prev);
+      prev = captures;
+      captures = next;
+    }
+    VALUE c = take_cell();
+    set_car(c, prev);
+    set_cdr(c, enc_sym(symrepr_nil()));
+    set_cdr(body_cell, c);
+    set_car(exp, enc_sym(symrepr_lambda_lex()));
+  }
+
+  // The body is evaluated in a frame of the parameters on a frame of
+  // the captured variables. The names were left in free_vars, above
+  // free_n.
+  unsigned int f = frames_n;
+  unsigned int outer_chain = chain_base;
+  chain_base = frames_n;
+  bool ok = true;
+  for (unsigned int i = 0; ok && i < m; i ++) {
+    ok = push_scope(free_vars[fv_base + i], free_boxed[fv_base + i]);
+  }
+  unsigned int params_base = scope_n;
+  ok = (ok &&
+	push_frame(n) &&
+	push_params(params) &&
+	push_frame(params_base) &&
+	resolve(body_cell, depth + 1));
+  scope_n = n;
+  frames_n = f;
+  chain_base = outer_chain;
+  return ok;
+}
+
+/* (let ((k1 e1) ... (kn en)) body) into (let-lex ((r1 e1) ... (rn en))
+   body), where ri is a reference to slot i of the frame of the keys.
+   The keys are in scope in the value expressions as well as in the
+   body (letrec). A key that a lambda in its own or an earlier value
+   expression refers to is kept in a binding, the lambda captures it
+   before it is bound. */
+static bool resolve_let(VALUE exp, unsigned int depth) {
+  VALUE binds = car(cdr(exp));
+  unsigned int n = scope_n;
+  unsigned int f = frames_n;
+  bool ok = push_let_keys(binds);
+
+  unsigned int j = n;
+  for (VALUE curr = binds; ok && type_of(curr) == PTR_TYPE_CONS; curr = cdr(curr)) {
+    for (VALUE prev = binds; prev != cdr(curr); prev = cdr(prev)) {
+      if (type_of(cdr(car(prev))) == PTR_TYPE_CONS &&
+	  captured_in(car(cdr(car(prev))), scope[j], false, 0)) {
+	scope_boxed[j] = true;
+	break;
+      }
+    }
+    j ++;
+  }
+  ok = ok && push_frame(n);
+
+  j = 0;
+  for (VALUE curr = binds; ok && type_of(curr) == PTR_TYPE_CONS; curr = cdr(curr)) {
+    if (rewrite) {
+      UINT code = ((scope_boxed[n + j] ? LEXICAL_INDIRECT : 0) |
+		   slot_path(scope_n - n, j));
+      set_car(car(curr), enc_sym(DEF_REPR_LEXICAL_REF + code));
+    }
+    if (type_of(cdr(car(curr))) == PTR_TYPE_CONS) {
+      ok = resolve(cdr(car(curr)), depth);
+    }
+    j ++;
+  }
+  if (ok && type_of(cdr(cdr(exp))) == PTR_TYPE_CONS) {
+    ok = resolve(cdr(cdr(exp)), depth);
+  }
+  if (ok && rewrite && j > 0) {
+    set_car(exp, enc_sym(symrepr_let_lex()));
+  }
+  scope_n = n;
+  frames_n = f;
+  return ok;
+}
+
+/* Resolves the expression in the car of cell, replacing it if it is a
+   variable in scope */
+static bool resolve(VALUE cell, unsigned int depth) {
+  VALUE exp = car(cell);
+
+  if (is_variable(exp)) {
+    VALUE ref;
+    if (chain_find(exp, &ref)) {
+      if (rewrite) set_car(cell, ref);
+      return true;
+    }
+    // Bound, maybe to not_found, by add_placeholders
+    VALUE binding = env_binding(exp, *env_get_global_ptr());
+    if (rewrite && type_of(binding) == PTR_TYPE_CONS) {
+      set_car(cell, enc_global_ref(binding));
+    }
+    return true;
+  }
+  if (type_of(exp) != PTR_TYPE_CONS) return true;
+  if (depth >= LEXICAL_MAX_DEPTH) return false;
+
+  VALUE head = car(exp);
+  if (type_of(head) == VAL_TYPE_SYMBOL) {
+    UINT sym_id = dec_sym(head);
+
+    // A lambda-lex here is shared with code resolved before
+    if (sym_id == symrepr_quote() ||
+	sym_id == symrepr_lambda_lex()) {
+      return true;
+    }
+    if (sym_id == symrepr_lambda()) {
+      return resolve_lambda(exp, false, depth + 1);
+    }
+    if (sym_id == symrepr_let()) {
+      return resolve_let(exp, depth + 1);
+    }
+    if (sym_id == symrepr_define()) {
+      if (type_of(cdr(exp)) == PTR_TYPE_CONS &&
+	  type_of(cdr(cdr(exp))) == PTR_TYPE_CONS) {
+	return resolve(cdr(cdr(exp)), depth + 1);
+      }
+      return true;
+    }
+  }
+  bool ok = true;
+  for (VALUE curr = exp; ok && type_of(curr) == PTR_TYPE_CONS; curr = cdr(curr)) {
+    ok = resolve(curr, depth + 1);
+  }
+  return ok;
+}
+
+static bool resolve_root(VALUE exp) {
+  scope_n = 0;
+  frames_n = 0;
+  chain_base = 0;
+  free_n = 0;
+  globals_n = 0;
+  cells = 0;
+  return resolve_lambda(exp, true, 0);
+}
+
+void lexical_init(void) {
+  for (unsigned int i = 0; i < LEXICAL_CACHE_SIZE; i ++) {
+    cache[i].src = 0;
+  }
+  cache_next = 0;
+  cache_gc_num = heap_num_gc();
+}
+
+void lexical_mark_cache(void) {
+  for (unsigned int i = 0; i < LEXICAL_CACHE_SIZE; i ++) {
+    if (cache[i].src) {
+      gc_mark_phase(cache[i].src);
+      gc_mark_phase(cache[i].res);
+      gc_mark_phase(cache[i].globals);
+    }
+  }
+  cache_gc_num = heap_num_gc();
+}
+
+void lexical_relocate_cache(void) {
+  for (unsigned int i = 0; i < LEXICAL_CACHE_SIZE; i ++) {
+    if (cache[i].src) {
+      cache[i].src = gc_relocate(cache[i].src);
+      cache[i].res = gc_relocate(cache[i].res);
+      cache[i].globals = gc_relocate(cache[i].globals);
+    }
+  }
+}
+
+// The copy in e resolves the lambda evaluated in env as well
+static bool cache_valid(cache_entry_t *e, VALUE env) {
+  if (e->res == e->src) return true;
+
+  VALUE captures = car(cdr(cdr(cdr(e->res))));
+  for (VALUE curr = captures; type_of(curr) == PTR_TYPE_CONS; curr = cdr(curr)) {
+    if (!env_binds(env, car(curr))) return false;
+  }
+  for (VALUE curr = e->globals; type_of(curr) == PTR_TYPE_CONS; curr = cdr(curr)) {
+    if (env_binds(env, car(curr))) return false;
+  }
+  return true;
+}
+
+static cache_entry_t *cache_find(VALUE exp) {
+  if (cache_gc_num != heap_num_gc()) {
+    lexical_init();
+  }
+  for (unsigned int i = 0; i < LEXICAL_CACHE_SIZE; i ++) {
+    if (cache[i].src == exp) return &cache[i];
+  }
+  return NULL;
+}
+
+static void cache_add(cache_entry_t *e, VALUE exp, VALUE res, VALUE globals) {
+  if (!e) {
+    e = &cache[cache_next];
+    cache_next = (cache_next + 1) % LEXICAL_CACHE_SIZE;
+  }
+  e->src = exp;
+  e->res = res;
+  e->globals = globals;
+}
+
+/* Binds each global that is not defined yet to not_found, for the
+   references to it to point at. Returns false if out of memory. */
+static bool add_placeholders(void) {
+  VALUE *global = env_get_global_ptr();
+
+  for (unsigned int i = 0; i < globals_n; i ++) {
+    if (type_of(env_binding(globals[i], *global)) == PTR_TYPE_CONS) continue;
+
+    VALUE new_env = env_set(*global, globals[i], enc_sym(symrepr_not_found()));
+    if (type_of(new_env) == VAL_TYPE_SYMBOL) {
+      if (dec_sym(new_env) == symrepr_merror()) return false;
+    } else {
+      *global = new_env;
+    }
+  }
+  return true;
+}
+
+/* Resolves the lambda exp evaluated in env into a copy, exp is left
+   unchanged as it may be quoted data. Returns the copy, exp if it
+   cannot be resolved, or merror if the cells for the copy cannot be
+   allocated. */
+VALUE lexical_resolve_lambda(VALUE exp, VALUE env) {
+
+  cache_entry_t *e = cache_find(exp);
+  if (e && cache_valid(e, env)) {
+    return e->res;
+  }
+
+  root_env = env;
+  rewrite = false;
+  if (!resolve_root(exp) ||
+      !count_copy(exp, 0)) {
+    cache_add(e, exp, exp, enc_sym(symrepr_nil()));
+    return exp;
+  }
+
+  if (!add_placeholders()) {
+    return enc_sym(symrepr_merror());
+  }
+
+  pool = enc_sym(symrepr_nil());
+  for (unsigned int i = cells + globals_n; i > 0; i --) {
+    pool = cons(enc_sym(symrepr_nil()), pool);
+    if (type_of(pool) == VAL_TYPE_SYMBOL) {
+      return pool;
+    }
+  }
+
+  VALUE res = copy_exp(exp);
+  rewrite = true;
+  resolve_root(res);
+
+  VALUE names = enc_sym(symrepr_nil());
+  for (unsigned int i = globals_n; i > 0; i --) {
+    VALUE c = take_cell();
+    set_car(c, globals[i - 1]);
+    set_cdr(c, names);
+    names = c;
+  }
+  pool = enc_sym(symrepr_nil());
+  cache_add(e, exp, res, names);
+  return res;
+}
+
+/* The slots of a frame of the n values in vals, see lexical.h. Returns
+   merror if they cannot be allocated. */
+static VALUE make_slots(VALUE *vals, unsigned int n) {
+  if (n == 1) return vals[0];
+
+  unsigned int h = (n + 1) / 2;
+  VALUE first = make_slots(vals, h);
+  if (h > 1 && type_of(first) == VAL_TYPE_SYMBOL) return first;
+  VALUE rest = make_slots(vals + h, n - h);
+  if (n - h > 1 && type_of(rest) == VAL_TYPE_SYMBOL) return rest;
+  return cons(first, rest);
+}
+
+/* A frame of the n values in vals on env, n > 0. Returns merror if it
+   cannot be allocated. */
+VALUE lexical_frame(VALUE *vals, unsigned int n, VALUE env) {
+  VALUE slots = make_slots(vals, n);
+  if (n > 1 && type_of(slots) == VAL_TYPE_SYMBOL) return slots;
+  return cons(slots, env);
+}
+
+/* The frame of the keys of a let-lex on env. The slots are nil, or
+   bindings for the keys referenced indirectly. */
+VALUE lexical_let_frame(VALUE binds, VALUE env) {
+  VALUE vals[LEXICAL_MAX_SLOTS];
+  unsigned int n = 0;
+
+  for (VALUE curr = binds; type_of(curr) == PTR_TYPE_CONS; curr = cdr(curr)) {
+    vals[n] = enc_sym(symrepr_nil());
+    if (is_indirect(car(car(curr)))) {
+      vals[n] = cons(enc_sym(symrepr_nil()), enc_sym(symrepr_nil()));
+      if (type_of(vals[n]) == VAL_TYPE_SYMBOL) return vals[n];
+    }
+    n ++;
+  }
+  if (n == 0) return env;
+  return lexical_frame(vals, n, env);
+}
+
+/* Builds the environment of a closure of the resolved lambda exp
+   evaluated in env, a frame of the variables listed in its captures,
+   or nil if there are none. Bindings captured by name were found in
+   env when exp was resolved. */
+VALUE lexical_capture(VALUE exp, VALUE env) {
+  VALUE vals[LEXICAL_MAX_SLOTS];
+  unsigned int n = 0;
+  VALUE captures = car(cdr(cdr(cdr(exp))));
+
+  for (VALUE curr = captures; type_of(curr) == PTR_TYPE_CONS; curr = cdr(curr)) {
+    VALUE src = car(curr);
+    if (symrepr_is_lexical_ref(dec_sym(src))) {
+      vals[n++] = lexical_slot(src, env);
+    } else {
+      vals[n++] = env_binding(src, env);
+    }
+  }
+  if (n == 0) return enc_sym(symrepr_nil());
+  return lexical_frame(vals, n, enc_sym(symrepr_nil()));
+}
@@ -18,6 +18,8 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
 
 #include "memory.h"
 
@@ -27,26 +29,41 @@
 #define START         2  //10b
 #define START_END     3  //11b
 
-/* States in memory_allocate state-machine*/
-#define INIT                 0
-#define FREE_LENGTH_CHECK    1
-#define SKIP                 2
-#define ALLOC_DONE           0xF00DF00D
-#define ALLOC_FAILED         0xDEADBEAF
+#define NO_FIT               0xFFFFFFFF
+
+/* Size classes */
+#define BIN_MIN_WORDS        2           // Bins for blocks of 2 to 32 words
+#define NUM_BINS             32
+#define BIN_REFILL_WORDS     64          // Carved at a time for an empty bin
+#define BIN_EMPTY            0xFFFFFFFF
+#define BIN_TAG              0xB1FFB1FF  // In the second word of a binned block
 
 uint32_t *bitmap = NULL;
 uint32_t *memory = NULL;
 uint32_t memory_size;  // in 4 byte words
 uint32_t bitmap_size;  // in 4 byte words
-unsigned int memory_base_address = 0;
+uintptr_t memory_base_address = 0;
+
+static bool     size_classes = false;
+static bool     next_fit = false;
+static uint32_t cursor;              // Where a next fit scan begins
+static uint32_t free_words;          // Words not handed out by memory_allocate
+static uint32_t bins[NUM_BINS + 1];  // First free block of each size, as bitmap index
+static uint32_t bin_words;           // Words held in bins
 
 int memory_init(unsigned char *data, uint32_t data_size,
 		unsigned char *bits, uint32_t bits_size) {
+  return memory_init_ext(data, data_size, bits, bits_size, MEMORY_SIZE_CLASSES);
+}
+
+int memory_init_ext(unsigned char *data, uint32_t data_size,
+		    unsigned char *bits, uint32_t bits_size,
+		    uint32_t options) {
 
   if (data == NULL || bits == NULL) return 0;
 
-  if (((unsigned int)data % 4 != 0) || data_size != 16 * bits_size || data_size % 4 != 0 ||
-      ((unsigned int)bits % 4 != 0) || bits_size < 1 || bits_size % 4 != 0) {
+  if (((uintptr_t)data % 4 != 0) || data_size != 16 * bits_size || data_size % 4 != 0 ||
+      ((uintptr_t)bits % 4 != 0) || bits_size < 1 || bits_size % 4 != 0) {
     // data is not 4 byte aligned
     // size is too small
     // or size is not a multiple of 4
@@ -61,17 +78,26 @@ int memory_init(unsigned char *data, uint32_t data_size,
   }
 
   memory = (uint32_t *) data;
-  memory_base_address = (unsigned int)data;
+  memory_base_address = (uintptr_t)data;
   memory_size = data_size >> 2;
+
+  size_classes = (options & MEMORY_SIZE_CLASSES) != 0;
+  next_fit = (options & MEMORY_NEXT_FIT) != 0;
+  cursor = 0;
+  free_words = memory_size;
+  for (unsigned int i = 0; i <= NUM_BINS; i ++) {
+    bins[i] = BIN_EMPTY;
+  }
+  bin_words = 0;
   return 1;
 }
 
 static inline unsigned int address_to_bitmap_ix(uint32_t *ptr) {
-  return ((unsigned int)ptr - memory_base_address) >> 2;
+  return (unsigned int)(((uintptr_t)ptr - memory_base_address) >> 2);
 }
 
 static inline uint32_t *bitmap_ix_to_address(unsigned int ix) {
-  return (uint32_t*)(memory_base_address + (ix << 2));
+  return (uint32_t*)(memory_base_address + ((uintptr_t)ix << 2));
 }
 
 static inline unsigned int status(unsigned int i) {
@@ -95,135 +121,285 @@ static inline void set_status(unsigned int i, uint32_t status) {
   bitmap[word_ix] |= mask;
 }
 
+static void set_block_status(unsigned int ix, uint32_t num_words) {
+  if (num_words == 1) {
+    set_status(ix, START_END);
+  } else {
+    set_status(ix, START);
+    set_status(ix + num_words - 1, END);
+  }
+}
+
 uint32_t memory_num_words(void) {
   return memory_size;
 }
 
-uint32_t memory_num_free(void) {
-  if (memory == NULL || bitmap == NULL) {
-    return 0;
+/* The bitmap is scanned a word, 16 status entries, at a time. Only
+   the entries that are not 00 change the state of a scan, and they
+   are found with ctz. A run of free words is the 00 entries between
+   the end of one allocation and the start of the next. */
+
+// Index of the next entry that is START, END or START_END at or after ix
+static uint32_t next_boundary(uint32_t ix) {
+  uint32_t w = ix >> 4;
+  if (w >= bitmap_size) return NO_FIT;
+
+  uint32_t bits = bitmap[w] & (0xFFFFFFFFu << ((ix & 0xF) << 1));
+  while (bits == 0) {
+    w ++;
+    if (w >= bitmap_size) return NO_FIT;
+    bits = bitmap[w];
+  }
+  return (w << 4) + ((uint32_t)__builtin_ctz(bits) >> 1);
+}
+
+/* Finds the first run of at least num_words free words at or after
+   start, which must not be inside an allocated block. The next fit
+   cursor is left after the block, where it is never inside a block
+   either. */
+static uint32_t *memory_allocate_from(uint32_t start, uint32_t num_words) {
+
+  uint32_t num_entries = bitmap_size << 4;
+  uint32_t run_start = start;
+  uint32_t ix = next_boundary(start);
+
+  for (;;) {
+    uint32_t run_end = (ix == NO_FIT) ? num_entries : ix;
+    if (run_end - run_start >= num_words) break;
+    if (ix == NO_FIT) return NULL;
+
+    if (status(ix) == START) {
+      ix = next_boundary(ix + 1);
+      if (ix == NO_FIT || status(ix) != END) return NULL;
+    }
+    run_start = ix + 1;
+    ix = next_boundary(ix + 1);
+  }
+
+  set_block_status(run_start, num_words);
+  cursor = run_start + num_words;
+  return bitmap_ix_to_address(run_start);
+}
+
+// First fit, or next fit from the cursor if MEMORY_NEXT_FIT
+static uint32_t *memory_allocate_scan(uint32_t num_words) {
+
+  uint32_t *res = NULL;
+
+  if (next_fit && cursor > 0) {
+    res = memory_allocate_from(cursor, num_words);
+  }
+  if (res == NULL) {
+    res = memory_allocate_from(0, num_words);
+  }
+  return res;
+}
+
+/* Size classes: freed blocks of BIN_MIN_WORDS to NUM_BINS words are
+   kept in a free list per size, linked through their first word, and
+   are still marked as allocated in the bitmap. Their second word holds
+   BIN_TAG, which is cleared when they leave the bin. Allocating a small
+   block then takes the first block of its bin, and an empty bin is
+   refilled by carving BIN_REFILL_WORDS words into blocks of its size.
+   When the bitmap has no room for an allocation, the blocks in the
+   bins are given back to it and the allocation is retried. */
+
+static inline bool is_bin_size(uint32_t num_words) {
+  return num_words >= BIN_MIN_WORDS && num_words <= NUM_BINS;
+}
+
+// A block that is tagged as binned, a live block may hold the tag too
+static inline bool is_tagged(unsigned int ix, uint32_t num_words) {
+  return is_bin_size(num_words) && memory[ix + 1] == BIN_TAG;
+}
+
+static bool in_bin(unsigned int ix, uint32_t num_words) {
+  for (uint32_t b = bins[num_words]; b != BIN_EMPTY; b = memory[b]) {
+    if (b == ix) return true;
   }
+  return false;
+}
+
+static void bin_push(unsigned int ix, uint32_t num_words) {
+  memory[ix] = bins[num_words];
+  memory[ix + 1] = BIN_TAG;
+  bins[num_words] = ix;
+  bin_words += num_words;
+}
 
-  unsigned int state = INIT;
-  uint32_t sum_length = 0;
-
-  for (unsigned int i = 0; i < (bitmap_size << 4); i ++) {
-
-    switch(status(i)) {
-    case FREE_OR_USED:
-      switch (state) {
-      case INIT:
-	  state = FREE_LENGTH_CHECK;
-	  sum_length ++;
-	break;
-      case FREE_LENGTH_CHECK:
-	sum_length ++;
-	state = FREE_LENGTH_CHECK;
-	break;
-      case SKIP:
-	break;
-      }
-      break;
-    case END:
-      state = INIT;
-      break;
-    case START:
-      state = SKIP;
-      break;
-    case START_END:
-      state = INIT;
-      break;
-    default:
-      return 0;
-      break;
+static void bins_flush(void) {
+  for (uint32_t n = BIN_MIN_WORDS; n <= NUM_BINS; n ++) {
+    uint32_t ix = bins[n];
+    while (ix != BIN_EMPTY) {
+      set_status(ix, FREE_OR_USED);
+      set_status(ix + n - 1, FREE_OR_USED);
+      memory[ix + 1] = 0;
+      ix = memory[ix];
     }
+    bins[n] = BIN_EMPTY;
   }
-  return sum_length;
+  bin_words = 0;
+}
+
+static uint32_t *bin_allocate(uint32_t num_words) {
+
+  if (bins[num_words] == BIN_EMPTY) {
+    uint32_t n = BIN_REFILL_WORDS / num_words;
+    uint32_t *chunk = memory_allocate_scan(n * num_words);
+    if (chunk == NULL) return NULL;
+
+    unsigned int ix = address_to_bitmap_ix(chunk);
+    for (uint32_t i = n; i > 0; i --) {
+      unsigned int block_ix = ix + (i - 1) * num_words;
+      set_block_status(block_ix, num_words);
+      bin_push(block_ix, num_words);
+    }
+  }
+
+  unsigned int ix = bins[num_words];
+  bins[num_words] = memory[ix];
+  memory[ix + 1] = 0;
+  bin_words -= num_words;
+  return bitmap_ix_to_address(ix);
 }
 
 uint32_t *memory_allocate(uint32_t num_words) {
 
-  if (memory == NULL || bitmap == NULL) {
+  if (memory == NULL || bitmap == NULL || num_words == 0) {
     return NULL;
   }
 
-  uint32_t start_ix = 0;
-  uint32_t end_ix = 0;
-  uint32_t free_length = 0;
-  unsigned int state = INIT;
-
-  for (unsigned int i = 0; i < (bitmap_size << 4); i ++) {
-    if (state == ALLOC_DONE) break;
-
-    switch(status(i)) {
-    case FREE_OR_USED:
-      switch (state) {
-      case INIT:
-	start_ix = i;
-	if (num_words == 1) {
-	  end_ix = i;
-	  state = ALLOC_DONE;
-	} else {
-	  state = FREE_LENGTH_CHECK;
-	  free_length = 1;
-	}
-	break;
-      case FREE_LENGTH_CHECK:
-	free_length ++;
-	if (free_length == num_words) {
-	  end_ix = i;
-	  state = ALLOC_DONE;
-	} else {
-	  state = FREE_LENGTH_CHECK;
-	}
-	break;
-      case SKIP:
-	break;
-      }
-      break;
-    case END:
-      state = INIT;
-      break;
-    case START:
-      state = SKIP;
-      break;
-    case START_END:
-      state = INIT;
-      break;
-    default:
-      return NULL;
-      break;
-    }
+  uint32_t *res = NULL;
+
+  if (size_classes && is_bin_size(num_words)) {
+    res = bin_allocate(num_words);
+  }
+  if (res == NULL) {
+    res = memory_allocate_scan(num_words);
   }
+  if (res == NULL && bin_words > 0) {
+    bins_flush();
+    res = memory_allocate_scan(num_words);
+  }
+  if (res) {
+    free_words -= num_words;
+  }
+  return res;
+}
 
-  if (state == ALLOC_DONE) {
-    if (start_ix == end_ix) {
-      set_status(start_ix, START_END);
-    } else {
-      set_status(start_ix, START);
-      set_status(end_ix, END);
+uint32_t memory_num_free(void) {
+  if (memory == NULL || bitmap == NULL) {
+    return 0;
+  }
+  return free_words;
+}
+
+/* The largest block memory_allocate can hand out right now. The
+   blocks in the bins count as free, as memory_allocate gives them back
+   to the bitmap before it fails. Nothing is changed, the tag is taken
+   to mean that a block is binned. */
+uint32_t memory_longest_free(void) {
+  if (memory == NULL || bitmap == NULL) {
+    return 0;
+  }
+
+  uint32_t num_entries = bitmap_size << 4;
+  uint32_t longest = 0;
+  uint32_t run_start = 0;
+  uint32_t ix = next_boundary(0);
+
+  while (ix != NO_FIT) {
+    uint32_t end = ix;
+    if (status(ix) == START) {
+      end = next_boundary(ix + 1);
+      if (end == NO_FIT || status(end) != END) return 0;
+    }
+    if (!(size_classes && is_tagged(ix, end - ix + 1))) {
+      if (ix - run_start > longest) longest = ix - run_start;
+      run_start = end + 1;
     }
-    return bitmap_ix_to_address(start_ix);
+    ix = next_boundary(end + 1);
   }
-  return NULL;
+  if (num_entries - run_start > longest) longest = num_entries - run_start;
+  return longest;
 }
 
 int memory_free(uint32_t *ptr) {
   unsigned int ix = address_to_bitmap_ix(ptr);
   switch(status(ix)) {
-  case START:
-    set_status(ix, FREE_OR_USED);
-    for (unsigned int i = ix; i < (bitmap_size << 4); i ++) {
-      if (status(i) == END) {
-	set_status(i, FREE_OR_USED);
-	return 1;
-      }
+  case START: {
+    uint32_t end = next_boundary(ix + 1);
+    if (end == NO_FIT || status(end) != END) return 0;
+    uint32_t num_words = end - ix + 1;
+    if (size_classes && is_bin_size(num_words)) {
+      // Freed twice, the block is still in its bin
+      if (is_tagged(ix, num_words) && in_bin(ix, num_words)) return 0;
+      bin_push(ix, num_words);
+    } else {
+      set_status(ix, FREE_OR_USED);
+      set_status(end, FREE_OR_USED);
     }
-    return 0;
+    free_words += num_words;
+    return 1;
+  }
   case START_END:
     set_status(ix, FREE_OR_USED);
+    free_words ++;
     return 1;
   }
 
   return 0;
 }
+
+// Word offset of an allocation, 32 bits also with 64 bit pointers
+uint32_t memory_offset(uint32_t *ptr) {
+  return address_to_bitmap_ix(ptr);
+}
+
+uint32_t *memory_address(uint32_t offset) {
+  return bitmap_ix_to_address(offset);
+}
+
+/* Slides the blocks that movable accepts towards the beginning of
+   the memory, in address order, and calls moved for every block that
+   was moved. Other blocks stay where they are and the blocks after
+   them slide up against them. movable is called with increasing
+   addresses. */
+int memory_compact(bool (*movable)(uint32_t *ptr),
+		   void (*moved)(uint32_t *from, uint32_t *to)) {
+
+  if (memory == NULL || bitmap == NULL) {
+    return 0;
+  }
+
+  bins_flush();
+
+  uint32_t dest = 0;
+  uint32_t ix = next_boundary(0);
+
+  while (ix != NO_FIT) {
+    uint32_t end = ix;
+    if (status(ix) == START) {
+      end = next_boundary(ix + 1);
+      if (end == NO_FIT || status(end) != END) return 0;
+    }
+    uint32_t num_words = end - ix + 1;
+    uint32_t *from = bitmap_ix_to_address(ix);
+
+    if (dest < ix && movable(from)) {
+      uint32_t *to = bitmap_ix_to_address(dest);
+      set_status(ix, FREE_OR_USED);
+      set_status(end, FREE_OR_USED);
+      memmove(to, from, num_words * sizeof(uint32_t));
+      set_block_status(dest, num_words);
+      moved(from, to);
+      dest += num_words;
+    } else {
+      dest = end + 1;
+    }
+    ix = next_boundary(end + 1);
+  }
+
+  cursor = 0;
+  return 1;
+}
@@ -51,7 +51,7 @@ int print_value(char *buf,int len, char *error, int len_error, VALUE t) {
   while (!stack_is_empty(&s) && offset <= len - 5) {
     
     VALUE curr;
-    UINT  instr;
+    VALUE instr;
     pop_u32(&s, &instr);
 
     switch(instr) {
@@ -150,39 +150,49 @@ int print_value(char *buf,int len, char *error, int len_error, VALUE t) {
 	break;
       }
 
+      case PTR_TYPE_GLOBAL_REF:
+	// Printed as the name of the variable
+	if (!push_u32_2(&s, car(dec_global_ref(curr)), PRINT)) {
+	  snprintf(error, len_error, "Error: Out of print stack\n");
+	  return -1;
+	}
+	break;
+
       case PTR_TYPE_REF:
 	n = snprintf(buf + offset, len - offset, "_ref_");
 	offset += n;
 	break;
 
+      case PTR_TYPE_BYTECODE:
+	n = snprintf(buf + offset, len - offset, "_bytecode_");
+	offset += n;
+	break;
+
       case PTR_TYPE_BOXED_F: {
-	VALUE uv = car(curr);
-	float v;
-	memcpy(&v, &uv, sizeof(float)); // = *(float*)(&uv);
+	float v = dec_f(curr);
 	n = snprintf(buf + offset, len - offset, "{%"PRI_FLOAT"}", v);
 	offset += n;
 	break;
       }
 	
       case PTR_TYPE_BOXED_U: {
-	VALUE v = car(curr);
+	UINT v = dec_U(curr);
 	n = snprintf(buf + offset, len - offset, "{%"PRI_UINT"}", v);
 	offset += n;
 	break;
       }
 	
       case PTR_TYPE_BOXED_I: {
-	int32_t v = (int32_t)car(curr);
+	INT v = dec_I(curr);
 	n = snprintf(buf + offset, len - offset, "{%"PRI_INT"}", v);
 	offset += n;
 	break;
       }
 	
       case PTR_TYPE_ARRAY: {
-	array_header_t *array = (array_header_t *)car(curr);
-	switch (array->elt_type){
+	switch (array_elt_type(curr)){
 	case VAL_TYPE_CHAR:
-	  n = snprintf(buf + offset, len - offset, "\"%s\"", (char *)(array)+8);
+	  n = snprintf(buf + offset, len - offset, "\"%s\"", (char *)array_data(curr));
 	  offset += n;
 	  break;
 	  break;
@@ -200,6 +210,12 @@ int print_value(char *buf,int len, char *error, int len_error, VALUE t) {
       }
 	
       case VAL_TYPE_SYMBOL:
+	if (symrepr_is_lexical_ref(dec_sym(curr))) {
+	  n = snprintf(buf + offset, len - offset, "lex_%"PRI_UINT"",
+		       dec_sym(curr) - DEF_REPR_LEXICAL_REF);
+	  offset += n;
+	  break;
+	}
 	str_ptr = symrepr_lookup_name(dec_sym(curr));
 	if (str_ptr == NULL) {
 	  
@@ -226,7 +242,7 @@ int print_value(char *buf,int len, char *error, int len_error, VALUE t) {
 	break;
 	
       default:
-	snprintf(error, len_error, "Error: print does not recognize type of value: %"PRIx32"", curr);
+	snprintf(error, len_error, "Error: print does not recognize type of value: %"PRI_HEX_VALUE"", curr);
 	return -1;
 	break;
       } // Switch type of curr
@@ -31,17 +31,39 @@
 #include "qq_expand.h"
 
 
+/* Allocation failures are propagated as error symbols so that the
+   parser can collect garbage and retry the expansion. */
+static inline bool is_error(VALUE v) {
+  return (type_of(v) == VAL_TYPE_SYMBOL &&
+	  symrepr_is_error(dec_sym(v)));
+}
+
+// (sym a b)
+static VALUE list3(VALUE sym, VALUE a, VALUE b) {
+  if (is_error(a)) return a;
+  if (is_error(b)) return b;
+  VALUE r = cons(b, enc_sym(symrepr_nil()));
+  if (is_error(r)) return r;
+  r = cons(a, r);
+  if (is_error(r)) return r;
+  return cons(sym, r);
+}
+
+// (sym a)
+static VALUE list2(VALUE sym, VALUE a) {
+  if (is_error(a)) return a;
+  VALUE r = cons(a, enc_sym(symrepr_nil()));
+  if (is_error(r)) return r;
+  return cons(sym, r);
+}
+
 VALUE gen_cons(VALUE a, VALUE b) {
-  return cons(enc_sym(symrepr_cons()),
-		   cons(a,
-			cons(b, enc_sym(symrepr_nil()))));
+  return list3(enc_sym(symrepr_cons()), a, b);
 }
 
 
 VALUE append(VALUE front, VALUE back) {
-  return cons (enc_sym(symrepr_append()),
-	       cons(front,
-		    cons(back, enc_sym(symrepr_nil()))));
+  return list3(enc_sym(symrepr_append()), front, back);
 }
 
 /* Bawden's qq-expand-list implementation
@@ -72,22 +94,20 @@ VALUE qq_expand_list(VALUE l) {
     cdr_val = cdr(l);
     if (type_of(car_val) == VAL_TYPE_SYMBOL &&
 	dec_sym(car_val) == symrepr_comma()) {
-      res = cons(enc_sym(symrepr_list()),
-		 cons(car(cdr_val), res));
+      res = list2(enc_sym(symrepr_list()), car(cdr_val));
     } else if (type_of(car_val) == VAL_TYPE_SYMBOL &&
 	       dec_sym(car_val) == symrepr_commaat()) {
       res = car(cdr_val);
     } else {
       VALUE expand_car = qq_expand_list(car_val);
+      if (is_error(expand_car)) return expand_car;
       VALUE expand_cdr = qq_expand(cdr_val);
-      res = cons(enc_sym(symrepr_list()),
-		 cons(append(expand_car, expand_cdr), enc_sym(symrepr_nil())));
+      res = list2(enc_sym(symrepr_list()), append(expand_car, expand_cdr));
     }
     break;
   default: {
     VALUE a_list = cons(l, enc_sym(symrepr_nil()));
-    res =
-      cons(enc_sym(symrepr_quote()), cons (a_list, enc_sym(symrepr_nil())));
+    res = list2(enc_sym(symrepr_quote()), a_list);
   }
   }
   return res;
@@ -127,12 +147,13 @@ VALUE qq_expand(VALUE qquoted) {
       res = enc_sym(symrepr_rerror()); // should have a more specific error here. 
     } else {
       VALUE expand_car = qq_expand_list(car_val);
+      if (is_error(expand_car)) return expand_car;
       VALUE expand_cdr = qq_expand(cdr_val);
       res = append(expand_car, expand_cdr);
     }
     break;
   default:
-    res = cons(enc_sym(symrepr_quote()), cons(qquoted, enc_sym(symrepr_nil())));
+    res = list2(enc_sym(symrepr_quote()), qquoted);
     break;
   }
   return res;
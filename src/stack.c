@@ -23,7 +23,7 @@
 
 int stack_allocate(stack *s, unsigned int stack_size, bool growable) {
   
-  s->data = malloc(sizeof(UINT) * stack_size);
+  s->data = malloc(sizeof(VALUE) * stack_size);
   s->sp = 0;
   s->size = stack_size;
   s->growable = growable;
@@ -32,7 +32,7 @@ int stack_allocate(stack *s, unsigned int stack_size, bool growable) {
   return 0;
 }
 
-int stack_create(stack *s, UINT* data, unsigned int size) {
+int stack_create(stack *s, VALUE* data, unsigned int size) {
   s->data = data;
   s->sp = 0;
   s->size = size;
@@ -57,11 +57,11 @@ int stack_grow(stack *s) {
   if (!s->growable) return 0;
   
   unsigned int new_size = s->size * 2;
-  UINT *data    = malloc(sizeof(UINT) * new_size);
+  VALUE *data    = malloc(sizeof(VALUE) * new_size);
 
   if (data == NULL) return 0;
 
-  memcpy(data, s->data, s->size*sizeof(UINT));
+  memcpy(data, s->data, s->size*sizeof(VALUE));
   free(s->data);
   s->data = data;
   s->size = new_size;
@@ -77,12 +77,12 @@ int stack_copy(stack *dest, stack *src) {
   }
   if (dest->size < src->size) return 0;
   dest->sp = src->sp;
-  memcpy(dest->data, src->data, src->sp * sizeof(UINT));
+  memcpy(dest->data, src->data, src->sp * sizeof(VALUE));
 
   return 1;
 }
 
-UINT *stack_ptr(stack *s, unsigned int n) {
+VALUE *stack_ptr(stack *s, unsigned int n) {
   if (n > s->sp) return NULL;
   int index = s->sp - n;
   return &s->data[index]; 
@@ -96,7 +96,7 @@ int stack_drop(stack *s, unsigned int n) {
   return 1;
 }
 
-int push_u32(stack *s, UINT val) {
+int push_u32(stack *s, VALUE val) {
   int res = 1;
   if (s->sp == s->size) {
     res = stack_grow(s);
@@ -112,7 +112,7 @@ int push_u32(stack *s, UINT val) {
 
 int push_k(stack *s, VALUE (*k)(VALUE)) {
   int res = 1;
-  s->data[s->sp] = (UINT)k;
+  s->data[s->sp] = (VALUE)k;
   s->sp++;
   if ( s->sp >= s->size) {
     res = stack_grow(s);
@@ -120,7 +120,7 @@ int push_k(stack *s, VALUE (*k)(VALUE)) {
   return res;
 }
 
-int pop_u32(stack *s, UINT *val) {
+int pop_u32(stack *s, VALUE *val) {
 
   s->sp--;
   *val = s->data[s->sp];
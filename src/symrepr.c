@@ -24,11 +24,7 @@
 #include "symrepr.h"
 #include "memory.h"
 
-#define NUM_SPECIAL_SYMBOLS 67
-
-#define NAME   0
-#define ID     1
-#define NEXT   2
+#define NUM_SPECIAL_SYMBOLS 71
 
 typedef struct {
   const char *name;
@@ -48,6 +44,9 @@ special_sym const special_symbols[NUM_SPECIAL_SYMBOLS] =  {
   //{"bquote"     , DEF_REPR_BACKQUOTE},
   {"comma"      , DEF_REPR_COMMA},
   {"splice"     , DEF_REPR_COMMAAT},
+  {"lambda-lex" , DEF_REPR_LAMBDA_LEX},
+  {"let-lex"    , DEF_REPR_LET_LEX},
+  {"closure-lex", DEF_REPR_CLOSURE_LEX},
   
   // Special symbols with unparseable names
   {"read_error"         , DEF_REPR_RERROR},
@@ -55,6 +54,7 @@ special_sym const special_symbols[NUM_SPECIAL_SYMBOLS] =  {
   {"eval_error"         , DEF_REPR_EERROR},
   {"out_of_memory"      , DEF_REPR_MERROR},
   {"fatal_error"        , DEF_REPR_FATAL_ERROR},
+  {"depth_error"        , DEF_REPR_DEPTH_ERROR},
   {"division_by_zero"   , DEF_REPR_DIVZERO},
   {"sym_array"          , DEF_REPR_ARRAY_TYPE},
   {"sym_boxed_i"        , DEF_REPR_BOXED_I_TYPE},
@@ -113,32 +113,136 @@ special_sym const special_symbols[NUM_SPECIAL_SYMBOLS] =  {
 };
 
 
-uint32_t *symlist = NULL;
-UINT next_symbol_id = 0;
+/* Index of the special symbols, sorted by name and by id, built by
+   symrepr_init and searched using binary search. */
+static uint8_t special_by_name[NUM_SPECIAL_SYMBOLS];
+static uint8_t special_by_id[NUM_SPECIAL_SYMBOLS];
+
+/* User defined symbols:
+   symbol_names is a dense array of the symbol names, as 32 bit word
+   offsets into the memory arena (see memory_offset), indexed by
+   (id - MAX_SPECIAL_SYMBOLS). Offsets rather than pointers keep the
+   array 4 byte aligned, as memory_allocate is, with 64 bit pointers.
+   symbol_table is an open addressing (linear probing) hash table
+   mapping names to ids. A slot holds index + 1, 0 is an empty slot.
+   Both are allocated from the memory arena and grow by doubling. */
+#define SYMBOL_TABLE_INIT_SIZE  32  // must be a power of two
+#define SYMBOL_NAMES_INIT_SIZE  16
+
+static uint32_t *symbol_table = NULL;
+static unsigned int symbol_table_size = 0;
+static uint32_t *symbol_names = NULL;
+static unsigned int symbol_names_size = 0;
+static UINT next_symbol_id = 0;
+
+static inline char *symbol_name(UINT i) {
+  return (char *)memory_address(symbol_names[i]);
+}
+
+static void sort_special(uint8_t *ix, bool by_name) {
+  // Insertion sort, the table is small and this is done once.
+  for (int i = 0; i < NUM_SPECIAL_SYMBOLS; i ++) {
+    ix[i] = (uint8_t)i;
+  }
+  for (int i = 1; i < NUM_SPECIAL_SYMBOLS; i ++) {
+    uint8_t v = ix[i];
+    int j = i - 1;
+    while (j >= 0 &&
+	   (by_name ?
+	    strcmp(special_symbols[ix[j]].name, special_symbols[v].name) > 0 :
+	    special_symbols[ix[j]].id > special_symbols[v].id)) {
+      ix[j + 1] = ix[j];
+      j --;
+    }
+    ix[j + 1] = v;
+  }
+}
 
 bool symrepr_init(void) {
+  sort_special(special_by_name, true);
+  sort_special(special_by_id, false);
+
+  symbol_table = NULL;
+  symbol_table_size = 0;
+  symbol_names = NULL;
+  symbol_names_size = 0;
+  next_symbol_id = 0;
   return true;
 }
 
 void symrepr_del(void) {
 
-  uint32_t *curr = symlist;
-  while (curr) {
-    uint32_t *tmp = curr; 
-    curr = (uint32_t*)curr[NEXT];
-    memory_free((uint32_t*)tmp[NAME]);
-    memory_free(tmp);
+  for (UINT i = 0; i < next_symbol_id; i ++) {
+    memory_free(memory_address(symbol_names[i]));
+  }
+  if (symbol_names) memory_free(symbol_names);
+  if (symbol_table) memory_free(symbol_table);
+
+  symbol_table = NULL;
+  symbol_table_size = 0;
+  symbol_names = NULL;
+  symbol_names_size = 0;
+  next_symbol_id = 0;
+}
+
+// FNV-1a
+static uint32_t hash_string(const char *str) {
+  uint32_t h = 2166136261u;
+  while (*str) {
+    h ^= (uint8_t)*str++;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+// Returns the slot holding name, or the empty slot where it belongs.
+static unsigned int find_slot(const char *name) {
+  unsigned int mask = symbol_table_size - 1;
+  unsigned int i = hash_string(name) & mask;
+
+  while (symbol_table[i]) {
+    if (strcmp(symbol_name(symbol_table[i] - 1), name) == 0) break;
+    i = (i + 1) & mask;
+  }
+  return i;
+}
+
+static bool grow_symbol_table(void) {
+  unsigned int size = symbol_table_size ? symbol_table_size * 2 : SYMBOL_TABLE_INIT_SIZE;
+  uint32_t *table = memory_allocate(size);
+  if (table == NULL) return false;
+  memset(table, 0, size * sizeof(uint32_t));
+
+  if (symbol_table) memory_free(symbol_table);
+  symbol_table = table;
+  symbol_table_size = size;
+
+  for (UINT i = 0; i < next_symbol_id; i ++) {
+    symbol_table[find_slot(symbol_name(i))] = i + 1;
+  }
+  return true;
+}
+
+static bool grow_symbol_names(void) {
+  unsigned int size = symbol_names_size ? symbol_names_size * 2 : SYMBOL_NAMES_INIT_SIZE;
+  uint32_t *names = memory_allocate(size);
+  if (names == NULL) return false;
+
+  if (symbol_names) {
+    memcpy(names, symbol_names, symbol_names_size * sizeof(uint32_t));
+    memory_free(symbol_names);
   }
+  symbol_names = names;
+  symbol_names_size = size;
+  return true;
 }
 
 const char *lookup_symrepr_name_memory(UINT id) {
 
-  uint32_t *curr = symlist;
-  while (curr) {
-    if (id == curr[ID]) {
-      return (const char *)curr[NAME];
-    }
-    curr = (uint32_t*)curr[NEXT];
+  if (id < MAX_SPECIAL_SYMBOLS) return NULL;
+  id -= MAX_SPECIAL_SYMBOLS;
+  if (id < next_symbol_id) {
+    return symbol_name(id);
   }
   return NULL;
 }
@@ -146,11 +250,16 @@ const char *lookup_symrepr_name_memory(UINT id) {
 // Lookup symbol name given a symbol id
 const char *symrepr_lookup_name(UINT id) {
   if (id < MAX_SPECIAL_SYMBOLS) {
-    for (int i = 0; i < NUM_SPECIAL_SYMBOLS; i ++) {
-      if (id == special_symbols[i].id) {
-	return (special_symbols[i].name);
-      }
-    } 
+    int lo = 0;
+    int hi = NUM_SPECIAL_SYMBOLS - 1;
+    while (lo <= hi) {
+      int mid = (lo + hi) / 2;
+      UINT mid_id = special_symbols[special_by_id[mid]].id;
+      if (mid_id == id) return special_symbols[special_by_id[mid]].name;
+      if (mid_id < id) lo = mid + 1;
+      else hi = mid - 1;
+    }
+    return NULL;
   }
   return lookup_symrepr_name_memory(id);
 }
@@ -158,22 +267,26 @@ const char *symrepr_lookup_name(UINT id) {
 // Lookup symbol id given symbol name
 int symrepr_lookup(char *name, UINT* id) {
 
-  // loop through special symbols
-  for (int i = 0; i < NUM_SPECIAL_SYMBOLS; i ++) {
-    if (strcmp(name, special_symbols[i].name) == 0) {
-      *id = special_symbols[i].id;
+  // binary search the special symbols
+  int lo = 0;
+  int hi = NUM_SPECIAL_SYMBOLS - 1;
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+    int c = strcmp(name, special_symbols[special_by_name[mid]].name);
+    if (c == 0) {
+      *id = special_symbols[special_by_name[mid]].id;
       return 1;
     }
+    if (c > 0) lo = mid + 1;
+    else hi = mid - 1;
   }
 
-  uint32_t *curr = symlist;
-  while (curr) {
-    char *str = (char*)curr[NAME];
-    if (strcmp(name, str) == 0) {
-      *id = curr[ID];
-      return 1;
-    }
-    curr = (uint32_t*)curr[NEXT];
+  if (symbol_table == NULL) return 0;
+
+  uint32_t ix = symbol_table[find_slot(name)];
+  if (ix) {
+    *id = MAX_SPECIAL_SYMBOLS + ix - 1;
+    return 1;
   }
   return 0;
 }
@@ -184,52 +297,40 @@ int symrepr_addsym(char *name, UINT* id) {
   n = strlen(name) + 1;
   if (n == 1) return 0; // failure if empty symbol
 
-  uint32_t *m = memory_allocate(3);
-
-  if (m == NULL) {
+  if (next_symbol_id == symbol_names_size &&
+      !grow_symbol_names()) {
     return 0;
   }
 
-  char *symbol_name_storage = NULL;;
-  if (n % 4 == 0) {
-    symbol_name_storage = (char *)memory_allocate(n);
-  } else {
-    symbol_name_storage = (char *)memory_allocate(n);
+  // Keep the load factor of the hash table below 1/2
+  if (2 * (next_symbol_id + 1) > symbol_table_size &&
+      !grow_symbol_table()) {
+    return 0;
   }
 
+  char *symbol_name_storage = (char *)memory_allocate((uint32_t)((n + 3) / 4));
   if (symbol_name_storage == NULL) {
-    memory_free(m);
     return 0;
   }
 
   strcpy(symbol_name_storage, name);
 
-  m[NAME] = (uint32_t)symbol_name_storage;
-  
-  if (symlist == NULL) {
-    m[NEXT] = (uint32_t) NULL;
-    symlist = m;
-  } else {
-    m[NEXT] = (uint32_t) symlist;
-    symlist = m;
-  }
-  m[ID] = MAX_SPECIAL_SYMBOLS + next_symbol_id++; 
-  *id = m[ID];
+  symbol_names[next_symbol_id] = memory_offset((uint32_t *)symbol_name_storage);
+  symbol_table[find_slot(name)] = next_symbol_id + 1;
+
+  *id = MAX_SPECIAL_SYMBOLS + next_symbol_id++;
   return 1;
 }
 
 unsigned int symrepr_size(void) {
 
   unsigned int n = 0;
-  uint32_t *curr = symlist;
-
-  while (curr) {
-    // up to 3 extra bytes are used for string storage if length is not multiple of 4
-    size_t s = strlen((char *)curr[NAME]);
-    s ++;
-    n += s % 4;
-    n += 12; // sizeof the node in the linked list
-    curr = (uint32_t *)curr[NEXT];
+
+  for (UINT i = 0; i < next_symbol_id; i ++) {
+    // string storage is rounded up to whole words
+    n += (unsigned int)((strlen(symbol_name(i)) + 4) & ~(size_t)3);
   }
+  n += symbol_table_size * (unsigned int)sizeof(uint32_t);
+  n += symbol_names_size * (unsigned int)sizeof(uint32_t);
   return n;
 }
@@ -29,6 +29,7 @@
 #include "qq_expand.h"
 #include "memory.h"
 #include "env.h"
+#include "stack.h"
 
 #define TOKOPENPAR      0
 #define TOKCLOSEPAR     1
@@ -76,12 +77,62 @@ typedef struct tcs{
   void (*drop)(struct tcs, unsigned int);
 } tokenizer_char_stream;
 
-// Todo: Try to figure out how to do GC while reading
-static int gc() {
+#define TOKPAR_MAX_ROOTS 4
+
+typedef struct {
+  void (*mark)(void);
+  void (*relocate)(void);
+} roots_callbacks_t;
+
+static roots_callbacks_t roots_callbacks[TOKPAR_MAX_ROOTS];
+static unsigned int num_roots_callbacks = 0;
+
+int tokpar_add_roots_callbacks(void (*mark)(void), void (*relocate)(void)) {
+  for (unsigned int i = 0; i < num_roots_callbacks; i ++) {
+    if (roots_callbacks[i].mark == mark) {
+      roots_callbacks[i].relocate = relocate;
+      return 1;
+    }
+  }
+  if (num_roots_callbacks == TOKPAR_MAX_ROOTS) return 0;
+  roots_callbacks[num_roots_callbacks].mark = mark;
+  roots_callbacks[num_roots_callbacks].relocate = relocate;
+  num_roots_callbacks ++;
+  return 1;
+}
+
+static stack *gc_parse_stack;  // The parser state that relocate_parse_roots updates
+static VALUE *gc_parse_value;
+
+static void relocate_parse_roots(void) {
+  VALUE *env = env_get_global_ptr();
+  *env = gc_relocate(*env);
+  gc_relocate_aux(gc_parse_stack->data, gc_parse_stack->sp);
+  *gc_parse_value = gc_relocate(*gc_parse_value);
+  for (unsigned int i = 0; i < num_roots_callbacks; i ++) {
+    roots_callbacks[i].relocate();
+  }
+}
+
+// GC while reading. The partial results are all reachable from the
+// parser stack or from the value currently being processed, which
+// compaction may move.
+static int gc(stack *s, VALUE *v) {
   gc_state_inc();
   gc_mark_freelist();
   gc_mark_phase(*env_get_global_ptr());
-  return gc_sweep_phase();
+  gc_mark_aux(s->data, s->sp);
+  gc_mark_phase(*v);
+
+  bool relocatable = true;
+  for (unsigned int i = 0; i < num_roots_callbacks; i ++) {
+    roots_callbacks[i].mark();
+    if (!roots_callbacks[i].relocate) relocatable = false;
+  }
+
+  gc_parse_stack = s;
+  gc_parse_value = v;
+  return gc_compact_phase(relocatable ? relocate_parse_roots : NULL);
 }
 
 bool more(tokenizer_char_stream str) {
@@ -508,41 +559,40 @@ token next_token(tokenizer_char_stream str) {
   return t;
 }
 
-VALUE parse_sexp(token tok, tokenizer_char_stream str);
-VALUE parse_sexp_list(token tok, tokenizer_char_stream str);
+/* The parser keeps its state on an explicit stack rather than the
+   C stack. Each open list has a frame of three words
+   [first, last, PARSE_LIST] where first and last are the first
+   and last cells of the list built so far. The top level program
+   is a list frame tagged PARSE_PROGRAM. Quote, backquote, comma
+   and comma-at push a single tag that is applied to the next
+   complete expression. Tags are stored as encoded integers so that
+   the stack can be used as a GC root.
 
-VALUE parse_program(tokenizer_char_stream str) {
-  token tok = next_token(str);
-  VALUE head;
-  VALUE tail;
+   The stack starts at PARSE_STACK_SIZE words and grows by doubling,
+   up to PARSE_MAX_STACK_SIZE words. Nesting deeper than that, about a
+   third as many levels, is a depth_error.
 
-  if (tok.type == TOKENIZER_ERROR) {
-    return enc_sym(symrepr_rerror());
-  }
-
-  if (tok.type == TOKENIZER_END) {
-    return enc_sym(symrepr_nil());
-  }
+   If an allocation fails, garbage is collected and the allocation
+   is retried once before giving up with out_of_memory. */
+#define PARSE_STACK_SIZE 256
 
-  head = parse_sexp(tok, str);
-  tail = parse_program(str);
+#ifndef PARSE_MAX_STACK_SIZE
+#define PARSE_MAX_STACK_SIZE 12288 /* 4096 levels of lists */
+#endif
 
-  return cons(head, tail);
-}
+#define PARSE_PROGRAM    0
+#define PARSE_LIST       1
+#define PARSE_QUOTE      2
+#define PARSE_BACKQUOTE  3
+#define PARSE_COMMA      4
+#define PARSE_COMMAAT    5
 
-VALUE parse_sexp(token tok, tokenizer_char_stream str) {
+// Does not free the token text, the caller does that.
+static VALUE parse_atom(token tok) {
 
   VALUE v;
-  token t;
 
   switch (tok.type) {
-  case TOKENIZER_END:
-    return enc_sym(symrepr_rerror());
-  case TOKENIZER_ERROR:
-    return enc_sym(symrepr_rerror());
-  case TOKOPENPAR:
-    t = next_token(str);
-    return parse_sexp_list(t,str);
   case TOKSYMBOL: {
     UINT symbol_id;
 
@@ -554,16 +604,12 @@ VALUE parse_sexp(token tok, tokenizer_char_stream str) {
     } else {
       v = enc_sym(symrepr_rerror());
     }
-    free(tok.data.text);
     return v;
   }
   case TOKSTRING: {
-    heap_allocate_array(&v, tok.text_len+1, VAL_TYPE_CHAR);
-    array_header_t *arr = (array_header_t*)car(v);
-    char *data = (char *)arr + 8;
-    memset(data, 0, (tok.text_len+1) * sizeof(char));
-    memcpy(data, tok.data.text, tok.text_len * sizeof(char));
-    free(tok.data.text);
+    if (!heap_intern_string(&v, tok.data.text, tok.text_len)) {
+      return enc_sym(symrepr_merror());
+    }
     return v;
   }
   case TOKINT:
@@ -573,71 +619,154 @@ VALUE parse_sexp(token tok, tokenizer_char_stream str) {
   case TOKCHAR:
     return enc_char(tok.data.c);
   case TOKBOXEDINT:
-    return set_ptr_type(cons(tok.data.i, enc_sym(DEF_REPR_BOXED_I_TYPE)), PTR_TYPE_BOXED_I);
+    return enc_I(tok.data.i);
   case TOKBOXEDUINT:
-    return set_ptr_type(cons(tok.data.u, enc_sym(DEF_REPR_BOXED_U_TYPE)), PTR_TYPE_BOXED_U);
+    return enc_U(tok.data.u);
   case TOKBOXEDFLOAT:
-    return set_ptr_type(cons(tok.data.u, enc_sym(DEF_REPR_BOXED_F_TYPE)), PTR_TYPE_BOXED_F);
-  case TOKQUOTE: {
-    t = next_token(str);
-    VALUE quoted = parse_sexp(t, str);
-    if (type_of(quoted) == VAL_TYPE_SYMBOL &&
-	dec_sym(quoted) == symrepr_rerror()) return quoted;
-    return cons(enc_sym(symrepr_quote()), cons (quoted, enc_sym(symrepr_nil()))); 
-  }
-  case TOKBACKQUOTE: {
-    t = next_token(str);
-    VALUE quoted = parse_sexp(t, str);
-    if (type_of(quoted) == VAL_TYPE_SYMBOL &&
-	dec_sym(quoted) == symrepr_rerror()) return quoted;
-    VALUE expanded = qq_expand(quoted);
-    if (type_of(expanded) == VAL_TYPE_SYMBOL &&
-	symrepr_is_error(dec_sym(expanded))) return expanded;
-    return expanded;
-  }
-  case TOKCOMMAAT: {
-    t = next_token(str);
-    VALUE splice = parse_sexp(t, str);
-    if (type_of(splice) == VAL_TYPE_SYMBOL &&
-	dec_sym(splice) == symrepr_rerror()) return splice;
-    return cons(enc_sym(symrepr_commaat()), cons (splice, enc_sym(symrepr_nil())));
-  }
-  case TOKCOMMA: {
-    t = next_token(str);
-    VALUE unquoted = parse_sexp(t, str);
-    if (type_of(unquoted) == VAL_TYPE_SYMBOL &&
-	dec_sym(unquoted) == symrepr_rerror()) return unquoted;
-    return cons(enc_sym(symrepr_comma()), cons (unquoted, enc_sym(symrepr_nil()))); 
-  }
+    return enc_F(tok.data.f);
   }
   return enc_sym(symrepr_rerror());
 }
 
-VALUE parse_sexp_list(token tok, tokenizer_char_stream str) {
+// (sym v)
+static VALUE list2(UINT sym, VALUE v) {
+  VALUE tail = cons(v, enc_sym(symrepr_nil()));
+  if (type_of(tail) == VAL_TYPE_SYMBOL) return tail;
+  return cons(enc_sym(sym), tail);
+}
 
-  token t;
-  VALUE head;
-  VALUE tail;
+static VALUE parse_apply_tag(UINT tag, VALUE v) {
+  switch (tag) {
+  case PARSE_QUOTE:
+    return list2(symrepr_quote(), v);
+  case PARSE_BACKQUOTE:
+    return qq_expand(v);
+  case PARSE_COMMA:
+    return list2(symrepr_comma(), v);
+  case PARSE_COMMAAT:
+    return list2(symrepr_commaat(), v);
+  }
+  return enc_sym(symrepr_fatal_error());
+}
 
-  switch (tok.type) {
-  case TOKENIZER_END:
-    return enc_sym(symrepr_rerror());
-  case TOKENIZER_ERROR:
-    return enc_sym(symrepr_rerror());
-  case TOKCLOSEPAR:
-    return enc_sym(symrepr_nil());
-  default:
-    head = parse_sexp(tok, str);
-    t = next_token(str);
-    tail = parse_sexp_list(t, str);
-    if ((type_of(head) == VAL_TYPE_SYMBOL &&
-	 dec_sym(head) == symrepr_rerror() ) ||
-	(type_of(tail) == VAL_TYPE_SYMBOL &&
-	 dec_sym(tail) == symrepr_rerror() )) return enc_sym(symrepr_rerror());
-    return cons(head, tail);
+/* Pushes a frame of n words, nil and then tag. Returns nil, or the
+   error if the stack cannot hold it. */
+static VALUE parse_push(stack *s, unsigned int n, UINT tag) {
+  VALUE nil = enc_sym(symrepr_nil());
+
+  if (s->sp + n > PARSE_MAX_STACK_SIZE) {
+    return enc_sym(symrepr_depth_error());
   }
+  for (unsigned int i = 1; i < n; i ++) {
+    if (!push_u32(s, nil)) return enc_sym(symrepr_merror());
+  }
+  if (!push_u32(s, enc_u(tag))) return enc_sym(symrepr_merror());
+  return nil;
+}
 
-  return enc_sym(symrepr_rerror());
+static VALUE parse(tokenizer_char_stream str, stack *s) {
+
+  VALUE nil = enc_sym(symrepr_nil());
+  VALUE v;
+  UINT tag;
+  token tok;
+
+  v = parse_push(s, 3, PARSE_PROGRAM);
+  if (v != nil) return v;
+
+  while (true) {
+    tok = next_token(str);
+
+    switch (tok.type) {
+    case TOKENIZER_ERROR:
+      return enc_sym(symrepr_rerror());
+    case TOKENIZER_END:
+      if (s->sp == 3 && s->data[2] == enc_u(PARSE_PROGRAM)) {
+	return s->data[0];
+      }
+      return enc_sym(symrepr_rerror());
+    case TOKOPENPAR:
+      v = parse_push(s, 3, PARSE_LIST);
+      if (v != nil) return v;
+      continue;
+    case TOKCLOSEPAR:
+      // A ) that closes no list, or follows a quote, is an error
+      if (s->data[s->sp - 1] != enc_u(PARSE_LIST)) return enc_sym(symrepr_rerror());
+      v = s->data[s->sp - 3];
+      stack_drop(s, 3);
+      break;
+    case TOKQUOTE:
+      v = parse_push(s, 1, PARSE_QUOTE);
+      if (v != nil) return v;
+      continue;
+    case TOKBACKQUOTE:
+      v = parse_push(s, 1, PARSE_BACKQUOTE);
+      if (v != nil) return v;
+      continue;
+    case TOKCOMMA:
+      v = parse_push(s, 1, PARSE_COMMA);
+      if (v != nil) return v;
+      continue;
+    case TOKCOMMAAT:
+      v = parse_push(s, 1, PARSE_COMMAAT);
+      if (v != nil) return v;
+      continue;
+    default:
+      v = parse_atom(tok);
+      if (is_symbol_merror(v)) {
+	v = nil;
+	gc(s, &v);
+	v = parse_atom(tok);
+      }
+      if (tok.type == TOKSYMBOL || tok.type == TOKSTRING) {
+	free(tok.data.text);
+      }
+      break;
+    }
+
+    // v is a complete expression. Apply the pending quotes, then
+    // add it to the enclosing list.
+    while (true) {
+      if (type_of(v) == VAL_TYPE_SYMBOL &&
+	  symrepr_is_error(dec_sym(v))) {
+	return v;
+      }
+
+      tag = dec_u(s->data[s->sp - 1]);
+      if (tag == PARSE_LIST || tag == PARSE_PROGRAM) break;
+
+      VALUE r = parse_apply_tag(tag, v);
+      if (is_symbol_merror(r)) {
+	gc(s, &v);
+	r = parse_apply_tag(tag, v);
+      }
+      stack_drop(s, 1);
+      v = r;
+    }
+
+    VALUE cell = cons(v, nil);
+    if (is_symbol_merror(cell)) {
+      gc(s, &v);
+      cell = cons(v, nil);
+    }
+    if (type_of(cell) == VAL_TYPE_SYMBOL) return cell;
+    if (s->data[s->sp - 3] == nil) {
+      s->data[s->sp - 3] = cell;
+    } else {
+      set_cdr(s->data[s->sp - 2], cell);
+    }
+    s->data[s->sp - 2] = cell;
+  }
+}
+
+static VALUE parse_program(tokenizer_char_stream str) {
+  stack s;
+  if (!stack_allocate(&s, PARSE_STACK_SIZE, true)) {
+    return enc_sym(symrepr_merror());
+  }
+  VALUE res = parse(str, &s);
+  stack_free(&s);
+  return res;
 }
 
 bool more_string(tokenizer_char_stream str) {
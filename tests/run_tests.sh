@@ -117,6 +117,46 @@ for prg in "test_lisp_code_cps" "test_lisp_code_cps_nc" "test_lisp_code_cps_nc -
     done
 
 
+    for lisp in *.lisp; do
+
+	./$prg -h 8192 -m $lisp
+
+	result=$?
+
+	echo "------------------------------------------------------------"
+	echo MINI_HEAP - COMPACTING!
+	if [ $result -eq 1 ]
+	then
+	    success_count=$((success_count+1))
+	    echo $lisp SUCCESS
+	else
+	    failing_tests="$failing_tests COMPACTING: $prg $lisp \n"
+	    fail_count=$((fail_count+1))
+	    echo $lisp FAILED
+	fi
+	echo "------------------------------------------------------------"
+    done
+
+    for lisp in *.lisp; do
+
+	./$prg -h 8192 -m -s $lisp
+
+	result=$?
+
+	echo "------------------------------------------------------------"
+	echo MINI_HEAP - COMPACTING - INTERNED STRINGS!
+	if [ $result -eq 1 ]
+	then
+	    success_count=$((success_count+1))
+	    echo $lisp SUCCESS
+	else
+	    failing_tests="$failing_tests INTERNED: $prg $lisp \n"
+	    fail_count=$((fail_count+1))
+	    echo $lisp FAILED
+	fi
+	echo "------------------------------------------------------------"
+    done
+
     for lisp in *.lisp; do
 	./$prg -h 8388608 -g -c  $lisp
 
@@ -0,0 +1,12 @@
+(define a "ab")
+(define b "abc")
+(define c "abcdefg")
+
+(array-write a 1u28 \#c)
+
+(and (= a "ac")
+     (= (array-read b 2u28) \#c)
+     (= (array-read c 6u28) \#g)
+     (= (sym-to-str (str-to-sym "xyz")) "xyz")
+     (= (str-to-sym "abc") (str-to-sym b))
+     (= (type-of "") 'type-array))
@@ -0,0 +1,116 @@
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "symrepr.h"
+#include "memory.h"
+#include "heap.h"
+
+#define HEAP_SIZE  4096
+#define NUM_ARRAYS 200
+
+/* Fragments the array memory by dropping every other array, with a
+   symbol name allocated in between, and then allocates an array that
+   only fits if the arrays are slid together. The kept arrays and the
+   symbol name must be intact afterwards. */
+int main(int argc, char **argv) {
+
+  int res = 1;
+
+  unsigned char *memory = malloc(MEMORY_SIZE_16K);
+  unsigned char *bitmap = malloc(MEMORY_BITMAP_SIZE_16K);
+  if (memory == NULL || bitmap == NULL) return 0;
+
+  res = memory_init(memory, MEMORY_SIZE_16K,
+		    bitmap, MEMORY_BITMAP_SIZE_16K);
+  if (!res) {
+    printf("Error initializing memory\n");
+    return 0;
+  }
+
+  res = symrepr_init();
+  if (!res) {
+    printf("Error initializing symrepr\n");
+    return 0;
+  }
+
+  res = heap_init(HEAP_SIZE);
+  if (!res) {
+    printf("Error initializing heap\n");
+    return 0;
+  }
+  printf("Initialized heap: OK\n");
+
+  VALUE nil = enc_sym(symrepr_nil());
+  VALUE live = nil;
+  UINT sym;
+
+  for (unsigned int i = 0; i < NUM_ARRAYS; i ++) {
+    VALUE arr;
+    if (!heap_allocate_array(&arr, 8, VAL_TYPE_U)) {
+      printf("Error allocating array %u\n", i);
+      return 0;
+    }
+    for (unsigned int j = 0; j < 8; j ++) {
+      ((UINT *)array_data(arr))[j] = i * 8 + j;
+    }
+    if (i % 2 == 0) {
+      live = cons(arr, live);
+    }
+    if (i == NUM_ARRAYS / 2 &&
+	!symrepr_addsym("a-symbol-name-in-between-the-arrays", &sym)) {
+      printf("Error adding symbol\n");
+      return 0;
+    }
+  }
+  heap_perform_gc(live);
+
+  uint32_t free_words = memory_num_free();
+  uint32_t longest = memory_longest_free();
+  uint32_t size = longest + 100;
+  if (free_words < size + 2) {
+    printf("Error memory not fragmented enough\n");
+    return 0;
+  }
+
+  VALUE big;
+  if (!heap_allocate_array(&big, size, VAL_TYPE_U)) {
+    printf("Error allocating %u words with %u free, %u in one block\n",
+	   size, free_words, longest);
+    return 0;
+  }
+  memset(array_data(big), 0xFF, size * sizeof(UINT));
+
+  heap_state_t hs;
+  heap_get_state(&hs);
+  if (hs.num_array_compactions != 1) {
+    printf("Error %u compactions\n", hs.num_array_compactions);
+    return 0;
+  }
+  printf("Allocated %u words with %u free, %u in one block: OK\n",
+	 size, free_words, longest);
+
+  VALUE curr = live;
+  for (unsigned int i = NUM_ARRAYS; i > 0; i --) {
+    unsigned int ix = i - 1;
+    if (ix % 2 != 0) continue;
+    VALUE arr = car(curr);
+    for (unsigned int j = 0; j < 8; j ++) {
+      if (type_of(arr) != PTR_TYPE_ARRAY ||
+	  ((UINT *)array_data(arr))[j] != ix * 8 + j) {
+	printf("Error array %u corrupted\n", ix);
+	return 0;
+      }
+    }
+    curr = cdr(curr);
+  }
+
+  const char *name = symrepr_lookup_name(sym);
+  if (name == NULL || strcmp(name, "a-symbol-name-in-between-the-arrays") != 0) {
+    printf("Error symbol name moved\n");
+    return 0;
+  }
+  printf("Arrays and symbol names intact: OK\n");
+  return 1;
+}
@@ -0,0 +1,71 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "heap.h"
+#include "symrepr.h"
+
+#define NUM_VALUES 6
+
+/* Encodes and decodes 32 bit numbers and collects with the numbers
+   as roots. With -D_VALUE64 the numbers must not use any cells. */
+int main(int argc, char **argv) {
+
+  if (!symrepr_init()) {
+    printf("Error initializing symrepr\n");
+    return 0;
+  }
+
+  if (!heap_init(1024)) {
+    printf("Error initializing heap\n");
+    return 0;
+  }
+  printf("Initialized heap: OK\n");
+
+  VALUE nil = enc_sym(symrepr_nil());
+  unsigned int before = heap_num_allocated();
+
+  VALUE vals[NUM_VALUES];
+  vals[0] = enc_I(-2147483647 - 1);
+  vals[1] = enc_I(2147483647);
+  vals[2] = enc_U(4294967295u);
+  vals[3] = enc_U(0);
+  vals[4] = enc_F(3.5f);
+  vals[5] = enc_F(-0.25f);
+
+  unsigned int used = heap_num_allocated() - before;
+#ifdef _VALUE64
+  if (used != 0) {
+#else
+  if (used != NUM_VALUES) {
+#endif
+    printf("Error %u cells used for %d numbers\n", used, NUM_VALUES);
+    return 0;
+  }
+  printf("Encoded %d numbers in %u cells: OK\n", NUM_VALUES, used);
+
+  heap_perform_gc_aux(nil, nil, nil, nil, nil, vals, NUM_VALUES);
+
+  if (type_of(vals[0]) != PTR_TYPE_BOXED_I ||
+      type_of(vals[2]) != PTR_TYPE_BOXED_U ||
+      type_of(vals[4]) != PTR_TYPE_BOXED_F) {
+    printf("Error wrong types\n");
+    return 0;
+  }
+  for (int i = 0; i < NUM_VALUES; i ++) {
+    if (!is_number(vals[i])) {
+      printf("Error value %d is not a number\n", i);
+      return 0;
+    }
+  }
+  if (dec_I(vals[0]) != -2147483647 - 1 ||
+      dec_I(vals[1]) != 2147483647 ||
+      dec_U(vals[2]) != 4294967295u ||
+      dec_U(vals[3]) != 0 ||
+      dec_f(vals[4]) != 3.5f ||
+      dec_f(vals[5]) != -0.25f) {
+    printf("Error numbers corrupted\n");
+    return 0;
+  }
+  printf("Numbers intact after GC: OK\n");
+  return 1;
+}
@@ -0,0 +1,154 @@
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "symrepr.h"
+#include "memory.h"
+#include "heap.h"
+#include "env.h"
+#include "bytecode.h"
+
+#define HEAP_SIZE   512
+#define ITERATIONS  1000
+#define MAX_CODE    256
+
+static uint8_t data[MAX_CODE];
+static unsigned int pos;
+static bytecode_t bc;
+
+static void u8(uint8_t v) {
+  data[pos++] = v;
+}
+
+static void u32(VALUE v) {
+  UINT u = (UINT)v;
+  for (int i = 0; i < 4; i ++) {
+    u8((uint8_t)(u >> (8 * i)));
+  }
+}
+
+static void instr_reg_imm(uint8_t op, uint8_t reg, VALUE imm) {
+  u8(op); u8(reg); u32(imm);
+}
+
+static void instr_reg_reg(uint8_t op, uint8_t r0, uint8_t r1) {
+  u8(op); u8(r0); u8(r1);
+}
+
+// (op i 0) or (op i 1) into val, with i in env
+static void call_with_counter(UINT fun, INT n) {
+  instr_reg_imm(OP_MOVIMM, REG_PROC, enc_sym(fun));
+  instr_reg_imm(OP_MOVIMM, REG_ARGL, enc_sym(symrepr_nil()));
+  instr_reg_imm(OP_CONSIMM, REG_ARGL, enc_i(n));
+  instr_reg_reg(OP_CONS, REG_ARGL, REG_ENV);
+  u8(OP_CALLF);
+}
+
+/* The program counts down from ITERATIONS, which fills the heap with
+   garbage and collects several times, and then evaluates to a
+   procedure (nil entry nil) that returns its argument list. The
+   argument list passed to bytecode_eval must survive the collections
+   made before the procedure is applied. */
+static unsigned int assemble(void) {
+
+  pos = 4; // code_size goes first
+
+  instr_reg_imm(OP_MOVIMM, REG_ENV, enc_i(ITERATIONS));
+  unsigned int loop = pos - 4;
+  call_with_counter(SYM_SUB, 1);
+  instr_reg_reg(OP_MOV, REG_ENV, REG_VAL);
+  call_with_counter(SYM_EQ, 0);
+  u8(OP_BNIL); u32(loop);
+
+  instr_reg_imm(OP_MOVIMM, REG_VAL, enc_sym(symrepr_nil()));
+  instr_reg_imm(OP_CONSIMM, REG_VAL, enc_sym(symrepr_nil()));
+  instr_reg_imm(OP_CONSIMM, REG_VAL, 0);
+  unsigned int entry_pos = pos - 4;
+  instr_reg_imm(OP_CONSIMM, REG_VAL, enc_sym(symrepr_nil()));
+  u8(OP_DONE);
+
+  // The procedure
+  unsigned int entry = pos - 4;
+  instr_reg_reg(OP_MOV, REG_VAL, REG_ARGL);
+  u8(OP_JMPCNT);
+
+  unsigned int end = pos;
+  pos = entry_pos;
+  u32(enc_u(entry));
+  pos = 0;
+  u32(end - 4);
+  pos = end;
+  u32(0); // no symbol indirections
+  return pos;
+}
+
+static bool check_list(VALUE l) {
+  for (INT i = 1; i <= 3; i ++) {
+    if (type_of(l) != PTR_TYPE_CONS || car(l) != enc_i(i)) return 0;
+    l = cdr(l);
+  }
+  return l == enc_sym(symrepr_nil());
+}
+
+static int run(char *name, uint32_t options) {
+
+  if (!heap_init_ext(HEAP_SIZE, options) ||
+      !env_init()) {
+    printf("Error initializing heap\n");
+    return 0;
+  }
+  heap_set_gc_compact_interval(1);
+
+  unsigned int size = assemble();
+  VALUE bc_val;
+  if (!bytecode_load(&bc, data, size) ||
+      !bytecode_create(&bc_val, &bc)) {
+    printf("Error loading bytecode\n");
+    return 0;
+  }
+
+  VALUE nil = enc_sym(symrepr_nil());
+  VALUE args = cons(enc_i(1), cons(enc_i(2), cons(enc_i(3), nil)));
+
+  heap_state_t hs;
+  heap_get_state(&hs);
+  unsigned int gc_before = hs.gc_num;
+
+  VALUE res = bytecode_eval(bc_val, args, NULL, NULL);
+
+  heap_get_state(&hs);
+  if (hs.gc_num == gc_before) {
+    printf("Error %s: no collection in the program\n", name);
+    return 0;
+  }
+  if (!check_list(res)) {
+    printf("Error %s: argument list lost in %u collections\n", name, hs.gc_num - gc_before);
+    return 0;
+  }
+  printf("%-12s %u collections: OK\n", name, hs.gc_num - gc_before);
+
+  bytecode_del(&bc);
+  heap_del();
+  return 1;
+}
+
+int main(int argc, char **argv) {
+
+  unsigned char *memory = malloc(MEMORY_SIZE_16K);
+  unsigned char *bitmap = malloc(MEMORY_BITMAP_SIZE_16K);
+  if (memory == NULL || bitmap == NULL) return 0;
+
+  if (!memory_init(memory, MEMORY_SIZE_16K,
+		   bitmap, MEMORY_BITMAP_SIZE_16K) ||
+      !symrepr_init()) {
+    printf("Error initializing memory\n");
+    return 0;
+  }
+
+  if (!run("default", 0) ||
+      !run("compacting", HEAP_COMPACTING)) {
+    return 0;
+  }
+  return 1;
+}
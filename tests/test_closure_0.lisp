@@ -0,0 +1,6 @@
+(define f (lambda (x y)
+	    (let ((g (lambda (z) (+ x z)))
+		  (x (* y 2)))
+	      (g 1))))
+
+(= (f 1 10) 21)
@@ -0,0 +1,9 @@
+(define adder (lambda (a) (lambda (b) (lambda (c) (+ a b c)))))
+
+(define adders (lambda (n acc)
+		 (if (= n 0)
+		     acc
+		   (adders (- n 1) (cons (lambda (x) (+ x n)) acc)))))
+
+(= (list (((adder 1) 2) 3) (map (lambda (f) (f 10)) (adders 3 nil)))
+   '(6 (11 12 13)))
@@ -0,0 +1,12 @@
+(let ((k 5))
+  (define addk (lambda (x) (+ x k))))
+
+(define f (lambda (x) x))
+
+(f 1)
+
+(define g (lambda () x))
+
+(define x 7)
+
+(and (= (addk 1) 6) (= (g) 7))
@@ -0,0 +1,11 @@
+(define code '(lambda () y))
+
+(define f1 (eval code))
+
+(define y 3)
+
+(define r1 (f1))
+
+(define f2 (let ((y 5)) (eval code)))
+
+(= (list r1 (f2)) '(3 5))
@@ -0,0 +1,5 @@
+(define f (let ((z 9)) (lambda () (eval 'z))))
+
+(define g (lambda (x) (let ((h (lambda (y) (eval 'x)))) (h 1))))
+
+(and (= (f) 9) (= (g 4) 4))
@@ -0,0 +1,101 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "heap.h"
+#include "symrepr.h"
+#include "env.h"
+#include "eval_cps.h"
+#include "tokpar.h"
+#include "memory.h"
+
+#define HEAP_SIZE 8192
+
+static VALUE eval(char *str) {
+  return eval_cps_program_nc(tokpar_parse(str));
+}
+
+/* A closure keeps only the variables its lambda references, however
+   large the environment it is created in, and applying it only
+   allocates one frame of the arguments. A lambda is resolved once,
+   however many times it is evaluated. */
+
+static bool is_closure_lex(VALUE exp) {
+  return (type_of(exp) == PTR_TYPE_CONS &&
+	  type_of(car(exp)) == VAL_TYPE_SYMBOL &&
+	  dec_sym(car(exp)) == symrepr_closure_lex());
+}
+
+int main(int argc, char **argv) {
+
+  unsigned char *memory = malloc(MEMORY_SIZE_16K);
+  unsigned char *bitmap = malloc(MEMORY_BITMAP_SIZE_16K);
+  if (memory == NULL || bitmap == NULL) return 0;
+
+  if (!memory_init(memory, MEMORY_SIZE_16K,
+		   bitmap, MEMORY_BITMAP_SIZE_16K) ||
+      !symrepr_init() ||
+      !heap_init(HEAP_SIZE) ||
+      !env_init() ||
+      !eval_cps_init_nc(256, false)) {
+    printf("Error initializing\n");
+    return 0;
+  }
+
+  eval("(define f (lambda (a b c d e g h)"
+       "  (let ((i 1) (j 20) (k 3))"
+       "    (lambda (x) (+ x b j)))))");
+
+  VALUE clo = eval("(f 1 2 3 4 5 6 7)");
+  if (!is_closure_lex(clo)) {
+    printf("Error no closure\n");
+    return 0;
+  }
+
+  // One frame, (slots . nil), with the slots (b . j)
+  VALUE clo_env = car(cdr(cdr(cdr(clo))));
+  if (length(clo_env) != 1 ||
+      type_of(car(clo_env)) != PTR_TYPE_CONS ||
+      car(car(clo_env)) != enc_i(2) ||
+      cdr(car(clo_env)) != enc_i(20)) {
+    printf("Error the closure does not keep a frame of b and j\n");
+    return 0;
+  }
+  printf("Closure of 2 free variables keeps a frame of 2 slots: OK\n");
+
+  VALUE r = eval("((f 1 2 3 4 5 6 7) 10)");
+  if (type_of(r) != VAL_TYPE_I || dec_i(r) != 32) {
+    printf("Error wrong result\n");
+    return 0;
+  }
+  printf("Closure applied: OK\n");
+
+  eval("(define g (lambda (a b c) (+ a b c)))");
+  VALUE prg = tokpar_parse("(g 1 2 3)");
+  unsigned int before = heap_num_free();
+  r = eval_cps_program_nc(prg);
+  unsigned int used = before - heap_num_free();
+  if (type_of(r) != VAL_TYPE_I || dec_i(r) != 6 || used != 3) {
+    printf("Error %u cells used in application\n", used);
+    return 0;
+  }
+  printf("Application of 3 arguments used %u cells: OK\n", used);
+
+  // The inner lambda is evaluated, in a new environment, by each call
+  // of mk, that is not resolved as it calls eval
+  eval("(define mk (lambda (k) (progn (eval 'k) (lambda (x) (+ x k)))))");
+  VALUE c1 = eval("(define c1 (mk 1))");
+  c1 = eval("c1");
+  VALUE c2 = eval("(mk 2)");
+  if (!is_closure_lex(c1) || !is_closure_lex(c2) ||
+      car(cdr(cdr(c1))) != car(cdr(cdr(c2)))) {
+    printf("Error lambda resolved twice\n");
+    return 0;
+  }
+  r = eval("(+ (c1 10) ((mk 2) 10))");
+  if (type_of(r) != VAL_TYPE_I || dec_i(r) != 23) {
+    printf("Error wrong result of the shared copy\n");
+    return 0;
+  }
+  printf("Lambda resolved once: OK\n");
+  return 1;
+}
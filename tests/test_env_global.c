@@ -0,0 +1,144 @@
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "symrepr.h"
+#include "heap.h"
+#include "env.h"
+
+#define HEAP_SIZE   8192
+#define NUM_GLOBALS 2000
+
+static void relocate_roots(void) {
+  VALUE *env = env_get_global_ptr();
+  *env = gc_relocate(*env);
+}
+
+static void collect(bool compacting) {
+  if (compacting) {
+    gc_state_inc();
+    gc_mark_freelist();
+    gc_mark_phase(*env_get_global_ptr());
+    gc_compact_phase(relocate_roots);
+  } else {
+    heap_perform_gc(*env_get_global_ptr());
+  }
+}
+
+static unsigned int num_iterated;
+static void count_binding(VALUE binding) {
+  (void) binding;
+  num_iterated ++;
+}
+
+static VALUE global(unsigned int i) {
+  return enc_sym(MAX_SPECIAL_SYMBOLS + i);
+}
+
+// Defines like the evaluator does, collecting when out of memory
+static int define(VALUE key, VALUE val, bool compacting) {
+  VALUE env = env_set(*env_get_global_ptr(), key, val);
+  if (type_of(env) == VAL_TYPE_SYMBOL) {
+    collect(compacting);
+    env = env_set(*env_get_global_ptr(), key, val);
+    if (type_of(env) == VAL_TYPE_SYMBOL) return 0;
+  }
+  *env_get_global_ptr() = env;
+  return 1;
+}
+
+static int check(unsigned int redefined) {
+  VALUE env = *env_get_global_ptr();
+  for (unsigned int i = 0; i < NUM_GLOBALS; i ++) {
+    VALUE v = env_lookup(global(i), env);
+    UINT expected = (i < redefined && i % 3 == 0) ? i + 1 : i;
+    if (type_of(v) != VAL_TYPE_U || dec_u(v) != expected) {
+      printf("Error global %u not found\n", i);
+      return 0;
+    }
+  }
+  VALUE v = env_lookup(global(NUM_GLOBALS), env);
+  if (type_of(v) != VAL_TYPE_SYMBOL || dec_sym(v) != symrepr_not_found()) {
+    printf("Error unbound global found\n");
+    return 0;
+  }
+  return 1;
+}
+
+/* Defines more globals than the initial table holds, so that it
+   grows, redefines some and collects, and checks that all bindings
+   are found after each step. */
+static int run(char *name, uint32_t options) {
+
+  bool compacting = options & HEAP_COMPACTING;
+
+  if (!heap_init_ext(HEAP_SIZE, options) || !env_init()) {
+    printf("Error initializing heap\n");
+    return 0;
+  }
+
+  for (unsigned int i = 0; i < NUM_GLOBALS; i ++) {
+    if (!define(global(i), enc_u(i), compacting)) {
+      printf("Error defining global %u\n", i);
+      return 0;
+    }
+  }
+  if (env_num_global_bindings() != NUM_GLOBALS || !check(0)) {
+    printf("Error after defining %u globals\n", env_num_global_bindings());
+    return 0;
+  }
+
+  for (unsigned int i = 0; i < NUM_GLOBALS; i += 3) {
+    if (!define(global(i), enc_u(i + 1), compacting)) {
+      printf("Error redefining global %u\n", i);
+      return 0;
+    }
+  }
+  if (env_num_global_bindings() != NUM_GLOBALS || !check(NUM_GLOBALS)) {
+    printf("Error after redefining globals\n");
+    return 0;
+  }
+
+  collect(compacting);
+  VALUE local = cons(cons(global(0), enc_u(42)), enc_sym(symrepr_nil()));
+  if (dec_u(env_lookup(global(0), local)) != 42 ||
+      env_modify_binding(*env_get_global_ptr(), global(1), enc_u(2)) !=
+      *env_get_global_ptr() ||
+      dec_u(env_lookup(global(1), *env_get_global_ptr())) != 2 ||
+      !define(global(1), enc_u(1), compacting)) {
+    printf("Error local and global lookup mixed up\n");
+    return 0;
+  }
+
+  collect(compacting);
+  if (!check(NUM_GLOBALS)) {
+    printf("Error globals lost in GC\n");
+    return 0;
+  }
+
+  num_iterated = 0;
+  env_global_iterate(count_binding);
+  if (num_iterated != NUM_GLOBALS) {
+    printf("Error %u bindings iterated\n", num_iterated);
+    return 0;
+  }
+  printf("%-12s %u globals: OK\n", name, NUM_GLOBALS);
+  heap_del();
+  return 1;
+}
+
+int main(int argc, char **argv) {
+
+  if (!symrepr_init()) {
+    printf("Error initializing symrepr\n");
+    return 0;
+  }
+
+  if (!run("default", 0) ||
+      !run("lazy", HEAP_LAZY_SWEEP) ||
+      !run("generational", HEAP_GENERATIONAL) ||
+      !run("compacting", HEAP_COMPACTING)) {
+    return 0;
+  }
+  return 1;
+}
@@ -0,0 +1 @@
+(= (list 1.5 4294967295u32 2147483647i32) (list 1.5 4294967295u32 2147483647i32))
@@ -0,0 +1 @@
+(= (list (= 1.5 2.5) (= 1u32 2u32) (= 1i32 1u32)) (list nil nil nil))
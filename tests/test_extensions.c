@@ -0,0 +1,82 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "heap.h"
+#include "symrepr.h"
+#include "extensions.h"
+#include "memory.h"
+
+#define NUM_EXTENSIONS 120
+
+static VALUE ext_a(VALUE *args, int argn) {
+  (void) args; (void) argn;
+  return enc_sym(symrepr_true());
+}
+
+static VALUE ext_b(VALUE *args, int argn) {
+  (void) args; (void) argn;
+  return enc_sym(symrepr_nil());
+}
+
+/* Adds more extensions than the registry holds at first, interleaved
+   with ordinary symbols, and looks them all up. */
+int main(int argc, char **argv) {
+
+  unsigned char *memory = malloc(MEMORY_SIZE_32K);
+  unsigned char *bitmap = malloc(MEMORY_BITMAP_SIZE_32K);
+  if (memory == NULL || bitmap == NULL) return 0;
+
+  if (!memory_init(memory, MEMORY_SIZE_32K,
+		   bitmap, MEMORY_BITMAP_SIZE_32K) ||
+      !symrepr_init()) {
+    printf("Error initializing\n");
+    return 0;
+  }
+
+  UINT ext_ids[NUM_EXTENSIONS];
+  UINT other_ids[NUM_EXTENSIONS];
+  char name[32];
+
+  for (int i = 0; i < NUM_EXTENSIONS; i ++) {
+    snprintf(name, 32, "other-%d", i);
+    if (!symrepr_addsym(name, &other_ids[i])) return 0;
+    snprintf(name, 32, "ext-%d", i);
+    if (!extensions_add(name, (i % 2) ? ext_a : ext_b) ||
+	!symrepr_lookup(name, &ext_ids[i])) {
+      printf("Error adding extension %d\n", i);
+      return 0;
+    }
+  }
+
+  for (int i = 0; i < NUM_EXTENSIONS; i ++) {
+    if (extensions_lookup(ext_ids[i]) != ((i % 2) ? ext_a : ext_b) ||
+	extensions_lookup(other_ids[i]) != NULL) {
+      printf("Error looking up extension %d\n", i);
+      return 0;
+    }
+  }
+  if (extensions_lookup(SYM_ADD) != NULL ||
+      extensions_lookup(ext_ids[NUM_EXTENSIONS - 1] + 1000) != NULL) {
+    printf("Error extension found for a non extension symbol\n");
+    return 0;
+  }
+  printf("Looked up %d extensions: OK\n", NUM_EXTENSIONS);
+
+  // Adding an extension again replaces its function
+  if (!extensions_add("ext-0", ext_a) ||
+      extensions_lookup(ext_ids[0]) != ext_a ||
+      extensions_lookup(ext_ids[1]) != ext_a ||
+      extensions_lookup(ext_ids[2]) != ext_b) {
+    printf("Error replacing extension\n");
+    return 0;
+  }
+  printf("Extension replaced: OK\n");
+
+  extensions_del();
+  if (extensions_lookup(ext_ids[0]) != NULL) {
+    printf("Error extension found after extensions_del\n");
+    return 0;
+  }
+  printf("Extensions removed: OK\n");
+  return 1;
+}
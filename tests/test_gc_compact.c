@@ -0,0 +1,152 @@
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "symrepr.h"
+#include "memory.h"
+#include "heap.h"
+
+#define HEAP_SIZE   10000
+#define NUM_LISTS   8
+#define LIST_LENGTH 200
+
+static VALUE roots[NUM_LISTS];
+
+static void relocate_roots(void) {
+  gc_relocate_aux(roots, NUM_LISTS);
+}
+
+static void collect(void) {
+  gc_state_inc();
+  gc_mark_freelist();
+  gc_mark_aux(roots, NUM_LISTS);
+  gc_compact_phase(relocate_roots);
+}
+
+/* Builds lists whose cells are interleaved with each other and with
+   garbage, and checks that compaction moves every list into
+   consecutive cells at the beginning of the heap without changing
+   its contents. Every other element is an array or a boxed value. */
+int main(int argc, char **argv) {
+
+  int res = 1;
+
+  unsigned char *memory = malloc(MEMORY_SIZE_16K);
+  unsigned char *bitmap = malloc(MEMORY_BITMAP_SIZE_16K);
+  if (memory == NULL || bitmap == NULL) return 0;
+
+  res = memory_init(memory, MEMORY_SIZE_16K,
+		    bitmap, MEMORY_BITMAP_SIZE_16K);
+  if (!res) {
+    printf("Error initializing memory\n");
+    return 0;
+  }
+
+  res = symrepr_init();
+  if (!res) {
+    printf("Error initializing symrepr\n");
+    return 0;
+  }
+
+  res = heap_init_ext(HEAP_SIZE, HEAP_COMPACTING);
+  if (!res) {
+    printf("Error initializing heap\n");
+    return 0;
+  }
+  printf("Initialized heap: OK\n");
+
+  VALUE nil = enc_sym(symrepr_nil());
+  for (int l = 0; l < NUM_LISTS; l ++) {
+    roots[l] = nil;
+  }
+
+  for (unsigned int i = 0; i < LIST_LENGTH; i ++) {
+    for (int l = 0; l < NUM_LISTS; l ++) {
+      VALUE v;
+      if (i % 2 == 0) {
+	v = enc_u(i);
+      } else if (l % 2 == 0) {
+	if (!heap_allocate_array(&v, 1, VAL_TYPE_U)) return 0;
+	((UINT *)car(v))[2] = i;
+      } else {
+	v = set_ptr_type(cons(enc_u(i), enc_sym(DEF_REPR_BOXED_U_TYPE)),
+			 PTR_TYPE_BOXED_U);
+      }
+      roots[l] = cons(v, roots[l]);
+      cons(nil, nil);
+      // Garbage arrays have to be freed by the compaction
+      if (i % 8 == 0) {
+	VALUE garbage;
+	if (!heap_allocate_array(&garbage, 1, VAL_TYPE_U)) return 0;
+      }
+    }
+  }
+  if (!is_ptr(roots[NUM_LISTS - 1])) {
+    printf("Error building lists\n");
+    return 0;
+  }
+
+  collect();
+
+  heap_state_t hs;
+  heap_get_state(&hs);
+  unsigned int live = NUM_LISTS * LIST_LENGTH * 3 / 2;
+  if (hs.gc_num_compactions != 1 || hs.num_alloc != live) {
+    printf("Error %u compactions %u cells live\n",
+	   hs.gc_num_compactions, hs.num_alloc);
+    return 0;
+  }
+  if (hs.gc_recovered_arrays != NUM_LISTS * LIST_LENGTH / 8) {
+    printf("Error %u arrays recovered\n", hs.gc_recovered_arrays);
+    return 0;
+  }
+  printf("Compacted to %u cells: OK\n", hs.num_alloc);
+
+  for (int l = 0; l < NUM_LISTS; l ++) {
+    VALUE curr = roots[l];
+    for (unsigned int i = LIST_LENGTH; i > 0; i --) {
+      unsigned int ix = i - 1;
+      VALUE v = car(curr);
+      UINT elt;
+      if (ix % 2 == 0) {
+	elt = dec_u(v);
+      } else if (l % 2 == 0) {
+	elt = type_of(v) == PTR_TYPE_ARRAY ?
+	  ((UINT *)car(v))[2] : 0xFFFFFFFF;
+      } else {
+	elt = type_of(v) == PTR_TYPE_BOXED_U ? dec_u(car(v)) : 0xFFFFFFFF;
+      }
+      if (elt != ix || (is_ptr(v) && dec_ptr(v) >= live)) {
+	printf("Error element %u of list %d corrupted\n", ix, l);
+	return 0;
+      }
+      VALUE next = cdr(curr);
+      if (dec_ptr(curr) >= live ||
+	  (is_ptr(next) && dec_ptr(next) != dec_ptr(curr) + 1)) {
+	printf("Error list %d is not contiguous at %u\n", l, ix);
+	return 0;
+      }
+      curr = next;
+    }
+    if (curr != nil) {
+      printf("Error list %d too long\n", l);
+      return 0;
+    }
+  }
+  printf("Lists intact and contiguous: OK\n");
+
+  // All free cells follow the live ones
+  for (unsigned int i = live; i < HEAP_SIZE; i ++) {
+    VALUE c = cons(nil, nil);
+    if (!is_ptr(c) || dec_ptr(c) != i) {
+      printf("Error free cell %u not handed out in order\n", i);
+      return 0;
+    }
+  }
+  if (is_ptr(cons(nil, nil))) {
+    printf("Error too many free cells\n");
+    return 0;
+  }
+  printf("Free cells in one block: OK\n");
+  return 1;
+}
@@ -0,0 +1,86 @@
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "heap.h"
+#include "symrepr.h"
+
+#define DEPTH 100000
+
+/* Builds a structure nested DEPTH levels deep in the car direction,
+   where every level also holds a boxed value in a separate cell.
+   Marking it overflows the GC mark stack many times over. */
+int main(int argc, char **argv) {
+
+  int res = 1;
+
+  unsigned int heap_size = 3 * DEPTH + 1024;
+
+  res = symrepr_init();
+  if (!res) {
+    printf("Error initializing symrepr\n");
+    return 0;
+  }
+
+  res = heap_init(heap_size);
+  if (!res) {
+    printf("Error initializing heap\n");
+    return 0;
+  }
+  printf("Initialized heap: OK\n");
+
+  VALUE nil = enc_sym(symrepr_nil());
+  VALUE deep = nil;
+
+  for (int i = 0; i < DEPTH; i ++) {
+    VALUE boxed = set_ptr_type(cons((UINT)i, enc_sym(DEF_REPR_BOXED_U_TYPE)), PTR_TYPE_BOXED_U);
+    VALUE level = cons(boxed, nil);
+    deep = cons(deep, level);
+    if (!is_ptr(boxed) || !is_ptr(level) || !is_ptr(deep)) {
+      printf("Error allocating structure at depth %d\n", i);
+      return 0;
+    }
+  }
+  // Some garbage
+  for (int i = 0; i < 512; i ++) {
+    cons(nil, nil);
+  }
+  printf("Built %d deep structure: OK\n", DEPTH);
+
+  heap_perform_gc(deep);
+
+  heap_state_t hs;
+  heap_get_state(&hs);
+  if (hs.gc_marked < 3 * DEPTH) {
+    printf("Error only %u cells marked\n", hs.gc_marked);
+    return 0;
+  }
+  if (hs.gc_recovered != 512) {
+    printf("Error %u cells recovered, expected 512\n", hs.gc_recovered);
+    return 0;
+  }
+  printf("GC marked %u cells with %u rescans: OK\n", hs.gc_marked, hs.gc_mark_rescans);
+
+  // Overwrite everything that is free
+  while (heap_num_free() > 0) {
+    cons(enc_u(0xDEAD), enc_u(0xBEEF));
+  }
+
+  VALUE curr = deep;
+  for (int i = DEPTH - 1; i >= 0; i --) {
+    VALUE boxed = car(cdr(curr));
+    if (type_of(curr) != PTR_TYPE_CONS ||
+	type_of(boxed) != PTR_TYPE_BOXED_U ||
+	car(boxed) != (UINT)i) {
+      printf("Error structure corrupted at depth %d\n", i);
+      return 0;
+    }
+    curr = car(curr);
+  }
+  if (curr != nil) {
+    printf("Error structure not terminated\n");
+    return 0;
+  }
+  printf("Structure intact after GC: OK\n");
+  return 1;
+}
@@ -0,0 +1,124 @@
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "heap.h"
+#include "symrepr.h"
+
+#define HEAP_SIZE   16384
+#define NUM_ELTS    1000
+#define ROUNDS      200000
+
+static VALUE root;
+
+// Elements are (v . (v + NUM_ELTS))
+static VALUE element(unsigned int v) {
+  VALUE rest = cons(enc_u(v + NUM_ELTS), enc_sym(symrepr_nil()));
+  if (!is_ptr(rest)) return rest;
+  return cons(enc_u(v), rest);
+}
+
+/* Allocates short lived garbage and now and then stores new cells
+   into old ones, collecting when the nursery is full or allocation
+   fails, the way the evaluators do. Young cells that are only
+   reachable from old cells, or from cells allocated past a full
+   nursery, must survive minor collections. Allocation only fails
+   when the heap is full. */
+int main(int argc, char **argv) {
+
+  int res = 1;
+
+  res = symrepr_init();
+  if (!res) {
+    printf("Error initializing symrepr\n");
+    return 0;
+  }
+
+  res = heap_init_ext(HEAP_SIZE, HEAP_GENERATIONAL);
+  if (!res) {
+    printf("Error initializing heap\n");
+    return 0;
+  }
+  printf("Initialized heap: OK\n");
+
+  VALUE nil = enc_sym(symrepr_nil());
+  root = nil;
+  for (unsigned int i = 0; i < NUM_ELTS; i ++) {
+    VALUE e = element(i);
+    VALUE c = cons(e, root);
+    if (!is_ptr(e) || !is_ptr(c)) {
+      heap_perform_gc(root);
+      i --;
+      continue;
+    }
+    root = c;
+  }
+  heap_perform_gc(root);
+
+  unsigned int seed = 1;
+  heap_state_t hs;
+
+  for (int r = 0; r < ROUNDS; r ++) {
+    VALUE e = element(0);
+    VALUE g = cons(nil, nil);
+
+    if (!is_ptr(e) || !is_ptr(g)) {
+      if (heap_num_free() > 0) {
+	printf("Error allocation failed with %u cells free\n", heap_num_free());
+	return 0;
+      }
+      heap_perform_gc(root);
+      continue;
+    }
+
+    // Replace an old element by a new one
+    if (r % 10 == 0) {
+      seed = seed * 1103515245 + 12345;
+      unsigned int n = (seed >> 8) % NUM_ELTS;
+      VALUE curr = root;
+      for (unsigned int i = 0; i < n; i ++) {
+	curr = cdr(curr);
+      }
+      set_car(e, car(car(curr)));
+      set_car(cdr(e), enc_u(dec_u(car(car(curr))) + NUM_ELTS));
+      set_car(curr, e);
+    }
+
+    // Every third round a few cells are allocated past the nursery
+    if (heap_nursery_full() && r % 3 != 0) {
+      heap_perform_gc(root);
+    }
+  }
+
+  heap_get_state(&hs);
+  if (hs.gc_num_minor == 0 || hs.gc_num_minor == hs.gc_num) {
+    printf("Error %u collections of which %u minor\n", hs.gc_num, hs.gc_num_minor);
+    return 0;
+  }
+  printf("%u collections of which %u minor: OK\n", hs.gc_num, hs.gc_num_minor);
+
+  // Hand out everything that is free
+  while (is_ptr(cons(enc_u(0xDEAD), enc_u(0xBEEF))));
+  heap_perform_gc(root);
+  while (is_ptr(cons(enc_u(0xDEAD), enc_u(0xBEEF))));
+
+  bool seen[NUM_ELTS] = { false };
+  VALUE curr = root;
+  for (unsigned int i = 0; i < NUM_ELTS; i ++) {
+    VALUE e = car(curr);
+    UINT v = dec_u(car(e));
+    if (type_of(curr) != PTR_TYPE_CONS ||
+	type_of(e) != PTR_TYPE_CONS ||
+	type_of(car(e)) != VAL_TYPE_U ||
+	v >= NUM_ELTS || seen[v] ||
+	car(cdr(e)) != enc_u(v + NUM_ELTS)) {
+      printf("Error element %u corrupted\n", i);
+      return 0;
+    }
+    seen[v] = true;
+    curr = cdr(curr);
+  }
+  printf("Live data intact: OK\n");
+  return 1;
+}
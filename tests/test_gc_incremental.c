@@ -0,0 +1,128 @@
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "heap.h"
+#include "symrepr.h"
+
+#define HEAP_SIZE   20000
+#define NUM_ELTS    2000
+#define ROUNDS      10
+
+static VALUE root;
+
+static void mark_roots(void) {
+  gc_mark_phase(root);
+}
+
+static VALUE nth_cell(unsigned int n) {
+  VALUE curr = root;
+  for (unsigned int i = 0; i < n; i ++) {
+    curr = cdr(curr);
+  }
+  return curr;
+}
+
+// Elements are (v . (v + NUM_ELTS))
+static VALUE element(unsigned int v) {
+  VALUE rest = cons(enc_u(v + NUM_ELTS), enc_sym(symrepr_nil()));
+  if (!is_ptr(rest)) return rest;
+  return cons(enc_u(v), rest);
+}
+
+/* Shuffles the live data with set_car and replaces parts of it with
+   new cells while the incremental collector is marking. Everything
+   reachable when a collection begins must survive it. */
+int main(int argc, char **argv) {
+
+  int res = 1;
+
+  res = symrepr_init();
+  if (!res) {
+    printf("Error initializing symrepr\n");
+    return 0;
+  }
+
+  res = heap_init_ext(HEAP_SIZE, HEAP_INCREMENTAL_GC);
+  if (!res) {
+    printf("Error initializing heap\n");
+    return 0;
+  }
+  heap_set_gc_step_budget(16);
+  printf("Initialized heap: OK\n");
+
+  VALUE nil = enc_sym(symrepr_nil());
+  root = nil;
+  for (unsigned int i = 0; i < NUM_ELTS; i ++) {
+    root = cons(element(i), root);
+  }
+
+  unsigned int seed = 1;
+  heap_state_t hs;
+
+  for (int r = 0; r < ROUNDS; r ++) {
+
+    heap_get_state(&hs);
+    unsigned int num_incremental = hs.gc_num_incremental;
+    unsigned int steps = 0;
+
+    while (hs.gc_num_incremental == num_incremental) {
+      seed = seed * 1103515245 + 12345;
+      VALUE a = nth_cell((seed >> 8) % NUM_ELTS);
+      seed = seed * 1103515245 + 12345;
+      VALUE b = nth_cell((seed >> 8) % NUM_ELTS);
+
+      VALUE tmp = car(a);
+      set_car(a, car(b));
+      set_car(b, tmp);
+
+      if (steps % 7 == 0) {
+	VALUE e = element(dec_u(car(car(a))));
+	if (is_ptr(e)) set_car(a, e);
+      }
+      cons(nil, nil);
+      cons(nil, nil);
+
+      gc_incremental_step(mark_roots);
+      heap_get_state(&hs);
+      steps ++;
+      if (steps > 1000000) {
+	printf("Error collection did not finish\n");
+	return 0;
+      }
+    }
+
+    // Hand out everything that was collected
+    while (is_ptr(cons(enc_u(0xDEAD), enc_u(0xBEEF))));
+
+    bool seen[NUM_ELTS] = { false };
+    VALUE curr = root;
+    for (unsigned int i = 0; i < NUM_ELTS; i ++) {
+      VALUE e = car(curr);
+      UINT v = dec_u(car(e));
+      if (type_of(curr) != PTR_TYPE_CONS ||
+	  type_of(e) != PTR_TYPE_CONS ||
+	  type_of(car(e)) != VAL_TYPE_U ||
+	  v >= NUM_ELTS || seen[v] ||
+	  car(cdr(e)) != enc_u(v + NUM_ELTS)) {
+	printf("Error element %u corrupted in round %d\n", i, r);
+	return 0;
+      }
+      seen[v] = true;
+      curr = cdr(curr);
+    }
+    printf("Round %d: collected in %u steps: OK\n", r, steps);
+
+    heap_perform_gc(root);
+  }
+
+  heap_get_state(&hs);
+  if (hs.gc_max_step > 2 * 16 + 32) {
+    printf("Error step of %u cells exceeds budget\n", hs.gc_max_step);
+    return 0;
+  }
+  printf("Longest step %u cells, longest pause %u cells: OK\n",
+	 hs.gc_max_step, hs.gc_max_pause);
+  return 1;
+}
@@ -0,0 +1,144 @@
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "symrepr.h"
+#include "memory.h"
+#include "heap.h"
+
+#define HEAP_SIZE  10000
+#define ROUNDS     20
+
+// Every third element of the live list is an array
+static int push_live(VALUE *live, unsigned int *n_live) {
+  VALUE v = enc_u(*n_live);
+  if (*n_live % 3 == 0 &&
+      !heap_allocate_array(&v, 100, VAL_TYPE_U)) {
+    return 0;
+  }
+  VALUE c = cons(v, *live);
+  if (!is_ptr(c)) return 0;
+  *live = c;
+  (*n_live) ++;
+  return 1;
+}
+
+/* With HEAP_LAZY_SWEEP, garbage is swept as cells are allocated.
+   Fills the heap with a live list, arrays and garbage over and over
+   and checks that nothing live is ever handed out again. */
+int main(int argc, char **argv) {
+
+  int res = 1;
+
+  unsigned char *memory = malloc(MEMORY_SIZE_16K);
+  unsigned char *bitmap = malloc(MEMORY_BITMAP_SIZE_16K);
+  if (memory == NULL || bitmap == NULL) return 0;
+
+  res = memory_init(memory, MEMORY_SIZE_16K,
+		    bitmap, MEMORY_BITMAP_SIZE_16K);
+  if (!res) {
+    printf("Error initializing memory\n");
+    return 0;
+  }
+
+  res = symrepr_init();
+  if (!res) {
+    printf("Error initializing symrepr\n");
+    return 0;
+  }
+
+  res = heap_init_ext(HEAP_SIZE, HEAP_LAZY_SWEEP);
+  if (!res) {
+    printf("Error initializing heap\n");
+    return 0;
+  }
+  printf("Initialized heap: OK\n");
+
+  VALUE nil = enc_sym(symrepr_nil());
+  VALUE live = nil;
+  unsigned int n_live = 0;
+
+  for (int r = 0; r < ROUNDS; r ++) {
+
+    for (;;) {
+      if (!push_live(&live, &n_live)) break;
+      // and garbage
+      VALUE arr;
+      if (n_live % 3 == 0 &&
+	  !heap_allocate_array(&arr, 100, VAL_TYPE_U)) break;
+      if (!is_ptr(cons(nil, nil))) break;
+    }
+
+    // Drop the newer half of the live list
+    unsigned int keep = n_live / 2;
+    for (unsigned int i = keep; i < n_live; i ++) {
+      live = cdr(live);
+    }
+    n_live = keep;
+
+    heap_perform_gc(live);
+
+    heap_state_t hs;
+    heap_get_state(&hs);
+    if (hs.gc_sweep_pos != 0) {
+      printf("Error sweep not deferred\n");
+      return 0;
+    }
+
+    // Counting the free cells does not sweep them
+    if (heap_num_free() + heap_num_allocated() != HEAP_SIZE) {
+      printf("Error cells lost in round %d\n", r);
+      return 0;
+    }
+    heap_get_state(&hs);
+    if (hs.gc_sweep_pos != 0) {
+      printf("Error heap_num_free swept\n");
+      return 0;
+    }
+
+    // Collect again with free cells left over from a partial sweep.
+    // Those are ahead of the next sweep, and what is allocated from
+    // them must survive it.
+    for (int i = 0; i < 100; i ++) {
+      cons(nil, nil);
+    }
+    heap_perform_gc(live);
+    for (int i = 0; i < 50; i ++) {
+      if (!push_live(&live, &n_live)) {
+	printf("Error allocating after GC in round %d\n", r);
+	return 0;
+      }
+    }
+
+    // The pending sweep hands out the garbage
+    for (;;) {
+      VALUE c = cons(enc_u(0xDEAD), enc_u(0xBEEF));
+      if (!is_ptr(c)) break;
+    }
+
+    VALUE curr = live;
+    for (unsigned int i = n_live; i > 0; i --) {
+      VALUE v = car(curr);
+      unsigned int ix = i - 1;
+      if (ix % 3 == 0) {
+	if (type_of(v) != PTR_TYPE_ARRAY) {
+	  printf("Error array %u lost in round %d\n", ix, r);
+	  return 0;
+	}
+      } else if (v != enc_u(ix)) {
+	printf("Error element %u corrupted in round %d\n", ix, r);
+	return 0;
+      }
+      curr = cdr(curr);
+    }
+    heap_perform_gc(live);
+  }
+  printf("Live data intact after %d rounds: OK\n", ROUNDS);
+
+  if (heap_num_free() + heap_num_allocated() != HEAP_SIZE) {
+    printf("Error cells lost\n");
+    return 0;
+  }
+  printf("All cells accounted for: OK\n");
+  return 1;
+}
@@ -0,0 +1,114 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "heap.h"
+#include "symrepr.h"
+#include "env.h"
+#include "extensions.h"
+#include "eval_cps.h"
+#include "tokpar.h"
+#include "memory.h"
+
+#define HEAP_SIZE 2048
+
+static VALUE eval(char *str) {
+  return eval_cps_program_nc(tokpar_parse(str));
+}
+
+static VALUE ext_inc(VALUE *args, int argn) {
+  if (argn != 1 || type_of(args[0]) != VAL_TYPE_I) {
+    return enc_sym(symrepr_terror());
+  }
+  return enc_i(dec_i(args[0]) + 1);
+}
+
+static int check(char *str, INT expected) {
+  VALUE r = eval(str);
+  if (type_of(r) != VAL_TYPE_I || dec_i(r) != expected) {
+    printf("Error %s is not %d\n", str, (int)expected);
+    return 0;
+  }
+  return 1;
+}
+
+/* References to globals in a lambda point at their bindings, and
+   see redefinitions and bindings moved by compacting collections.
+   References to undefined names bind them to not_found, see the
+   define that binds them later and see extensions added later. */
+int main(int argc, char **argv) {
+
+  unsigned char *memory = malloc(MEMORY_SIZE_16K);
+  unsigned char *bitmap = malloc(MEMORY_BITMAP_SIZE_16K);
+  if (memory == NULL || bitmap == NULL) return 0;
+
+  if (!memory_init(memory, MEMORY_SIZE_16K,
+		   bitmap, MEMORY_BITMAP_SIZE_16K) ||
+      !symrepr_init() ||
+      !heap_init_ext(HEAP_SIZE, HEAP_COMPACTING) ||
+      !env_init() ||
+      !eval_cps_init_nc(256, false)) {
+    printf("Error initializing\n");
+    return 0;
+  }
+
+  eval("(define g (lambda (x) (+ x 1)))");
+  eval("(define f (lambda (x) (g x)))");
+  if (!check("(f 1)", 2)) return 0;
+
+  UINT f_sym;
+  if (!symrepr_lookup("f", &f_sym)) return 0;
+  VALUE f = env_lookup(enc_sym(f_sym), *env_get_global_ptr());
+  VALUE body = car(cdr(cdr(f)));
+  if (type_of(car(body)) != PTR_TYPE_GLOBAL_REF) {
+    printf("Error reference to g not resolved\n");
+    return 0;
+  }
+  printf("Reference to global resolved: OK\n");
+
+  eval("(define g (lambda (x) (* x 10)))");
+  if (!check("(f 1)", 10)) return 0;
+  printf("Redefinition seen: OK\n");
+
+  // Allocates enough to collect a few times
+  eval("(define garbage (lambda (n acc)"
+       "  (if (= n 0) 0 (garbage (- n 1) (cons n (cons n acc))))))");
+  for (int i = 0; i < 10; i ++) {
+    eval("(garbage 500 nil)");
+    if (!check("(f 2)", 20)) return 0;
+  }
+  printf("Global references survive compaction: OK\n");
+
+  unsigned int n = env_num_global_bindings();
+  eval("(define typos (lambda () (list tpyo-1 tpyo-2 tpyo-3)))");
+  if (env_num_global_bindings() != n + 4) {
+    printf("Error %u bindings added\n", env_num_global_bindings() - n);
+    return 0;
+  }
+  printf("Undefined names bound to not_found: OK\n");
+
+  eval("(define is-even (lambda (x) (if (= x 0) 1 (is-odd (- x 1)))))");
+  eval("(define is-odd (lambda (x) (if (= x 0) 0 (is-even (- x 1)))))");
+  UINT even_sym;
+  if (!symrepr_lookup("is-even", &even_sym)) return 0;
+  VALUE even = env_lookup(enc_sym(even_sym), *env_get_global_ptr());
+  VALUE call = car(cdr(cdr(cdr(car(cdr(cdr(even)))))));
+  if (type_of(car(call)) != PTR_TYPE_GLOBAL_REF) {
+    printf("Error reference to a later define not resolved\n");
+    return 0;
+  }
+  if (!check("(is-even 10)", 1) || !check("(is-even 7)", 0)) return 0;
+  printf("Mutual recursion resolved: OK\n");
+
+  // The failing define leaves ext-b bound to nothing
+  eval("(define ext-b (not-a-function 1))");
+  eval("(define use-a (lambda (x) (ext-a x)))");
+  eval("(define use-b (lambda (x) (ext-b x)))");
+  if (!extensions_add("ext-a", ext_inc) ||
+      !extensions_add("ext-b", ext_inc)) {
+    printf("Error adding extensions\n");
+    return 0;
+  }
+  if (!check("(use-a 1)", 2) || !check("(use-b 2)", 3)) return 0;
+  printf("Extensions added after the lambda: OK\n");
+  return 1;
+}
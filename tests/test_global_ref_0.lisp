@@ -0,0 +1,13 @@
+(define g (lambda (x) (+ x 1)))
+
+(define f (lambda (x) (g x)))
+
+(define a (f 1))
+
+(define g (lambda (x) (* x 10)))
+
+(define h (lambda () later))
+
+(define later 42)
+
+(and (= a 2) (= (f 1) 10) (= (h) 42))
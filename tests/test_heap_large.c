@@ -0,0 +1,72 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "heap.h"
+#include "symrepr.h"
+
+// One more cell than a 32 bit value can point to
+#define NUM_CELLS (0x800000u + 1)
+
+/* With -D_VALUE64 builds a list through a heap that is too large for
+   32 bit pointers and collects it. Without, the heap is refused. */
+int main(int argc, char **argv) {
+
+  if (!symrepr_init()) {
+    printf("Error initializing symrepr\n");
+    return 0;
+  }
+
+#ifndef _VALUE64
+  if (heap_init(NUM_CELLS)) {
+    printf("Error heap of %u cells accepted\n", NUM_CELLS);
+    return 0;
+  }
+  printf("Heap of %u cells refused: OK\n", NUM_CELLS);
+  return 1;
+#else
+  if (!heap_init(NUM_CELLS)) {
+    printf("Error initializing heap\n");
+    return 0;
+  }
+  printf("Initialized heap of %u cells: OK\n", NUM_CELLS);
+
+  VALUE nil = enc_sym(symrepr_nil());
+  VALUE list = nil;
+  for (unsigned int i = 0; i < NUM_CELLS; i ++) {
+    list = cons(enc_u(i), list);
+    if (!is_ptr(list)) {
+      printf("Error allocating cell %u\n", i);
+      return 0;
+    }
+  }
+  if (dec_ptr(list) != NUM_CELLS - 1) {
+    printf("Error last cell at %u\n", dec_ptr(list));
+    return 0;
+  }
+
+  heap_perform_gc_aux(list, nil, nil, nil, nil, NULL, 0);
+
+  VALUE curr = list;
+  for (unsigned int i = NUM_CELLS; i > 0; i --) {
+    if (dec_u(car(curr)) != i - 1) {
+      printf("Error element %u corrupted\n", i - 1);
+      return 0;
+    }
+    curr = cdr(curr);
+  }
+  if (curr != nil || heap_num_allocated() != NUM_CELLS) {
+    printf("Error list corrupted by GC\n");
+    return 0;
+  }
+  printf("List intact after GC: OK\n");
+
+  heap_perform_gc_aux(nil, nil, nil, nil, nil, NULL, 0);
+  if (heap_num_free() != NUM_CELLS) {
+    printf("Error %u cells free after GC\n", heap_num_free());
+    return 0;
+  }
+  printf("All cells free after GC: OK\n");
+  heap_del();
+  return 1;
+#endif
+}
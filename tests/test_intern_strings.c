@@ -0,0 +1,133 @@
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "symrepr.h"
+#include "memory.h"
+#include "heap.h"
+
+#define HEAP_SIZE   4096
+#define NUM_STRINGS 100
+
+static VALUE roots[NUM_STRINGS];
+
+static void relocate_roots(void) {
+  gc_relocate_aux(roots, NUM_STRINGS);
+}
+
+static void collect(void) {
+  gc_state_inc();
+  gc_mark_freelist();
+  gc_mark_aux(roots, NUM_STRINGS);
+  gc_compact_phase(relocate_roots);
+}
+
+static int intern(VALUE *res, unsigned int i) {
+  char str[32];
+  snprintf(str, 32, "string number %u", i);
+  return heap_intern_string(res, str, (unsigned int)strlen(str));
+}
+
+/* Interns strings, drops every other one and collects. The kept
+   strings must still be found, also after compaction, and the
+   dropped ones must have been removed from the table and freed,
+   also if they are not yet swept. */
+static int run(char *name, uint32_t options) {
+
+  if (!heap_init_ext(HEAP_SIZE, options)) {
+    printf("Error initializing heap\n");
+    return 0;
+  }
+
+  VALUE a, b, c, s;
+  if (!heap_intern_string(&a, "hello world", 11) ||
+      !heap_intern_string(&b, "hello world", 11) ||
+      !heap_intern_string(&c, "hello world!", 12) ||
+      !heap_intern_string(&s, "ab", 2)) {
+    printf("Error interning strings\n");
+    return 0;
+  }
+  if (a != b || a == c || !array_is_interned(a) ||
+      array_is_interned(s) || strcmp(array_data(b), "hello world") != 0) {
+    printf("Error equal strings not shared\n");
+    return 0;
+  }
+
+  VALUE nil = enc_sym(symrepr_nil());
+  VALUE dropped[NUM_STRINGS];
+  for (unsigned int i = 0; i < NUM_STRINGS; i ++) {
+    if (!intern(&roots[i], i)) {
+      printf("Error interning string %u\n", i);
+      return 0;
+    }
+    dropped[i] = roots[i];
+    if (i % 2) roots[i] = nil;
+  }
+
+  collect();
+
+  // Strings that are not yet swept are still in the table
+  heap_state_t hs;
+  heap_get_state(&hs);
+  if (!hs.lazy_sweep && hs.num_interned != NUM_STRINGS / 2) {
+    printf("Error %u strings interned after collection\n", hs.num_interned);
+    return 0;
+  }
+
+  for (unsigned int i = 0; i < NUM_STRINGS; i ++) {
+    VALUE v;
+    if (!intern(&v, i)) {
+      printf("Error interning string %u again\n", i);
+      return 0;
+    }
+    if ((i % 2 == 0 && v != roots[i]) ||
+	(i % 2 == 1 && v == dropped[i] && !hs.compacting)) {
+      printf("Error string %u %s\n", i, i % 2 ? "resurrected" : "not found");
+      return 0;
+    }
+    roots[i] = v;
+  }
+
+  collect();
+
+  for (unsigned int i = 0; i < NUM_STRINGS; i ++) {
+    char str[32];
+    VALUE v;
+    snprintf(str, 32, "string number %u", i);
+    if (!intern(&v, i) || v != roots[i] ||
+	strcmp(array_data(v), str) != 0) {
+      printf("Error string %u corrupted\n", i);
+      return 0;
+    }
+  }
+  heap_get_state(&hs);
+  printf("%-12s %u interned, %u hits: OK\n", name, hs.num_interned, hs.num_intern_hits);
+  heap_del();
+  return 1;
+}
+
+int main(int argc, char **argv) {
+
+  unsigned char *memory = malloc(MEMORY_SIZE_16K);
+  unsigned char *bitmap = malloc(MEMORY_BITMAP_SIZE_16K);
+  if (memory == NULL || bitmap == NULL) return 0;
+
+  if (!memory_init(memory, MEMORY_SIZE_16K,
+		   bitmap, MEMORY_BITMAP_SIZE_16K)) {
+    printf("Error initializing memory\n");
+    return 0;
+  }
+
+  if (!symrepr_init()) {
+    printf("Error initializing symrepr\n");
+    return 0;
+  }
+
+  if (!run("default", HEAP_INTERN_STRINGS) ||
+      !run("lazy", HEAP_INTERN_STRINGS | HEAP_LAZY_SWEEP) ||
+      !run("compacting", HEAP_INTERN_STRINGS | HEAP_COMPACTING)) {
+    return 0;
+  }
+  return 1;
+}
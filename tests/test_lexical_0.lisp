@@ -0,0 +1,10 @@
+(define f (lambda (x) (> x 0)))
+
+(define g (lambda (y) (if (f y) y 7)))
+
+(define h (lambda (a b)
+	    (let ((c (+ a b)))
+	      (let ((a (* c 10)))
+		(progn (f c) (list a b c))))))
+
+(and (= (g 5) 5) (= (g 0) 7) (= (h 1 2) '(30 2 3)))
@@ -0,0 +1,9 @@
+(define x 100)
+
+(define f (lambda (x y)
+	    (let ((g (lambda (z) (+ y z)))
+		  (w (+ x 1)))
+	      (let ((x w))
+		(list (g 1) x 'x (eval 'x))))))
+
+(= (f 1 10) '(11 2 x 2))
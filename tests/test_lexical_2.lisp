@@ -0,0 +1,5 @@
+(define code '(lambda (x) (+ x 1)))
+
+(define g (eval code))
+
+(and (= (car code) 'lambda) (= (g 3) 4) (= (g 4) 5) (= (car code) 'lambda))
@@ -0,0 +1,11 @@
+(define f (lambda (a b c d e)
+            (let ((odd (lambda (n) (if (= n 0) nil (even (- n 1)))))
+                  (even (lambda (n) (if (= n 0) 't (odd (- n 1)))))
+                  (k (+ a e)))
+              (lambda (x) (list (even x) (+ x b d k))))))
+
+(define h (f 1 2 3 4 5))
+
+(and (= (car (h 10)) 't)
+     (= (car (h 7)) nil)
+     (= (car (cdr (h 10))) 22))
@@ -63,13 +63,15 @@ int main(int argc, char **argv) {
   unsigned int heap_size = 8 * 1024 * 1024;  // 8 Megabytes is standard  
   bool growing_continuation_stack = false;
   bool compress_decompress = false;
+  bool compacting = false;
+  bool intern_strings = false;
 
   pthread_t lispbm_thd;
   
   int c;
   opterr = 1;
   
-  while (( c = getopt(argc, argv, "gch:")) != -1) {
+  while (( c = getopt(argc, argv, "gcmsh:")) != -1) {
     switch (c) {
     case 'h':
       heap_size = (unsigned int)atoi((char *)optarg);
@@ -80,6 +82,12 @@ int main(int argc, char **argv) {
     case 'c':
       compress_decompress = true;
       break;
+    case 'm':
+      compacting = true;
+      break;
+    case 's':
+      intern_strings = true;
+      break;
     case '?':
       break;
     default:
@@ -90,6 +98,8 @@ int main(int argc, char **argv) {
   printf("Heap size: %u\n", heap_size);
   printf("Growing stack: %s\n", growing_continuation_stack ? "yes" : "no");
   printf("Compression: %s\n", compress_decompress ? "yes" : "no");
+  printf("Compacting heap: %s\n", compacting ? "yes" : "no");
+  printf("Interned strings: %s\n", intern_strings ? "yes" : "no");
   printf("------------------------------------------------------------\n");
 	 
   if (argc - optind < 1) {
@@ -142,7 +152,9 @@ int main(int argc, char **argv) {
     return 0;
   } 
   
-  res = heap_init(heap_size);
+  res = heap_init_ext(heap_size,
+		      (compacting ? HEAP_COMPACTING : 0) |
+		      (intern_strings ? HEAP_INTERN_STRINGS : 0));
   if (res)
     printf("Heap initialized. Heap size: %f MiB. Free cons cells: %d\n", heap_size_bytes() / 1024.0 / 1024.0, heap_num_free());
   else {
@@ -0,0 +1,191 @@
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "memory.h"
+
+#define ROUNDS   20000
+#define MAX_LIVE 64
+
+static uint32_t *live[MAX_LIVE];
+static uint32_t live_size[MAX_LIVE];
+
+/* Allocates and frees blocks of random sizes, writing a pattern into
+   each block, and checks that no two live blocks overlap and that
+   memory_num_free agrees with what is live. In the end everything is
+   freed and the whole arena must be allocatable as one block. */
+static int run(unsigned char *memory, unsigned char *bitmap, uint32_t options) {
+
+  if (!memory_init_ext(memory, MEMORY_SIZE_16K,
+		       bitmap, MEMORY_BITMAP_SIZE_16K, options)) {
+    printf("Error initializing memory\n");
+    return 0;
+  }
+
+  uint32_t num_words = memory_num_words();
+  uint32_t *arena = (uint32_t *)memory;
+  unsigned int seed = 1;
+  uint32_t used = 0;
+
+  for (int i = 0; i < MAX_LIVE; i ++) {
+    live[i] = NULL;
+  }
+
+  for (int r = 0; r < ROUNDS; r ++) {
+    seed = seed * 1103515245 + 12345;
+    unsigned int slot = (seed >> 8) % MAX_LIVE;
+
+    if (live[slot]) {
+      for (uint32_t j = 0; j < live_size[slot]; j ++) {
+	if (live[slot][j] != slot) {
+	  printf("Error block %u overwritten in round %d\n", slot, r);
+	  return 0;
+	}
+      }
+      if (!memory_free(live[slot])) {
+	printf("Error freeing block %u in round %d\n", slot, r);
+	return 0;
+      }
+      used -= live_size[slot];
+      live[slot] = NULL;
+    } else {
+      uint32_t n = 1 + (seed >> 16) % (seed & 0x100 ? 8 : 200);
+      uint32_t *p = memory_allocate(n);
+      if (p) {
+	if (p < arena || p + n > arena + num_words) {
+	  printf("Error block outside of memory in round %d\n", r);
+	  return 0;
+	}
+	for (uint32_t j = 0; j < n; j ++) {
+	  p[j] = slot;
+	}
+	live[slot] = p;
+	live_size[slot] = n;
+	used += n;
+      }
+    }
+
+    if (memory_num_free() != num_words - used) {
+      printf("Error %u words free, expected %u, in round %d\n",
+	     memory_num_free(), num_words - used, r);
+      return 0;
+    }
+  }
+
+  // The longest free block can be allocated and nothing longer
+  uint32_t longest = memory_longest_free();
+  if (memory_allocate(longest + 1) != NULL) {
+    printf("Error allocated more than the longest free block\n");
+    return 0;
+  }
+  uint32_t *p = memory_allocate(longest);
+  if (longest > 0 && p == NULL) {
+    printf("Error could not allocate the longest free block\n");
+    return 0;
+  }
+  if (p) memory_free(p);
+
+  for (int i = 0; i < MAX_LIVE; i ++) {
+    if (live[i]) memory_free(live[i]);
+  }
+  if (memory_longest_free() != num_words) {
+    printf("Error free memory is fragmented after freeing everything\n");
+    return 0;
+  }
+  uint32_t *all = memory_allocate(num_words);
+  if (all == NULL || memory_num_free() != 0 || memory_allocate(1) != NULL) {
+    printf("Error memory not free after freeing everything\n");
+    return 0;
+  }
+  memory_free(all);
+  return 1;
+}
+
+/* Freeing a block twice fails and leaves its bin and the count of
+   free words as they were. */
+static int double_free(unsigned char *memory, unsigned char *bitmap) {
+
+  if (!memory_init_ext(memory, MEMORY_SIZE_16K,
+		       bitmap, MEMORY_BITMAP_SIZE_16K, MEMORY_SIZE_CLASSES)) {
+    printf("Error initializing memory\n");
+    return 0;
+  }
+
+  uint32_t num_words = memory_num_words();
+  uint32_t *p = memory_allocate(4);
+  uint32_t *one = memory_allocate(1);
+  if (p == NULL || one == NULL ||
+      !memory_free(p) || !memory_free(one)) {
+    printf("Error allocating and freeing\n");
+    return 0;
+  }
+  if (memory_free(p) || memory_free(one)) {
+    printf("Error block freed twice\n");
+    return 0;
+  }
+  if (memory_num_free() != num_words) {
+    printf("Error %u words free after freeing twice\n", memory_num_free());
+    return 0;
+  }
+  uint32_t *q = memory_allocate(4);
+  uint32_t *r = memory_allocate(4);
+  if (q == NULL || r == NULL || q == r) {
+    printf("Error bin corrupted by freeing twice\n");
+    return 0;
+  }
+  return 1;
+}
+
+/* memory_longest_free counts binned blocks as free and leaves them in
+   their bins. */
+static int longest_keeps_bins(unsigned char *memory, unsigned char *bitmap) {
+
+  if (!memory_init_ext(memory, MEMORY_SIZE_16K,
+		       bitmap, MEMORY_BITMAP_SIZE_16K, MEMORY_SIZE_CLASSES)) {
+    printf("Error initializing memory\n");
+    return 0;
+  }
+
+  uint32_t *p = memory_allocate(4);
+  if (p == NULL || !memory_free(p)) {
+    printf("Error allocating and freeing\n");
+    return 0;
+  }
+  if (memory_longest_free() != memory_num_words()) {
+    printf("Error binned blocks not counted as free\n");
+    return 0;
+  }
+  if (memory_allocate(4) != p) {
+    printf("Error bins emptied by memory_longest_free\n");
+    return 0;
+  }
+  return 1;
+}
+
+int main(int argc, char **argv) {
+
+  unsigned char *memory = malloc(MEMORY_SIZE_16K);
+  unsigned char *bitmap = malloc(MEMORY_BITMAP_SIZE_16K);
+  if (memory == NULL || bitmap == NULL) return 0;
+
+  if (!run(memory, bitmap, 0)) return 0;
+  printf("First fit: OK\n");
+
+  if (!run(memory, bitmap, MEMORY_SIZE_CLASSES)) return 0;
+  printf("Size classes: OK\n");
+
+  if (!run(memory, bitmap, MEMORY_NEXT_FIT)) return 0;
+  printf("Next fit: OK\n");
+
+  if (!run(memory, bitmap, MEMORY_NEXT_FIT | MEMORY_SIZE_CLASSES)) return 0;
+  printf("Next fit with size classes: OK\n");
+
+  if (!double_free(memory, bitmap)) return 0;
+  printf("Double free: OK\n");
+
+  if (!longest_keeps_bins(memory, bitmap)) return 0;
+  printf("Longest free block without flushing the bins: OK\n");
+  return 1;
+}
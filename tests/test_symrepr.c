@@ -0,0 +1,77 @@
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "symrepr.h"
+#include "memory.h"
+
+#define NUM_SYMBOLS 2000
+
+int main(int argc, char **argv) {
+
+  int res = 1;
+  char name[32];
+  UINT id;
+
+  unsigned char *memory = malloc(MEMORY_SIZE_64BYTES_TIMES_X(2048));
+  unsigned char *bitmap = malloc(MEMORY_BITMAP_SIZE(2048));
+  if (memory == NULL || bitmap == NULL) return 0;
+
+  res = memory_init(memory, MEMORY_SIZE_64BYTES_TIMES_X(2048),
+		    bitmap, MEMORY_BITMAP_SIZE(2048));
+  if (!res) {
+    printf("Error initializing memory\n");
+    return 0;
+  }
+
+  res = symrepr_init();
+  if (!res) {
+    printf("Error initializing symrepr\n");
+    return 0;
+  }
+  printf("Initialized symrepr: OK\n");
+
+  if (!symrepr_lookup("define", &id) || id != DEF_REPR_DEFINE ||
+      !symrepr_lookup("is-fundamental", &id) || id != SYM_IS_FUNDAMENTAL ||
+      !symrepr_lookup("+", &id) || id != SYM_ADD ||
+      strcmp(symrepr_lookup_name(SYM_TYPE_OF), "type-of") != 0 ||
+      strcmp(symrepr_lookup_name(DEF_REPR_NIL), "nil") != 0) {
+    printf("Error looking up special symbol\n");
+    return 0;
+  }
+  printf("Special symbol lookup: OK\n");
+
+  for (int i = 0; i < NUM_SYMBOLS; i ++) {
+    snprintf(name, 32, "symbol-%d", i);
+    if (symrepr_lookup(name, &id)) {
+      printf("Error symbol %s found before added\n", name);
+      return 0;
+    }
+    if (!symrepr_addsym(name, &id) ||
+	id != (UINT)(MAX_SPECIAL_SYMBOLS + i)) {
+      printf("Error adding symbol %s\n", name);
+      return 0;
+    }
+  }
+  printf("Added %d symbols: OK\n", NUM_SYMBOLS);
+
+  for (int i = 0; i < NUM_SYMBOLS; i ++) {
+    snprintf(name, 32, "symbol-%d", i);
+    if (!symrepr_lookup(name, &id) ||
+	id != (UINT)(MAX_SPECIAL_SYMBOLS + i) ||
+	strcmp(symrepr_lookup_name(id), name) != 0) {
+      printf("Error looking up symbol %s\n", name);
+      return 0;
+    }
+  }
+  printf("Symbol lookup: OK\n");
+
+  symrepr_del();
+  if (memory_num_free() != memory_num_words()) {
+    printf("Error symrepr_del leaks memory\n");
+    return 0;
+  }
+  printf("Symrepr del: OK\n");
+  return 1;
+}
@@ -0,0 +1,241 @@
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "heap.h"
+#include "symrepr.h"
+#include "memory.h"
+#include "tokpar.h"
+#include "print.h"
+
+#define LIST_LENGTH 10000
+#define NESTING     10000 // deeper than the parser stack may grow
+#define DEEP        1000
+#define KEEP_LENGTH 1000
+
+static VALUE keep;
+
+static void mark_keep(void) {
+  gc_mark_phase(keep);
+}
+
+static void relocate_keep(void) {
+  keep = gc_relocate(keep);
+}
+
+static bool check_list(VALUE l) {
+  for (int i = 0; i < LIST_LENGTH; i ++) {
+    if (type_of(l) != PTR_TYPE_CONS ||
+	(i % 100 == 0 && type_of(car(l)) != PTR_TYPE_ARRAY) ||
+	(i % 100 != 0 && dec_i(car(l)) != i)) {
+      return false;
+    }
+    l = cdr(l);
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+
+  int res = 1;
+
+  unsigned char *memory = malloc(MEMORY_SIZE_16K);
+  unsigned char *bitmap = malloc(MEMORY_BITMAP_SIZE_16K);
+  if (memory == NULL || bitmap == NULL) return 0;
+
+  res = memory_init(memory, MEMORY_SIZE_16K,
+		    bitmap, MEMORY_BITMAP_SIZE_16K);
+  if (!res) {
+    printf("Error initializing memory\n");
+    return 0;
+  }
+
+  res = symrepr_init();
+  if (!res) {
+    printf("Error initializing symrepr\n");
+    return 0;
+  }
+
+  res = heap_init(65536);
+  if (!res) {
+    printf("Error initializing heap\n");
+    return 0;
+  }
+  printf("Initialized: OK\n");
+
+  /* A long quoted list */
+  char *src = malloc(LIST_LENGTH * 10 + 16);
+  if (!src) return 0;
+  strcpy(src, "'(");
+  size_t pos = 2;
+  for (int i = 0; i < LIST_LENGTH; i ++) {
+    pos += (size_t)sprintf(src + pos, "%d ", i);
+  }
+  strcpy(src + pos, ")");
+
+  VALUE prg = tokpar_parse(src);
+  if (type_of(prg) != PTR_TYPE_CONS ||
+      type_of(cdr(prg)) != VAL_TYPE_SYMBOL) {
+    printf("Error parsing long list\n");
+    return 0;
+  }
+  VALUE l = car(cdr(car(prg)));
+  for (int i = 0; i < LIST_LENGTH; i ++) {
+    if (type_of(l) != PTR_TYPE_CONS ||
+	dec_i(car(l)) != i) {
+      printf("Error in long list at %d\n", i);
+      return 0;
+    }
+    l = cdr(l);
+  }
+  if (l != enc_sym(symrepr_nil())) {
+    printf("Error long list not terminated\n");
+    return 0;
+  }
+  printf("Long list: OK\n");
+
+  /* A long program */
+  pos = 0;
+  for (int i = 0; i < LIST_LENGTH; i ++) {
+    pos += (size_t)sprintf(src + pos, "%d ", i);
+  }
+  prg = tokpar_parse(src);
+  int n = 0;
+  while (type_of(prg) == PTR_TYPE_CONS) {
+    n ++;
+    prg = cdr(prg);
+  }
+  if (n != LIST_LENGTH) {
+    printf("Error parsing long program\n");
+    return 0;
+  }
+  printf("Long program: OK\n");
+
+  /* Parsing into a heap full of garbage */
+  while (heap_num_free() > 0) {
+    heap_allocate_cell(PTR_TYPE_CONS);
+  }
+  pos = 0;
+  strcpy(src, "'(");
+  pos = 2;
+  for (int i = 0; i < LIST_LENGTH; i ++) {
+    if (i % 100 == 0) {
+      pos += (size_t)sprintf(src + pos, "\"%d\" ", i);
+    } else {
+      pos += (size_t)sprintf(src + pos, "%d ", i);
+    }
+  }
+  strcpy(src + pos, ")");
+  prg = tokpar_parse(src);
+  if (type_of(prg) != PTR_TYPE_CONS) {
+    printf("Error parsing with full heap\n");
+    return 0;
+  }
+  if (!check_list(car(cdr(car(prg))))) {
+    printf("Error in list parsed with full heap\n");
+    return 0;
+  }
+  printf("Parse with GC: OK\n");
+
+  /* The same into a compacting heap, full of garbage interleaved
+     with a list that the caller keeps */
+  heap_del();
+  if (!heap_init_ext(65536, HEAP_COMPACTING) ||
+      !tokpar_add_roots_callbacks(mark_keep, relocate_keep)) {
+    printf("Error initializing compacting heap\n");
+    return 0;
+  }
+  heap_set_gc_compact_interval(1);
+  keep = enc_sym(symrepr_nil());
+  for (int i = 0; heap_num_free() > 0; i ++) {
+    VALUE c = heap_allocate_cell(PTR_TYPE_CONS);
+    if (i % 50 == 0 && i / 50 < KEEP_LENGTH) {
+      set_car(c, enc_i(i / 50));
+      set_cdr(c, keep);
+      keep = c;
+    }
+  }
+  prg = tokpar_parse(src);
+  heap_state_t hs;
+  heap_get_state(&hs);
+  if (type_of(prg) != PTR_TYPE_CONS ||
+      hs.gc_num_compactions == 0 ||
+      !check_list(car(cdr(car(prg))))) {
+    printf("Error parsing with compaction\n");
+    return 0;
+  }
+  for (int i = KEEP_LENGTH - 1; i >= 0; i --) {
+    if (type_of(keep) != PTR_TYPE_CONS || dec_i(car(keep)) != i) {
+      printf("Error roots of the caller lost in compaction at %d\n", i);
+      return 0;
+    }
+    keep = cdr(keep);
+  }
+  printf("Parse with compaction: OK\n");
+  free(src);
+
+  /* Nesting that grows the parser stack, and nesting deeper than it
+     may grow */
+  src = malloc(NESTING * 2 + 1);
+  if (!src) return 0;
+  for (int i = 0; i < DEEP; i ++) {
+    src[i] = '(';
+    src[DEEP + i] = ')';
+  }
+  src[DEEP * 2] = 0;
+  prg = tokpar_parse(src);
+  VALUE curr = prg;
+  int depth = 0;
+  while (type_of(curr) == PTR_TYPE_CONS) {
+    curr = car(curr);
+    depth ++;
+  }
+  if (depth != DEEP || curr != enc_sym(symrepr_nil())) {
+    printf("Error nesting of %d levels read as %d\n", DEEP, depth);
+    return 0;
+  }
+  for (int i = 0; i < NESTING; i ++) {
+    src[i] = '(';
+    src[NESTING + i] = ')';
+  }
+  src[NESTING * 2] = 0;
+  prg = tokpar_parse(src);
+  if (type_of(prg) != VAL_TYPE_SYMBOL ||
+      dec_sym(prg) != symrepr_depth_error()) {
+    printf("Error deep nesting should result in depth_error\n");
+    return 0;
+  }
+  free(src);
+  printf("Deep nesting: OK\n");
+
+  /* Unbalanced parentheses */
+  prg = tokpar_parse("(a (b c)");
+  if (type_of(prg) != VAL_TYPE_SYMBOL ||
+      dec_sym(prg) != symrepr_rerror()) {
+    printf("Error unbalanced parentheses\n");
+    return 0;
+  }
+  // A ) that closes no list is a read_error, not ignored
+  prg = tokpar_parse("(a b))");
+  if (type_of(prg) != VAL_TYPE_SYMBOL ||
+      dec_sym(prg) != symrepr_rerror()) {
+    printf("Error unbalanced parentheses\n");
+    return 0;
+  }
+  prg = tokpar_parse("(a ')");
+  if (type_of(prg) != VAL_TYPE_SYMBOL ||
+      dec_sym(prg) != symrepr_rerror()) {
+    printf("Error ) after a quote\n");
+    return 0;
+  }
+  printf("Unbalanced: OK\n");
+
+  char output[1024];
+  char error[1024];
+  prg = tokpar_parse("(define f (lambda (x) `(a ,x ,@x 'b \"str\" 1u28 2i32 3.0)))");
+  print_value(output, 1024, error, 1024, prg);
+  printf("%s\n", output);
+  return 1;
+}